@@ -0,0 +1,548 @@
+#include "gb/batch.hpp"
+#include "gb/bus.hpp"
+#include "gb/compositor.hpp"
+#include "gb/cpu.hpp"
+#include "gb/emulator.hpp"
+#include "gb/joypad.hpp"
+#include "gb/ppu.hpp"
+#include "gb/timer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+#ifndef GBEMU_JIT
+#define GBEMU_JIT 0
+#endif
+#ifndef GBEMU_SIMD
+#define GBEMU_SIMD 0
+#endif
+#ifndef GBEMU_COMMIT
+#define GBEMU_COMMIT "unknown"
+#endif
+#ifndef GBEMU_BUILD_TYPE
+#define GBEMU_BUILD_TYPE ""
+#endif
+
+/*
+ * Micro-benchmarks of the hot paths (CPU::step and CPU::run over synthetic
+ * instruction mixes, Bus::read8/write8 per region, PPU::pixel_transfer on
+ * canned VRAM/OAM, Timer::tick, Bus::oam_dma) and macro-benchmarks of ROMs
+ * run headless for a number of frames. Prints a table, or JSON with host,
+ * compiler and commit metadata for tracking results over time.
+ */
+namespace {
+	using my_clock = std::chrono::steady_clock;
+	using gb::u8;
+	using gb::u16;
+	using gb::u64;
+
+	struct Options {
+		double seconds = 0.3;  // per micro-benchmark
+		long long frames = 600; // per macro-benchmark
+		std::string filter;     // substring of the names to run
+		std::string roms = "roms";
+		std::string bootrom;    // default <roms>/bootix_dmg.bin
+		std::vector<std::string> games; // default: GAMES found in roms
+		std::string json;       // "-": stdout
+	};
+
+	const char* GAMES[] = {"Tetris.gb", "Dr. Mario.gb"};
+
+	struct Result {
+		std::string name;
+		std::string unit;   // of value
+		double value = 0;   // ns per op (micro) or frames per second (macro)
+		double rate = 0;    // ops per second (micro) or guest MIPS (macro)
+		u64 iterations = 0;
+	};
+
+	void usage() {
+		std::cout <<
+			"usage: gbemu_bench [options] [rom...]\n"
+			"  --seconds <s>        time per micro-benchmark (default 0.3)\n"
+			"  --frames <n>         frames per macro-benchmark (default 600)\n"
+			"  --filter <text>      only benchmarks whose name contains text\n"
+			"  --roms <dir>         where the macro-benchmark ROMs are (default roms)\n"
+			"  --bootrom <file>     boot ROM (default <roms>/bootix_dmg.bin)\n"
+			"  --json <file>        write results as JSON, - for stdout\n"
+			"ROMs given on the command line replace Tetris and Dr. Mario.\n";
+	}
+
+	bool parse_options(int argc, char** argv, Options& options) {
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+			try {
+				if(arg == "--seconds" || arg == "--frames" || arg == "--filter" || arg == "--roms" ||
+						arg == "--bootrom" || arg == "--json") {
+					const char* v = value();
+					if(!v) {
+						std::cerr << arg << " needs a value\n";
+						return false;
+					}
+					if(arg == "--seconds") options.seconds = std::stod(v);
+					else if(arg == "--frames") options.frames = std::stoll(v);
+					else if(arg == "--filter") options.filter = v;
+					else if(arg == "--roms") options.roms = v;
+					else if(arg == "--bootrom") options.bootrom = v;
+					else if(arg == "--json") options.json = v;
+				}
+				else if(arg == "-h" || arg == "--help") return false;
+				else if(!arg.empty() && arg[0] == '-') {
+					std::cerr << "unknown option: " << arg << "\n";
+					return false;
+				}
+				else options.games.push_back(arg);
+			} catch(const std::exception&) {
+				std::cerr << "bad value for " << arg << "\n";
+				return false;
+			}
+		}
+		if(options.bootrom.empty()) options.bootrom = (std::filesystem::path(options.roms) / "bootix_dmg.bin").string();
+		return true;
+	}
+
+	const char* decoder_name(gb::Decoder decoder) {
+		switch(decoder) {
+			case gb::Decoder::Switch: return "switch";
+			case gb::Decoder::Table: return "table";
+			case gb::Decoder::Cached: return "cached";
+			case gb::Decoder::Jit: return "jit";
+		}
+		return "?";
+	}
+
+	// Calls run(n) with growing n until seconds have passed; run returns the
+	// ops it did. The first call warms caches and is not counted.
+	Result measure(const std::string& name, double seconds, const std::function<u64(u64)>& run) {
+		run(1);
+		u64 batch = 64, ops = 0;
+		auto start = my_clock::now();
+		double elapsed = 0;
+		while(elapsed < seconds) {
+			ops += run(batch);
+			elapsed = std::chrono::duration<double>(my_clock::now() - start).count();
+			if(elapsed < seconds / 8) batch *= 2;
+		}
+		Result result;
+		result.name = name;
+		result.unit = "ns/op";
+		result.value = elapsed * 1e9 / static_cast<double>(ops);
+		result.rate = static_cast<double>(ops) / elapsed;
+		result.iterations = ops;
+		return result;
+	}
+
+	volatile u8 sink_u8; // keeps benchmark reads alive
+
+	// Synthetic cartridge: MBC1 + 8 KiB RAM, JP 0x0150 at 0x0000 and the
+	// program at 0x0150
+	std::string write_rom(const std::vector<u8>& program) {
+		std::vector<u8> rom(0x8000, 0x00);
+		rom[0x0000] = 0xC3; rom[0x0001] = 0x50; rom[0x0002] = 0x01;
+		rom[0x0147] = 0x02; // MBC1 + RAM, no battery
+		rom[0x0149] = 0x02; // 8 KiB
+		std::copy(program.begin(), program.end(), rom.begin() + 0x0150);
+
+		static int count = 0;
+		std::string name = "gbemu_bench_" + std::to_string(count++);
+#if defined(__unix__) || defined(__APPLE__)
+		name += '_';
+		name += std::to_string(getpid());
+#endif
+		std::filesystem::path path = std::filesystem::temp_directory_path() / (name + ".gb");
+		std::ofstream ofs(path, std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+		return path.string();
+	}
+
+	// Timer, PPU, Joypad, Bus and CPU on a synthetic cartridge, no boot ROM
+	struct Machine {
+		gb::Timer timer;
+		gb::PPU ppu;
+		gb::Joypad joypad;
+		gb::Bus bus{timer, ppu, joypad};
+		gb::CPU cpu{bus};
+
+		explicit Machine(const std::string& rom) {
+			cpu.reset();
+			bus.load_cartridge(rom, false);
+			bus.write8(0x0000, 0x0A); // cartridge RAM on
+		}
+	};
+
+	// Instruction mixes: a body of more than one block (Block::MAX_OPS) so
+	// none of them looks like an idle loop, then JP back
+	struct Mix {
+		const char* name;
+		std::vector<u8> body;
+	};
+
+	std::vector<u8> make_program(const Mix& mix) {
+		// LD HL,0xC000 / LD SP,0xDFF0 / loop: body x n / JP loop / sub: RET
+		std::vector<u8> code = {0x21, 0x00, 0xC0, 0x31, 0xF0, 0xDF};
+		u16 loop = static_cast<u16>(0x0150 + code.size());
+		while(code.size() < 160) code.insert(code.end(), mix.body.begin(), mix.body.end());
+		code.insert(code.end(), {0xC3, static_cast<u8>(loop), static_cast<u8>(loop >> 8)});
+		u16 sub = static_cast<u16>(0x0150 + code.size());
+		code.push_back(0xC9);
+
+		// CALL operands point at the RET
+		for(std::size_t i = 6; i + 2 < code.size(); i++) {
+			if(code[i] == 0xCD && code[i + 1] == 0xEE && code[i + 2] == 0xEE) {
+				code[i + 1] = static_cast<u8>(sub);
+				code[i + 2] = static_cast<u8>(sub >> 8);
+			}
+		}
+		return code;
+	}
+
+	const std::vector<Mix>& mixes() {
+		static const std::vector<Mix> list = {
+			// ADD A,B / XOR C / INC D / DEC E / AND H / OR L / SUB B / CP C / ADC A,D / SBC A,E
+			{"alu", {0x80, 0xA9, 0x14, 0x1D, 0xA4, 0xB5, 0x90, 0xB9, 0x8A, 0x9B}},
+			// LD B,C / LD D,E / LD A,(HL) / LD (HL),A / LD A,(0xC010) / LDH A,(0x80) / LDH (0x81),A / LD C,0x12
+			{"load", {0x41, 0x53, 0x7E, 0x77, 0xFA, 0x10, 0xC0, 0xF0, 0x80, 0xE0, 0x81, 0x0E, 0x12}},
+			// JR +0 / CALL sub / JR NZ,+0 (A != 0 after OR 1) / OR 1 / PUSH BC / POP BC
+			{"branch", {0x18, 0x00, 0xCD, 0xEE, 0xEE, 0xF6, 0x01, 0x20, 0x00, 0xC5, 0xC1}},
+			// SWAP A / BIT 0,A / RES 0,A / SET 0,A / RL C / SRL A
+			{"cb", {0xCB, 0x37, 0xCB, 0x47, 0xCB, 0x87, 0xCB, 0xC7, 0xCB, 0x11, 0xCB, 0x3F}},
+			// A bit of each
+			{"mixed", {0x80, 0x41, 0x7E, 0x18, 0x00, 0xCB, 0x37, 0xA9, 0x77, 0xCD, 0xEE, 0xEE, 0x14, 0xCB, 0x47}},
+		};
+		return list;
+	}
+
+	class Bench {
+		public:
+			explicit Bench(const Options& options) : options_(options) {}
+			~Bench() {
+				for(const std::string& path : temp_files_) {
+					std::error_code error;
+					std::filesystem::remove(path, error);
+				}
+			}
+
+			bool wanted(const std::string& name) const {
+				return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+			}
+
+			void add(const Result& result) {
+				results_.push_back(result);
+				if(options_.json == "-") return;
+				char line[200];
+				std::snprintf(line, sizeof(line), "%-38s %12.2f %-6s %14.0f /s\n",
+						result.name.c_str(), result.value, result.unit.c_str(), result.rate);
+				if(result.unit == "fps") {
+					std::snprintf(line, sizeof(line), "%-38s %12.1f %-6s %11.2f MIPS\n",
+							result.name.c_str(), result.value, result.unit.c_str(), result.rate);
+				}
+				std::cout << line << std::flush;
+			}
+
+			void micro(const std::string& name, const std::function<u64(u64)>& run) {
+				if(wanted(name)) add(measure(name, options_.seconds, run));
+			}
+
+			void cpu();
+			void bus();
+			void ppu();
+			void timer();
+			void macro();
+
+			const std::vector<Result>& get_results() const { return results_; }
+		private:
+			// Synthetic cartridge file, removed with the Bench
+			std::string rom(const std::vector<u8>& program) {
+				temp_files_.push_back(write_rom(program));
+				return temp_files_.back();
+			}
+
+			const Options& options_;
+			std::vector<Result> results_;
+			std::vector<std::string> temp_files_;
+	};
+
+	void Bench::cpu() {
+		for(const Mix& mix : mixes()) {
+			std::string path = rom(make_program(mix));
+
+			// CPU::step (plus the bus tick CPU::run does after it) for the
+			// interpreters, CPU::run for the block engines; ops = instructions
+			for(gb::Decoder decoder : {gb::Decoder::Switch, gb::Decoder::Table}) {
+				auto machine = std::make_unique<Machine>(path);
+				machine->cpu.set_decoder(decoder);
+				micro(std::string("cpu.step/") + mix.name + "/" + decoder_name(decoder), [&](u64 n) {
+					for(u64 i = 0; i < n; i++) machine->bus.tick(machine->cpu.step());
+					return n;
+				});
+			}
+			for(gb::Decoder decoder : {gb::Decoder::Cached, gb::Decoder::Jit}) {
+				auto machine = std::make_unique<Machine>(path);
+				machine->cpu.set_decoder(decoder);
+				micro(std::string("cpu.run/") + mix.name + "/" + decoder_name(decoder), [&](u64 n) {
+					u64 before = machine->cpu.get_instructions();
+					for(u64 i = 0; i < n; i++) machine->cpu.run(456);
+					return machine->cpu.get_instructions() - before;
+				});
+			}
+		}
+	}
+
+	void Bench::bus() {
+		auto machine = std::make_unique<Machine>(rom({0x18, 0xFE})); // JR -2
+		gb::Bus& bus = machine->bus;
+
+		// 256 addresses per region, read or written in turn
+		struct Region {
+			const char* name;
+			u16 base;
+			u16 span;
+		};
+		const Region reads[] = {
+			{"rom0", 0x0000, 0x4000}, {"romx", 0x4000, 0x4000}, {"vram", 0x8000, 0x2000},
+			{"cart_ram", 0xA000, 0x2000}, {"wram", 0xC000, 0x2000}, {"oam", 0xFE00, 0xA0},
+			{"io", 0xFF00, 0x4C}, {"hram", 0xFF80, 0x7F},
+		};
+		for(const Region& region : reads) {
+			micro(std::string("bus.read8/") + region.name, [&](u64 n) {
+				u8 acc = 0;
+				for(u64 i = 0; i < n; i++) acc ^= bus.read8(static_cast<u16>(region.base + (i * 7) % region.span));
+				sink_u8 = acc;
+				return n;
+			});
+		}
+
+		// I/O writes: palette registers only (no DMA, LCD or timer side effects)
+		const Region writes[] = {
+			{"vram", 0x8000, 0x2000}, {"cart_ram", 0xA000, 0x2000}, {"wram", 0xC000, 0x2000},
+			{"oam", 0xFE00, 0xA0}, {"io", 0xFF47, 3}, {"hram", 0xFF80, 0x7F},
+		};
+		for(const Region& region : writes) {
+			micro(std::string("bus.write8/") + region.name, [&](u64 n) {
+				for(u64 i = 0; i < n; i++) bus.write8(static_cast<u16>(region.base + (i * 7) % region.span), static_cast<u8>(i));
+				return n;
+			});
+		}
+
+		micro("bus.oam_dma", [&](u64 n) {
+			for(u64 i = 0; i < n; i++) bus.oam_dma(static_cast<u8>(0xC0 + (i & 0x1F)));
+			return n;
+		});
+	}
+
+	void Bench::ppu() {
+		// Canned state: random tile data and maps, 10 sprites on line 0.
+		// No window: pixel_transfer() does not render it yet.
+		auto make_ppu = [](u8 lcdc) {
+			auto ppu = std::make_unique<gb::PPU>();
+			std::mt19937 random(1);
+			for(u16 addr = 0x8000; addr < 0xA000; addr++) ppu->write8(addr, static_cast<u8>(random()));
+			for(int i = 0; i < 40; i++) {
+				u16 entry = static_cast<u16>(0xFE00 + i * 4);
+				ppu->write8(entry + 0, static_cast<u8>(i < 10 ? 16 : 200)); // y
+				ppu->write8(entry + 1, static_cast<u8>(8 + i * 15));        // x
+				ppu->write8(entry + 2, static_cast<u8>(random()));
+				ppu->write8(entry + 3, static_cast<u8>(random() & 0xF0));
+			}
+			ppu->write8(0xFF47, 0xE4);
+			ppu->write8(0xFF48, 0xD2);
+			ppu->write8(0xFF49, 0x93);
+			ppu->write8(0xFF40, lcdc);
+			ppu->oam_search();
+			return ppu;
+		};
+
+		struct Case {
+			const char* name;
+			u8 lcdc;
+			bool scroll; // change SCX every call, so the line cache misses
+		};
+		const Case cases[] = {
+			{"bg", 0x91, true},
+			{"bg+sprites", 0x93, true},
+			{"cached", 0x93, false},
+		};
+		for(const Case& c : cases) {
+			auto ppu = make_ppu(c.lcdc);
+			micro(std::string("ppu.pixel_transfer/") + c.name, [&](u64 n) {
+				for(u64 i = 0; i < n; i++) {
+					if(c.scroll) ppu->write8(0xFF43, static_cast<u8>(i));
+					ppu->pixel_transfer();
+				}
+				sink_u8 = ppu->get_framebuffer()[0];
+				return n;
+			});
+		}
+
+		// Whole frames through PPU::tick, one scanline per call
+		auto ppu = make_ppu(0x93);
+		micro("ppu.tick/line", [&](u64 n) {
+			for(u64 i = 0; i < n; i++) {
+				ppu->write8(0xFF43, static_cast<u8>(i));
+				ppu->tick(456);
+			}
+			return n;
+		});
+	}
+
+	void Bench::timer() {
+		gb::Timer timer;
+		timer.write8(0xFF07, 0x05); // enabled, 262144 Hz
+		for(int cycles : {4, 456}) {
+			micro("timer.tick/" + std::to_string(cycles), [&](u64 n) {
+				bool fired = false;
+				for(u64 i = 0; i < n; i++) fired |= timer.tick(cycles);
+				sink_u8 = fired;
+				return n;
+			});
+		}
+	}
+
+	void Bench::macro() {
+		std::vector<std::string> games = options_.games;
+		if(games.empty()) {
+			for(const char* game : GAMES) {
+				std::filesystem::path path = std::filesystem::path(options_.roms) / game;
+				if(std::filesystem::exists(path)) games.push_back(path.string());
+			}
+		}
+
+		u64 cycles = static_cast<u64>(options_.frames) * gb::Emulator::CYCLES_PER_FRAME;
+		for(const std::string& game : games) {
+			for(gb::Decoder decoder : {gb::Decoder::Switch, gb::Decoder::Table, gb::Decoder::Cached, gb::Decoder::Jit}) {
+				std::string name = "macro/" + std::filesystem::path(game).stem().string() + "/" + decoder_name(decoder);
+				if(!wanted(name)) continue;
+
+				auto emulator = std::make_unique<gb::Emulator>();
+				emulator->set_decoder(decoder);
+				if(!emulator->load(options_.bootrom, game)) {
+					std::cerr << "load failed: " << game << "\n";
+					continue;
+				}
+				auto start = my_clock::now();
+				u64 ran = emulator->run(cycles);
+				double seconds = std::chrono::duration<double>(my_clock::now() - start).count();
+
+				Result result;
+				result.name = name;
+				result.unit = "fps";
+				result.value = static_cast<double>(ran) / gb::Emulator::CYCLES_PER_FRAME / seconds;
+				result.rate = static_cast<double>(emulator->get_instructions()) / seconds / 1e6;
+				result.iterations = ran / gb::Emulator::CYCLES_PER_FRAME;
+				add(result);
+			}
+		}
+	}
+
+	std::string compiler() {
+#if defined(__clang__)
+		return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+		return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_VER);
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string cpu_model() {
+		std::ifstream ifs("/proc/cpuinfo");
+		std::string line;
+		while(std::getline(ifs, line)) {
+			if(line.rfind("model name", 0) != 0) continue;
+			std::size_t colon = line.find(':');
+			if(colon != std::string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+		}
+		return "unknown";
+	}
+
+	std::string report(const std::vector<Result>& results) {
+		using gb::json_string;
+
+		char text[64];
+		std::time_t now = std::time(nullptr);
+		std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+		std::string host = "unknown", os = "unknown";
+#if defined(__unix__) || defined(__APPLE__)
+		utsname name;
+		if(uname(&name) == 0) {
+			host = name.nodename;
+			os = std::string(name.sysname) + " " + name.release + " " + name.machine;
+		}
+#endif
+
+		std::string out = "{\n  \"meta\": {";
+		out += "\"timestamp\": " + json_string(text);
+		out += ", \"commit\": " + json_string(GBEMU_COMMIT);
+		out += ", \"build_type\": " + json_string(GBEMU_BUILD_TYPE);
+		out += ", \"compiler\": " + json_string(compiler());
+		out += ",\n    \"host\": " + json_string(host);
+		out += ", \"os\": " + json_string(os);
+		out += ", \"cpu\": " + json_string(cpu_model());
+		out += ", \"threads\": " + std::to_string(std::thread::hardware_concurrency());
+		out += ",\n    \"jit\": " + std::to_string(GBEMU_JIT);
+		out += ", \"lazy_flags\": " + std::to_string(GBEMU_LAZY_FLAGS);
+		out += ", \"simd\": " + std::to_string(GBEMU_SIMD);
+		out += ", \"compositor\": " + json_string(gb::compose::backend());
+		out += "},\n  \"results\": [\n";
+		for(std::size_t i = 0; i < results.size(); i++) {
+			const Result& result = results[i];
+			out += "    {\"name\": " + json_string(result.name);
+			out += ", \"unit\": " + json_string(result.unit);
+			std::snprintf(text, sizeof(text), "%.4f", result.value);
+			out += ", \"value\": " + std::string(text);
+			std::snprintf(text, sizeof(text), "%.4f", result.rate);
+			out += std::string(result.unit == "fps" ? ", \"mips\": " : ", \"ops_per_second\": ") + text;
+			out += ", \"iterations\": " + std::to_string(result.iterations);
+			out += (i + 1 < results.size()) ? "},\n" : "}\n";
+		}
+		out += "  ]\n}\n";
+		return out;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if(!parse_options(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+
+	Bench bench(options);
+	bench.cpu();
+	bench.bus();
+	bench.ppu();
+	bench.timer();
+	bench.macro();
+
+	if(options.json.empty()) return 0;
+	std::string json = report(bench.get_results());
+	if(options.json == "-") {
+		std::cout << json;
+		return 0;
+	}
+	std::ofstream ofs(options.json, std::ios::binary);
+	if(!(ofs << json)) {
+		std::cout << "cannot write " << options.json << "\n";
+		return 1;
+	}
+	return 0;
+}
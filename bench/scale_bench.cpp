@@ -0,0 +1,63 @@
+#include "gb/scaler.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+/*
+ * Frames per second of each upscaling filter at 3x and 4x, full frames
+ * (every row dirty). Usage: gbemu_scale_bench [seconds per case]
+ */
+namespace {
+	using my_clock = std::chrono::steady_clock;
+
+	// Scrolling tiles, diagonals and text-like strokes: plenty of edges
+	std::vector<gb::u8> make_frame(int frame) {
+		std::vector<gb::u8> shades(160 * 144);
+		for(int y = 0; y < 144; y++) {
+			for(int x = 0; x < 160; x++) {
+				int sx = x + frame, sy = y + frame / 2;
+				gb::u8 shade = static_cast<gb::u8>(((sx >> 3) ^ (sy >> 3)) & 0x1);
+				if(((sx + sy) & 0xF) == 0) shade = 3;
+				if((sx & 0x7) == 3 && (sy & 0xF) < 10) shade = 2;
+				shades[y * 160 + x] = shade;
+			}
+		}
+		return shades;
+	}
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+
+	std::vector<std::vector<gb::u8>> frames;
+	for(int i = 0; i < 16; i++) frames.push_back(make_frame(i));
+
+	std::cout << "backend: " << gb::compose::backend() << "\n";
+	std::cout << std::left << std::setw(10) << "filter" << std::setw(8) << "factor" << "fps\n";
+	for(auto filter : {gb::scale::Filter::Nearest, gb::scale::Filter::ScaleNx, gb::scale::Filter::XbrLite, gb::scale::Filter::LcdGrid}) {
+		for(int factor : {3, 4}) {
+			gb::scale::Scaler scaler(filter, factor);
+			std::vector<gb::u32> out(scaler.get_width() * scaler.get_height());
+			int pitch = scaler.get_width() * 4;
+
+			// 1. Warm up, then run for the given time
+			scaler.run(frames[0].data(), gb::DMG_GRAY, 0, 144, out.data(), pitch);
+			long count = 0;
+			auto start = my_clock::now();
+			auto end = start + std::chrono::duration_cast<my_clock::duration>(std::chrono::duration<double>(seconds));
+			while(my_clock::now() < end) {
+				for(int i = 0; i < 16; i++, count++) {
+					scaler.run(frames[i].data(), gb::DMG_GRAY, 0, 144, out.data(), pitch);
+				}
+			}
+			double elapsed = std::chrono::duration<double>(my_clock::now() - start).count();
+
+			std::cout << std::left << std::setw(10) << gb::scale::name(filter) << std::setw(8) << factor
+				<< std::fixed << std::setprecision(1) << count / elapsed << "\n";
+		}
+	}
+	return 0;
+}
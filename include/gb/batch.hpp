@@ -0,0 +1,97 @@
+#pragma once
+
+#include "gb/types.hpp"
+#include "gb/cpu.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gb {
+	/*
+	 * Work-stealing thread pool. Every worker has its own deque: it runs its
+	 * newest task from the back, and an idle worker steals the oldest task
+	 * from the front of another's. Tasks submitted to one worker go to a
+	 * separate queue that is never stolen. With pin, worker i stays on the
+	 * i-th core the process may use (Linux only; ignored elsewhere).
+	 */
+	class WorkStealingPool {
+		public:
+			using Task = std::function<void(int worker)>;
+
+			explicit WorkStealingPool(int threads = 0, bool pin = false); // 0: one per hardware thread
+			~WorkStealingPool();
+
+			int get_threads() const { return static_cast<int>(workers_.size()); }
+			int get_core(int worker) const { return workers_[worker]->core; } // -1 when not pinned
+
+			// worker < 0: any worker
+			void submit(Task task, int worker = -1);
+			void wait(); // until every task submitted so far has run
+
+			// Calling thread to one core, or any core for core < 0
+			static bool pin_to_core(int core);
+		private:
+			struct Worker {
+				std::mutex mutex;
+				std::deque<Task> tasks; // own from the back, thieves from the front
+				std::deque<Task> fixed; // submitted to this worker, never stolen
+				std::thread thread;
+				int core = -1;
+			};
+
+			void work(int index);
+			bool take(int index, Task& task);
+
+			std::vector<std::unique_ptr<Worker>> workers_;
+
+			std::mutex mutex_; // counters below; taken before a Worker::mutex
+			std::condition_variable wake_;
+			std::condition_variable done_;
+			u64 submitted_ = 0;
+			int unfinished_ = 0;
+			int next_ = 0;
+			bool stop_ = false;
+	};
+
+	// One emulator instance run for a fixed number of cycles, or a test ROM
+	// run until it reports a result, with cycles as its budget
+	struct BatchJob {
+		std::string name;
+		std::string rom;
+		std::string bootrom = "roms/bootix_dmg.bin";
+		u64 cycles = 0;
+		Decoder decoder = Decoder::Cached;
+		bool frame_hashes = false;
+		bool test_rom = false; // see Emulator::run_test
+		int core = -1; // >= 0: run on this core only
+	};
+
+	struct BatchResult {
+		// "ok", "stopped" (CPU stopped early) or "load failed"; test ROMs
+		// "passed", "failed" or "timeout" (budget used up) instead of "ok"
+		std::string status;
+		u64 cycles = 0;
+		u64 instructions = 0;
+		double seconds = 0;
+		std::string serial;
+		u64 state_hash = 0;
+		std::vector<u64> frame_hashes;
+		int worker = -1;
+	};
+
+	// Every job on the pool, each in its own gb::Emulator; results in job order
+	std::vector<BatchResult> run_batch(WorkStealingPool& pool, const std::vector<BatchJob>& jobs);
+
+	bool succeeded(const BatchResult& result); // "ok" or "passed"
+
+	// JSON: per-job results plus totals for the whole batch
+	std::string batch_report(const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results,
+			double seconds, int threads);
+	std::string json_string(const std::string& text); // quoted and escaped
+} // namespace gb
@@ -1,7 +1,12 @@
+#pragma once
+
 #include "gb/types.hpp"
+#include "gb/scheduler.hpp"
+#include "gb/cartridge.hpp"
 
 #include <string>
 #include <array>
+#include <chrono>
 #include <cstdint>
 
 namespace gb {
@@ -13,32 +18,115 @@ namespace gb {
 		public:
 			explicit Bus(Timer &timer, PPU &ppu, Joypad &joypad);
 
-			u8 read8(u16 addr) const;
-			void write8(u16 addr, u8 value);
+			// Plain memory is a single indexed load/store through the page
+			// table; I/O and everything with side effects goes to the page handler
+			u8 read8(u16 addr) {
+				const Page& page = pages_[addr >> 8];
+				if(page.read) return page.read[addr & 0xFF];
+				return page.on_read(*this, addr);
+			}
+			void write8(u16 addr, u8 value) {
+				const Page& page = pages_[addr >> 8];
+				if(page.write) page.write[addr & 0xFF] = value;
+				else page.on_write(*this, addr, value);
+			}
 
-			void tick(int cycles);
+			// Advance the clock. Timer and PPU are only run when one of their
+			// deadlines is reached or their registers are accessed.
+			void tick(int cycles) {
+				scheduler_.advance(cycles);
+				if(scheduler_.due()) run_events();
+			}
+			int cycles_to_event() const; // cycles until the next deadline
+			u64 now() const { return scheduler_.now(); }
+			void poll_input(); // raise IF for key presses since the last call
+			void poll_save();  // hand battery RAM written since the last call to the flusher
 
 			bool load_bootrom(const std::string &path);
-			void set_bootrom_enabled(bool flag) { bootrom_enabled = flag; }
+			void set_bootrom_enabled(bool flag);
 			bool get_bootrom_enabled() { return bootrom_enabled; }
 
-			bool load_cartridge(const std::string &path);
+			bool load_cartridge(const std::string &path, bool persist_save = true); // see Cartridge::load
+			void set_save_interval(std::chrono::milliseconds interval); // .sav flush period
 
 			void oam_dma(u8 source);
+
+			// Bytes sent over the serial port (0xFF01/0xFF02) are appended to
+			// out; nullptr (the default) prints them to std::cout
+			void set_serial_output(std::string* out) { serial_out_ = out; }
+
+			// Code cache support (see CPU::find_block)
+			static constexpr u32 NO_CODE = 0xFFFFFFFF;
+			u32 code_key(u16 addr) const;
+			void mark_code(u16 begin, u16 end);
+			u32 code_gen() const { return code_gen_; }     // RAM code changed or boot ROM unmapped
+			u32 code_epoch() const { return code_gen_ + rom_switches_; } // that or a ROM bank switch: running blocks stop
+
+			u8 pending_interrupts() const { return ioregs_[0x0F] & intr_reg & 0x1F; }
 		private:
+			friend class Jit; // inline WRAM/HRAM access from generated code
+
+			using ReadHandler = u8 (*)(Bus& bus, u16 addr);
+			using WriteHandler = void (*)(Bus& bus, u16 addr, u8 value);
+
+			// One 256-byte page of the address space. read/write point at the
+			// start of the page in host memory, or are null to use the handler.
+			struct Page {
+				const u8* read = nullptr;
+				u8* write = nullptr;
+				ReadHandler on_read = nullptr;
+				WriteHandler on_write = nullptr;
+			};
+
+			void map_pages();
+			void map_bootrom();
+			void map_cartridge(); // ROM/RAM windows to the current banks
+			void map_cart_ram();
+
+			// Page handlers
+			static u8 read_unmapped(Bus& bus, u16 addr);
+			static u8 read_cart_ram(Bus& bus, u16 addr);
+			static u8 read_oam(Bus& bus, u16 addr);
+			static u8 read_io(Bus& bus, u16 addr);
+			static void write_ignored(Bus& bus, u16 addr, u8 value);
+			static void write_rom(Bus& bus, u16 addr, u8 value);
+			static void write_cart_ram(Bus& bus, u16 addr, u8 value);
+			static void write_vram(Bus& bus, u16 addr, u8 value);
+			static void write_wram(Bus& bus, u16 addr, u8 value);
+			static void write_oam(Bus& bus, u16 addr, u8 value);
+			static void write_io(Bus& bus, u16 addr, u8 value);
+
+			void note_code_write(u16 addr);
+
+			void run_events();
+			void sync_timer();
+			void sync_ppu();
+
 			Timer &timer_;
 			PPU &ppu_;
 			Joypad &joypad_;
 
 			bool bootrom_enabled = false;
 			std::array<u8, 0x100> bootrom_{};    // 0x0000 ~ 0x00FF
-			std::array<u8, 0x8000> cartridge_{}; // 0x0000 ~ 0x7FFF
+			Cartridge cartridge_;                // 0x0000 ~ 0x7FFF, 0xA000 ~ 0xBFFF
 			//std::array<u8, 0x2000> vram_{};      // 0x8000 ~ 0x9FFF <- PPU
 			std::array<u8, 0x2000> wram_{};      // 0xC000 ~ 0xDFFF
 			//std::array<u8, 0xA0> oam_{};         // 0xFE00 ~ 0xFE9F <- PPU
 			std::array<u8, 0x80> ioregs_{};      // 0xFF00 ~ 0xFF7F
 			std::array<u8, 0x7F> hram_{};        // 0xFF80 ~ 0xFFFE
 			u8 intr_reg = 0;												 // 0xFFFF
+			std::string* serial_out_ = nullptr;
+
+			std::array<Page, 0x100> pages_{};
+
+			// 16-byte granules of WRAM/HRAM holding cached code
+			std::array<bool, 0x208> code_granule_{};
+			u32 code_gen_ = 0;
+			u32 rom_switches_ = 0; // only running blocks care: cached ones are keyed by bank
+
+			Scheduler scheduler_;
+			u64 timer_synced_ = 0; // scheduler_.now() at the last Timer::tick
+			u64 ppu_synced_ = 0;
 	};
 } // gb
 
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "gb/types.hpp"
+#include "gb/rom_image.hpp"
+#include "gb/save_ram.hpp"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gb {
+	enum class Mapper : u8 {
+		None, // 32 KiB ROM, optional RAM
+		MBC1,
+		MBC3, // with or without RTC
+		MBC5,
+	};
+
+	/*
+	 * Cartridge ROM/RAM and its memory bank controller. The ROM bytes are a
+	 * RomImage shared with every other cartridge loaded from the same file;
+	 * battery-backed RAM is a SaveRam on the ROM's .sav file.
+	 * Bus maps the current banks straight into its page table through the
+	 * get_rom0()/get_romx()/get_ram() pointers; a bank switch only changes
+	 * which pointer those return. RTC registers are not plain memory and go
+	 * through read_ram()/write_ram().
+	 */
+	class Cartridge {
+		public:
+			static constexpr u32 ROM_BANK = 0x4000;
+			static constexpr u32 RAM_BANK = 0x2000;
+			static constexpr u64 RTC_HZ = 4194304; // RTC counts guest seconds
+
+			// Battery RAM is kept in the .sav next to path, or only in memory
+			// without persist (instances that must not share or touch the file)
+			bool load(const std::string &path, bool persist = true);
+
+			// Mapper register write (0x0000 ~ 0x7FFF); now is the guest cycle,
+			// for the RTC latch
+			void write_rom(u16 addr, u8 value, u64 now);
+
+			// 0x0000 ~ 0x3FFF, 0x4000 ~ 0x7FFF; nullptr before load()
+			const u8* get_rom0() const { return rom_ ? rom_->data() + rom0_bank_ * ROM_BANK : nullptr; }
+			const u8* get_romx() const { return rom_ ? rom_->data() + romx_bank_ * ROM_BANK : nullptr; }
+			u16 get_rom0_bank() const { return rom0_bank_; }
+			u16 get_romx_bank() const { return romx_bank_; }
+
+			// 0xA000 ~ 0xBFFF; nullptr when disabled, absent or an RTC
+			// register is selected
+			u8* get_ram();
+			u8 read_ram(u16 addr, u64 now);
+			// Returns true if the page may be written through get_ram() until
+			// the next commit_save()
+			bool write_ram(u16 addr, u8 value, u64 now);
+
+			// Battery RAM: writes must reach write_ram() once per page and
+			// commit, so get_ram() is only mapped for reads until then
+			bool tracks_writes() const { return save_ != nullptr; }
+			bool commit_save() { return save_ && save_->commit(); }
+			void set_save_interval(std::chrono::milliseconds interval) { if(save_) save_->set_interval(interval); }
+
+			Mapper get_mapper() const { return mapper_; }
+			bool has_battery() const { return battery_; }
+		private:
+			void update_banks();
+			void sync_rtc(u64 now);
+
+			std::shared_ptr<const RomImage> rom_;
+			u8* ram_ = nullptr;
+			u32 ram_size_ = 0;
+			std::vector<u8> ram_buffer_;    // RAM without battery
+			std::unique_ptr<SaveRam> save_; // RAM with battery
+			Mapper mapper_ = Mapper::None;
+			bool battery_ = false;
+			bool rtc_present_ = false;
+			bool rumble_ = false; // MBC5 0x1C~0x1E: RAM bank bit 3 is the motor
+
+			// Mapper registers
+			bool ram_enabled_ = false;
+			u16 rom_bank_ = 1;  // MBC1: low 5 bits, MBC3: 7 bits, MBC5: 9 bits
+			u8 bank_hi_ = 0;    // MBC1 upper 2 bits / RAM bank / MBC3 RTC select
+			bool mbc1_mode_ = false;
+
+			// Resolved banks
+			u16 rom0_bank_ = 0;
+			u16 romx_bank_ = 1;
+			u8 ram_bank_ = 0;
+
+			// MBC3 RTC: seconds, minutes, hours, day low, day high/halt/carry
+			std::array<u8, 5> rtc_{};
+			std::array<u8, 5> rtc_latched_{};
+			u8 rtc_latch_ = 0xFF;
+			u64 rtc_synced_ = 0; // guest cycle of the last sync
+			u64 rtc_cycles_ = 0; // sub-second remainder
+	};
+} // namespace gb
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <array>
+
+namespace gb {
+	// Host pixel for each shade. DMG_GRAY is 32-bit RGBA (R, G, B, A bytes).
+	using Palette = std::array<u32, 4>;
+	inline constexpr Palette DMG_GRAY = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+
+	/*
+	 * Scanline compositor used by PPU::pixel_transfer().
+	 * Pixels are DMG shades (0 = white ~ 3 = black); host pixels only appear
+	 * in convert(), through a Palette. Built with SSE2 or AVX2 when the
+	 * target has them and GBEMU_SIMD is on, scalar otherwise; every backend
+	 * gives identical output.
+	 */
+	namespace compose {
+		// shades[i] = palette entry for color index indices[i] (BGP/OBP0/OBP1)
+		void palette(const u8* indices, u8 pal, u8* shades, int count);
+
+		// One 8-pixel sprite row over line[0..7]. Color index 0 is transparent;
+		// with the BG priority attribute only columns whose bg shade is 0 are
+		// drawn. Both line and bg may extend past the screen edges.
+		void sprite(u8* line, const u8* bg, const u8* indices, u8 pal, u8 attr);
+
+		// out[i] = palette[shades[i]]
+		void convert(const u8* shades, const Palette& palette, u32* out, int count);
+
+		const char* backend(); // "avx2", "sse2" or "scalar"
+	}
+} // namespace gb
@@ -1,31 +1,295 @@
+#pragma once
+
 #include "gb/types.hpp"
+#include "gb/jit.hpp"
+#include "gb/profile.hpp"
+#include "gb/guest_profile.hpp"
+
+#include <array>
+#include <bit>
+#include <memory>
+#include <unordered_map>
 
 namespace gb {
 	class Bus;
 
+#ifndef GBEMU_LAZY_FLAGS
+#define GBEMU_LAZY_FLAGS 1
+#endif
+
+	static_assert(std::endian::native == std::endian::little, "Registers assumes a little-endian host");
+
+	// 8-bit registers overlaid on their pairs (low half first)
 	struct Registers {
-		u8 a{}, b{}, c{}, d{}, e{}, f{}, h{}, l{};
+		union { struct { u8 f, a; }; u16 af = 0; };
+		union { struct { u8 c, b; }; u16 bc = 0; };
+		union { struct { u8 e, d; }; u16 de = 0; };
+		union { struct { u8 l, h; }; u16 hl = 0; };
 		u16 pc{}, sp{};
 	};
 
-	struct Flags {
-		bool z{}, n{}, h{}, c{};
+	/*
+	 * Z/N/H/C, kept in Registers::f.
+	 * ALU paths hand their operands to defer_*(). With GBEMU_LAZY_FLAGS the
+	 * flags are only computed when something reads them (branches, PUSH AF,
+	 * DAA, ADC...), otherwise immediately. Never touch Registers::f/af
+	 * directly; go through get()/set().
+	 */
+	class Flags {
+		public:
+			static constexpr u8 Z = 0x80, N = 0x40, H = 0x20, C = 0x10;
+
+			explicit Flags(u8& f) : f_(f) {}
+
+			bool z() { return get() & Z; }
+			bool n() { return get() & N; }
+			bool h() { return get() & H; }
+			bool c() { return get() & C; }
+			void set_z(bool v) { put(Z, v); }
+			void set_n(bool v) { put(N, v); }
+			void set_h(bool v) { put(H, v); }
+			void set_c(bool v) { put(C, v); }
+
+			u8 get() {
+				if(op_ != Op::None) materialize();
+				return f_;
+			}
+			void set(u8 f) {
+				op_ = Op::None;
+				f_ = f & 0xF0;
+			}
+
+			// a + b + carry / a - b - carry (ADD, ADC, SUB, SBC, CP)
+			void defer_add(u8 a, u8 b, u8 carry) { record(Op::Add, a, b, carry); }
+			void defer_sub(u8 a, u8 b, u8 carry) { record(Op::Sub, a, b, carry); }
+			// AND / XOR, OR on their result
+			void defer_and(u8 result) { record(Op::And, result, 0, 0); }
+			void defer_or(u8 result) { record(Op::Or, result, 0, 0); }
+			// INC / DEC r8 on their result; C is kept, still unevaluated
+			void defer_inc(u8 result) { keep_carry(); record(Op::Inc, result, 0, 0); }
+			void defer_dec(u8 result) { keep_carry(); record(Op::Dec, result, 0, 0); }
+		private:
+			enum class Op : u8 { None, Add, Sub, And, Or, Inc, Dec };
+
+			// C of an INC/DEC comes from the op before it (or from f_ with
+			// None); a run of INC/DEC keeps the first one's source
+			void keep_carry() {
+				if(op_ == Op::Inc || op_ == Op::Dec) return;
+				carry_op_ = op_;
+				carry_x_ = x_;
+				carry_y_ = y_;
+				carry_in_ = carry_;
+			}
+			u8 kept_carry() const {
+				switch(carry_op_) {
+					case Op::Add: return (carry_x_ + carry_y_ + carry_in_ > 0xFF) ? C : 0;
+					case Op::Sub: return (carry_x_ < carry_y_ + carry_in_) ? C : 0;
+					case Op::And: case Op::Or: return 0;
+					default: return f_ & C;
+				}
+			}
+
+			void put(u8 mask, bool v) { f_ = static_cast<u8>((get() & ~mask) | (v ? mask : 0)); }
+
+			void record(Op op, u8 x, u8 y, u8 carry) {
+				op_ = op;
+				x_ = x;
+				y_ = y;
+				carry_ = carry;
+				if constexpr (!GBEMU_LAZY_FLAGS) materialize();
+			}
+
+			void materialize() {
+				u8 f = 0;
+				switch(op_) {
+					case Op::Add:
+						if(static_cast<u8>(x_ + y_ + carry_) == 0) f |= Z;
+						if((x_ & 0x0F) + (y_ & 0x0F) + carry_ > 0x0F) f |= H;
+						if(x_ + y_ + carry_ > 0xFF) f |= C;
+						break;
+					case Op::Sub:
+						f = N;
+						if(static_cast<u8>(x_ - y_ - carry_) == 0) f |= Z;
+						if((x_ & 0x0F) < (y_ & 0x0F) + carry_) f |= H;
+						if(x_ < y_ + carry_) f |= C;
+						break;
+					case Op::And:
+						f = (x_ == 0) ? (Z | H) : H;
+						break;
+					case Op::Or:
+						f = (x_ == 0) ? Z : 0;
+						break;
+					case Op::Inc:
+						f = kept_carry();
+						if(x_ == 0) f |= Z;
+						if((x_ & 0x0F) == 0) f |= H;
+						break;
+					case Op::Dec:
+						f = kept_carry() | N;
+						if(x_ == 0) f |= Z;
+						if((x_ & 0x0F) == 0x0F) f |= H;
+						break;
+					case Op::None:
+						return;
+				}
+				f_ = f;
+				op_ = Op::None;
+			}
+
+			u8& f_;
+			Op op_ = Op::None;
+			u8 x_ = 0, y_ = 0, carry_ = 0;
+			Op carry_op_ = Op::None;
+			u8 carry_x_ = 0, carry_y_ = 0, carry_in_ = 0;
+	};
+
+	enum class Decoder {
+		Switch, // if/switch cascade in CPU::execute()
+		Table,  // 256-entry handler tables (cpu_table.cpp)
+		Cached, // pre-decoded basic blocks on top of the tables (cpu_block.cpp)
+		Jit,    // Cached, plus hot ROM blocks translated to x86-64 (jit_x64.cpp)
 	};
 
 	class CPU {
 		public:
 			explicit CPU(Bus& bus);
+			// flags holds a reference to regs.f: a copied or moved CPU would
+			// update the old one's F
+			CPU(const CPU&) = delete;
+			CPU& operator=(const CPU&) = delete;
+			CPU(CPU&&) = delete;
+			CPU& operator=(CPU&&) = delete;
 			void reset();
 			int step();
+			int run(int budget);
       void isr_vec(u8 intr_num, u16 vec);
       int isr_handler();
+
+			void set_decoder(Decoder decoder) { decoder_ = decoder; }
+			Decoder get_decoder() const { return decoder_; }
+
+			// Guest instructions executed so far, skipped idle-loop passes included
+			u64 get_instructions() const { return instructions_; }
+
+			// Register file with F brought up to date
+			Registers get_registers() { flags.get(); return regs; }
+			bool get_ime() const { return ime_; }
+			bool get_halted() const { return halted_; }
+
+			// Opcode histogram, only fed in GBEMU_PROFILE builds. Blocks run
+			// interpreted while it is set, so every instruction is counted.
+			void set_profile(OpcodeProfile* profile) { profile_ = profile; }
+
+			// Guest code sampler, same deal: GBEMU_PROFILE builds, blocks
+			// interpreted while set
+			void set_guest_profiler(GuestProfiler* profiler) {
+				guest_ = profiler;
+				guest_countdown_ = profiler ? static_cast<int>(profiler->get_period()) : GUEST_OFF;
+			}
 		private:
+			friend struct CPUOps;
+			using Handler = int (*)(CPU&);
+
+			// One pre-decoded instruction: handler, immediate operand, length
+			struct MicroOp {
+				Handler fn = nullptr;
+				u16 imm = 0;      // CB ops: the CB opcode
+				u8 length = 0;
+				u8 opcode = 0;
+			};
+
+			// Straight-line run of guest code, ended by a branch, HALT or the
+			// end of the mapped region. Keyed by Bus::code_key() (bank + PC).
+			struct Block {
+				static constexpr int MAX_OPS = 32;
+				u32 key = 0;
+				u32 gen = 0;      // Bus::code_gen() at decode time (RAM blocks)
+				bool ram = false;
+				u8 count = 0;
+				std::array<MicroOp, MAX_OPS> ops{};
+
+				// Polling loop: ends with a branch back to its first instruction and
+				// only reads memory / recomputes registers (see is_idle_loop)
+				bool idle = false;
+
+				// Ends with CALL/RST/RET, for the guest profiler's shadow stack
+				bool calls = false;
+
+				// Native translation (ROM blocks only)
+				JitCode jit = nullptr;
+				u8 hits = 0;
+			};
+
+			int execute(u8 opcode);
+			int halt();
+
+			// GBEMU_PROFILE: one instruction through execute(), counted and
+			// timed in profile_
+			template<typename Execute>
+			int profile_op(u8 opcode, u8 cb, Execute&& execute) {
+				if(!profile_->sample()) {
+					int cycles = execute();
+					profile_->record(opcode, cb, cycles);
+					return cycles;
+				}
+				u64 start = OpcodeProfile::ticks();
+				int cycles = execute();
+				profile_->record(opcode, cb, cycles, OpcodeProfile::ticks() - start);
+				return cycles;
+			}
+
+			// GBEMU_PROFILE: cycles spent at pc, counted down to guest_'s next
+			// sample (and harmlessly without one), and the shadow call stack
+			// after a CALL/RST/RET at pc
+			static constexpr int GUEST_OFF = 1 << 30;
+			void guest_cycles(u16 pc, int cycles, GuestProfiler::Leaf leaf = GuestProfiler::Leaf::Code) {
+				guest_countdown_ -= cycles;
+				if(guest_countdown_ <= 0) guest_sample(pc, leaf);
+			}
+			void guest_sample(u16 pc, GuestProfiler::Leaf leaf);
+			void guest_stack(u16 pc, u8 opcode) {
+				// Taken unless PC is on the next instruction: CALL is 3 bytes, RST/RET 1
+				bool call = GuestProfiler::is_call(opcode);
+				u16 next = static_cast<u16>(pc + ((call && (opcode & 0x07) != 0x07) ? 3 : 1));
+				if(regs.pc == next) return;
+				if(call) guest_->call(guest_key(regs.pc), regs.sp);
+				else guest_->ret(regs.sp);
+			}
+			u32 guest_key(u16 pc) const; // Bus::code_key(), plain PC outside ROM/WRAM/HRAM
+
+			int run_block(int budget);
+			Block* find_block(u16 pc);
+			void decode_block(Block& block, u16 pc, u32 key);
+			void compile_block(Block& block);
+			int run_jit(Block& block, int budget); // block and those chained after it
+
+			// Idle fast-forward (cpu_block.cpp)
+			int skip_halt(int budget);
+			int skip_idle_loop(const Block& block, int cycles, int budget);
+			bool idle_reads_timer(const Block& block);
+			static bool is_idle_loop(const Block& block, u16 pc);
+
+			static const std::array<Handler, 256> op_table_;
+			static const std::array<Handler, 256> cb_table_;
+			static const std::array<Handler, 256> block_table_;
+
 			Bus& bus_;
 			Registers regs;
-			Flags flags;
+			Flags flags{regs.f};
+			Decoder decoder_ = Decoder::Cached;
 			bool halted_ = false;
 			bool ime_ = false;
 			bool pass_handler = false;
 			bool halt_bug = false;
+			u64 instructions_ = 0;
+			OpcodeProfile* profile_ = nullptr;
+			GuestProfiler* guest_ = nullptr;
+			int guest_countdown_ = GUEST_OFF;
+
+			// Block cache
+			u16 imm_ = 0;
+			std::unordered_map<u32, Block> blocks_;
+			std::array<Block*, 0x1000> block_lookup_{};
+			std::unique_ptr<Jit> jit_;
 	};
 }
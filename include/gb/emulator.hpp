@@ -0,0 +1,84 @@
+#pragma once
+
+#include "gb/types.hpp"
+#include "gb/timer.hpp"
+#include "gb/ppu.hpp"
+#include "gb/joypad.hpp"
+#include "gb/bus.hpp"
+#include "gb/cpu.hpp"
+#include "gb/video_sink.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gb {
+	// 64-bit FNV-1a, for state and frame hashes
+	u64 fnv1a(const u8* data, std::size_t size, u64 hash = 0xcbf29ce484222325ull);
+
+	// Test ROM outcome (see Emulator::run_test)
+	enum class TestVerdict {
+		Running,
+		Passed,
+		Failed,
+	};
+
+	/*
+	 * One complete machine: Timer, PPU, Joypad, Bus and CPU wired together.
+	 * Instances share nothing but read-only ROM images (see RomImage), so
+	 * any number of them can run at once, each on its own thread. Battery
+	 * RAM stays in memory unless asked for and serial output is captured
+	 * instead of printed.
+	 */
+	class Emulator {
+		public:
+			static constexpr int CYCLES_PER_FRAME = 70224;
+
+			Emulator();
+			Emulator(const Emulator&) = delete;
+			Emulator& operator=(const Emulator&) = delete;
+
+			// persist_save: battery RAM in the ROM's .sav, as in gbemu
+			bool load(const std::string& bootrom, const std::string& rom, bool persist_save = false);
+			void set_decoder(Decoder decoder) { cpu_.set_decoder(decoder); }
+
+			// Run at least cycles (whole instructions); returns the cycles run,
+			// fewer only if the CPU stopped
+			u64 run(u64 cycles);
+
+			// Test ROMs: Blargg's print "Passed"/"Failed" on the serial port,
+			// Mooneye's leave B, C, D, E, H, L = 3, 5, 8, 13, 21, 34 on success
+			// and all 0x42 on failure. run_test() runs frame by frame until
+			// either shows up (plus the rest of the text) or budget cycles.
+			TestVerdict test_verdict();
+			TestVerdict run_test(u64 budget);
+
+			// Record a hash of every frame from now on, one per VBlank
+			void set_frame_hashing(bool enabled);
+			const std::vector<u64>& get_frame_hashes() const { return frame_hashes_; }
+
+			// CPU registers and the 0x8000 ~ 0xFFFF address space as the guest
+			// reads it (VRAM, cartridge RAM, WRAM, OAM, I/O, HRAM, IE)
+			u64 state_hash();
+
+			const std::string& get_serial() const { return serial_; }
+			u64 get_cycles() const { return cycles_; }
+			u64 get_instructions() const { return cpu_.get_instructions(); }
+
+			CPU& get_cpu() { return cpu_; }
+			Bus& get_bus() { return bus_; }
+			PPU& get_ppu() { return ppu_; }
+			Joypad& get_joypad() { return joypad_; }
+		private:
+			Timer timer_;
+			PPU ppu_;
+			Joypad joypad_;
+			Bus bus_;
+			CPU cpu_;
+
+			u64 cycles_ = 0;
+			std::string serial_;
+			std::vector<u64> frame_hashes_;
+			CallbackVideoSink frame_sink_;
+	};
+} // namespace gb
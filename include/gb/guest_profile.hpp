@@ -0,0 +1,106 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gb {
+	/*
+	 * Sampling profiler for guest code. Every period guest cycles it records
+	 * where the game is: the code key (bank << 16 | PC, see Bus::code_key) and
+	 * a shadow call stack kept from taken CALL/RST, RET/RETI and interrupt
+	 * entries. Stacks are interned in a trie and counted per (stack, PC).
+	 * The CPU only feeds it in GBEMU_PROFILE builds (see
+	 * CPU::set_guest_profiler).
+	 *
+	 * Output is folded stacks ("main;Func;Leaf 42" per line) for flamegraph
+	 * tools, and a hot-PC table. Addresses are named from an optional RGBDS
+	 * .sym file, "BB:AAAA" otherwise.
+	 */
+	class GuestProfiler {
+		public:
+			static constexpr u32 IRQ_KEY = 0xFFFE0000; // | vector: interrupt entry frame
+
+			// Where a sample was taken
+			enum class Leaf : u8 { Code, Halt, Idle };
+
+			explicit GuestProfiler(u32 period = 16384) { set_period(period); reset(); }
+			void set_period(u32 period) { period_ = (period < 16) ? 16 : period; }
+			u32 get_period() const { return period_; }
+			void reset();
+
+			// RGBDS symbol file: "BB:AAAA Name" per line, ';' comments
+			bool load_symbols(const std::string& path);
+
+			// CPU hooks. The CPU counts the period down itself.
+			void sample(u32 key, u16 sp, Leaf leaf, int count);
+			void call(u32 target, u16 sp) {  // sp after the return address was pushed
+				unwind(sp);
+				if(depth_ < MAX_DEPTH) stack_[depth_++] = {target, 0, sp};
+			}
+			void ret(u16 sp) { unwind(sp); } // sp after it was popped
+
+			// Opcodes that may move the shadow stack: CALL, RST, RET, RETI
+			static constexpr bool is_call(u8 opcode) { return opcode == 0xCD || (opcode & 0xE7) == 0xC4 || (opcode & 0xC7) == 0xC7; }
+			static constexpr bool is_ret(u8 opcode) { return opcode == 0xC9 || opcode == 0xD9 || (opcode & 0xE7) == 0xC0; }
+
+			u64 get_samples() const { return samples_; }
+			std::string folded() const;
+			std::string hot_pcs(int top = 40) const; // top = 0: every sampled PC
+		private:
+			static constexpr int MAX_DEPTH = 64;
+
+			struct Node {
+				u32 parent;
+				u32 key;
+			};
+			struct Frame {
+				u32 key;
+				u32 node; // trie node, once resolved
+				u16 sp;
+			};
+
+			u32 child(u32 parent, u32 key);
+			void unwind(u16 sp) {
+				// A frame lives while its return address is on the stack, i.e. at
+				// or above sp. Catches RET as well as code that pops it by hand.
+				while(depth_ > 0 && stack_[depth_ - 1].sp < sp) depth_--;
+				if(resolved_ > depth_) resolved_ = depth_;
+			}
+			u32 resolve(); // trie node of the whole stack
+
+			// Names
+			struct Symbol {
+				u16 addr;
+				std::string name;
+			};
+			static u32 region(u32 key); // symbol namespace: bank and memory area
+			const Symbol* lookup(u32 key) const;
+			std::string location(u32 key) const;          // "BB:AAAA"
+			std::string function_name(u32 key) const;     // containing symbol or location
+			std::string frame_name(u32 key) const;
+
+			u32 period_ = 16384; // 256 samples per guest second
+			u64 samples_ = 0;
+
+			// Shadow stack; calls past MAX_DEPTH are not tracked. Frames below
+			// resolved_ have their trie node: calls far outnumber samples, so
+			// nodes are looked up when a sample needs them.
+			std::array<Frame, MAX_DEPTH> stack_{};
+			int depth_ = 0;
+			int resolved_ = 0;
+
+			// Stack trie (node 0 is the root) and samples per (node, leaf)
+			std::vector<Node> nodes_;
+			std::unordered_map<u64, u32> children_;
+			std::unordered_map<u64, u64> counts_; // node << 34 | leaf << 32 | key
+			u64 last_id_ = ~0ull;                 // idle loops hit the same entry
+			u64* last_count_ = nullptr;
+
+			std::map<u32, std::vector<Symbol>> symbols_; // by region(), sorted by addr
+	};
+} // namespace gb
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "gb/joypad.hpp"
+
+#include <functional>
+#include <utility>
+
+namespace gb {
+	/*
+	 * Where button presses come from.
+	 * poll() runs on the host (main) thread, forwards pending host input to
+	 * the Joypad's set_*() and returns false once the host asks to quit.
+	 */
+	class InputSource {
+		public:
+			virtual ~InputSource() = default;
+			virtual bool poll(Joypad& joypad) = 0;
+	};
+
+	// Headless: no buttons, never quits on its own
+	class NullInputSource : public InputSource {
+		public:
+			bool poll(Joypad&) override { return true; }
+	};
+
+	// Embedding: the callback drives the Joypad itself
+	class CallbackInputSource : public InputSource {
+		public:
+			using Callback = std::function<bool(Joypad& joypad)>;
+
+			explicit CallbackInputSource(Callback callback) : callback_(std::move(callback)) {}
+			bool poll(Joypad& joypad) override { return callback_ ? callback_(joypad) : true; }
+		private:
+			Callback callback_;
+	};
+} // namespace gb
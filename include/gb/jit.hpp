@@ -0,0 +1,71 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <cstddef>
+
+namespace gb {
+	class Bus;
+
+	// Guest state shared with generated code; field offsets are baked into it
+	struct JitContext {
+		u16 pc = 0, sp = 0;
+		u16 bc = 0, de = 0, hl = 0;
+		u8 a = 0, f = 0;
+		u8 ime = 0;
+		u8 exit = 0;     // set by helpers: leave at the next instruction boundary
+		u8 tmp = 0;
+		u32 cycles = 0;  // elapsed cycles at block exit
+		u32 insns = 0;   // guest instructions completed at block exit
+		u32 ticked = 0;  // cycles already fed to Bus::tick() by helpers
+		u32 limit = 0;   // leave at the first instruction boundary this many cycles in
+		u32 epoch = 0;   // Bus::code_epoch() at block entry
+		Bus* bus = nullptr;
+		u8* wram = nullptr;
+		u8* hram = nullptr;
+		const bool* code_granule = nullptr;
+		u8 flag_lut[256]{}; // x86 AH (after LAHF) -> SM83 Z/H/C
+	};
+
+	using JitCode = void (*)(JitContext*);
+
+	// One guest instruction handed to the translator (CB ops: imm = CB opcode)
+	struct JitInsn {
+		u8 opcode = 0;
+		u8 length = 0;
+		u16 imm = 0;
+	};
+
+	/*
+	 * x86-64 translator for hot ROM blocks.
+	 * Guest A/BC/DE/HL/F live in callee-saved host registers for the whole
+	 * block. WRAM and HRAM are accessed inline; everything else calls back
+	 * into Bus after catching the peripherals up to the current instruction.
+	 * Every instruction boundary checks ctx.limit, so a block stops where the
+	 * interpreter would next see an event.
+	 * Built only with GBEMU_JIT on x86-64; otherwise available() is false.
+	 */
+	class Jit {
+		public:
+			explicit Jit(Bus& bus);
+			~Jit();
+			Jit(const Jit&) = delete;
+			Jit& operator=(const Jit&) = delete;
+
+			bool available() const { return code_ != nullptr; }
+			JitContext& context() { return ctx_; }
+
+			// Translate the leading supported instructions of a block starting
+			// at pc. Returns nullptr if the first instruction is unsupported or
+			// the code buffer is full (see full()/reset()).
+			JitCode compile(const JitInsn* insns, int count, u16 pc);
+			bool full() const { return full_; }
+			void reset();
+		private:
+			Bus& bus_;
+			JitContext ctx_;
+			u8* code_ = nullptr;
+			std::size_t used_ = 0;
+			bool full_ = false;
+	};
+} // namespace gb
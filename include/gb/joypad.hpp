@@ -1,6 +1,8 @@
 #pragma once
 #include "gb/types.hpp"
 
+#include <atomic>
+
 namespace gb {
 	struct Button {
 		bool up = false;
@@ -13,11 +15,17 @@ namespace gb {
 		bool start = false;
 	};
 	
+	/*
+	 * set_*() may be called from the render/input thread: they only update
+	 * an atomic button mask, which the emulation thread latches in poll().
+	 */
 	class Joypad {
 		public:
 			u8 read8(u16 addr);
 			void write8(u16 addr, u8 value);
 			bool tick();
+			bool poll(); // latch the host buttons; true if a press is pending
+			bool has_pending() const { return pending_intr; }
 
 			void set_a(bool pressed);
 			void set_b(bool pressed);
@@ -28,8 +36,13 @@ namespace gb {
 			void set_left(bool pressed);
 			void set_right(bool pressed);
 		private:
+			// Host button mask bits (P1 order): A, B, Select, Start, Right, Left, Up, Down
+			void set_button(u8 bit, bool pressed);
+
 			u8 sel_ = 0x30; // 8'b0011_0000
 			Button button_{};
 			bool pending_intr = false;
+			std::atomic<u8> host_buttons_{0};
+			u8 latched_ = 0;
 	};
 } // namespace gb
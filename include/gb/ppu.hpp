@@ -1,33 +1,68 @@
+#pragma once
+
 #include "gb/types.hpp"
-#include "gb/joypad.hpp"
-#include "SDL2/SDL.h"
+#include "gb/compositor.hpp"
+#include "gb/video_sink.hpp"
 
 #include <array>
+#include <bitset>
 
 namespace gb {
 	struct Sprites {
 		u8 x, y;
 		u8 tile;
 		u8 attr;
+
+		bool operator==(const Sprites&) const = default;
 	};
 
 	class PPU {
 		public:
-			void initPPU();
-			void present();
-			bool pump_events(Joypad& joypad);
-			void shutdownPPU();
+			// Finished frames go to the sink at VBlank; none (the default) means
+			// headless, where frames are simply dropped
+			void set_video_sink(VideoSink* sink) { sink_ = sink; }
 			void renderTestPattern(u32 frame);
 			u8 tick(int cycles);
+			int cycles_to_event() const; // cycles until the next mode change
 			u8 read8(u16 addr);
 			void write8(u16 addr, u8 value);
+			u8* get_vram() { return vram_.data(); } // direct reads from Bus's page table
 			
 			void oam_search();
 			void pixel_transfer();
+			const Sprites* get_sprites() const { return ly_sprites_.data(); } // oam_search() result for LY
+			int get_sprites_num() const { return sprites_num; }
+			void invalidate_lines(); // next frame renders every line, cached or not
+
+			// Frame being drawn as shades (0~3), 160 per row. Host pixels are only
+			// made on demand, by the sink or convert_frame().
+			const u8* get_framebuffer() const { return framebuffer_.data(); }
+			void convert_frame(u32* out, const Palette& palette = DMG_GRAY) const; // 160 * 144 pixels
 		private:
-			SDL_Renderer* renderer_;
-			SDL_Window* window_;
-			SDL_Texture* texture_;
+			// Decoded tile row: 8 color indices (0~3), leftmost pixel first
+			const u8* tile_row(int tile, int row) const { return &tiles_[(tile << 6) | (row << 3)]; }
+			void decode_tile_row(u16 offset); // offset of either byte of the row in vram_
+
+			// Every input pixel_transfer() reads for line ly_, as of its last render
+			struct LineKey {
+				u8 lcdc, scy, scx, bgp, obp0, obp1, wy, wx;
+				bool operator==(const LineKey&) const = default;
+			};
+			struct LineCache {
+				bool valid = false;
+				LineKey key{};
+				u64 gen = 0; // gen_ when rendered
+				int sprites_num = 0;
+				std::array<Sprites, 10> sprites{};
+			};
+			LineKey line_key() const { return {lcdc_, scy_, scx_, bgp_, obp0_, obp1_, wy_, wx_}; }
+			bool line_unchanged() const;
+
+			// Sprite index: OAM entries on each line, in OAM order
+			void mark_sprite_rows(u8 y_pos); // lines an entry at y_pos may cover
+			void build_sprite_row(int line);
+
+			VideoSink* sink_ = nullptr;
 
 			int dot_cycles = 0;
 			int mode = 2;
@@ -37,6 +72,19 @@ namespace gb {
 			std::array<u8, 0x2000> vram_{}; // 0x8000 ~ 0x9FFF
 			std::array<u8, 0xA0> oam_{};    // 0xFE00 ~ 0xFE9F
 
+			// 384 tiles of 0x8000 ~ 0x97FF as 8x8 color indices, kept in step
+			// with vram_ by write8()
+			std::array<u8, 384 * 64> tiles_{};
+
+			// Generation counters: every write that changes VRAM or OAM stamps
+			// what it touched with ++gen_. Lines rendered after the stamp are
+			// still valid.
+			u64 gen_ = 0;
+			std::array<u64, 384> tile_gen_{}; // tile data, per tile
+			std::array<u64, 64> map_gen_{};   // both tilemaps, per row of 32 tiles
+			u64 oam_gen_ = 0;
+			std::array<LineCache, 144> lines_{};
+
 			// Registers
 			u8 lcdc_ = 0;
 			u8 stat_ = 0;
@@ -48,7 +96,16 @@ namespace gb {
 			u8 obp0_ = 0; u8 obp1_ = 0;
 			u8 wy_ = 0; u8 wx_ = 0;
 
-			std::array<u8, 160 * 144 * 4> framebuffer_{};
+			void publish_frame();
+
+			std::array<u8, 160 * 144> framebuffer_{};
 			std::array<Sprites, 10> ly_sprites_{};
+
+			// Per-line buckets of up to 10 OAM entry numbers, kept across frames.
+			// OAM writes only mark the lines they can affect; oam_search()
+			// rescans those.
+			std::array<std::array<u8, 10>, 144> sprite_rows_{};
+			std::array<u8, 144> sprite_rows_num_{};
+			std::bitset<144> sprite_rows_valid_;
 	};
 } // namespace gb
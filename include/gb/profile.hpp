@@ -0,0 +1,92 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <array>
+#include <chrono>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#ifndef GBEMU_PROFILE
+#define GBEMU_PROFILE 0
+#endif
+
+namespace gb {
+	/*
+	 * Per-opcode execution counts and guest cycles (CB-prefixed ops on their
+	 * own), plus the cycles spent entering interrupts, halted and in skipped
+	 * idle-loop passes. Optionally the host time of one in every
+	 * sample_period instructions, read with rdtsc on x86-64 and steady_clock
+	 * elsewhere. The CPU only feeds it in GBEMU_PROFILE builds (see
+	 * CPU::set_profile); otherwise every hook compiles away.
+	 */
+	class OpcodeProfile {
+		public:
+			struct Stats {
+				u64 count = 0;
+				u64 cycles = 0;
+				u64 samples = 0; // timed executions
+				u64 ticks = 0;   // host ticks of those
+			};
+
+			OpcodeProfile() { reset(); }
+			void reset();
+			void set_sample_period(u32 period) { period_ = period; countdown_ = period; } // 0: no host timing
+
+			// CPU hooks. cb is the CB opcode when opcode is 0xCB.
+			bool sample() { return period_ != 0 && --countdown_ == 0; }
+			void record(u8 opcode, u8 cb, int cycles) {
+				Stats& stats = (opcode == 0xCB) ? cb_[cb] : ops_[opcode];
+				stats.count++;
+				stats.cycles += cycles;
+			}
+			void record(u8 opcode, u8 cb, int cycles, u64 ticks) {
+				record(opcode, cb, cycles);
+				Stats& stats = (opcode == 0xCB) ? cb_[cb] : ops_[opcode];
+				stats.samples++;
+				stats.ticks += (ticks > overhead_) ? ticks - overhead_ : 0;
+				countdown_ = period_;
+			}
+			void record_interrupt(int cycles) { interrupts_++; interrupt_cycles_ += cycles; }
+			void record_halt(int cycles) { halt_cycles_ += cycles; }
+			void record_idle(int cycles, u64 instructions) { idle_cycles_ += cycles; idle_instructions_ += instructions; }
+
+			static u64 ticks() {
+#if defined(__x86_64__) || defined(_M_X64)
+				return __rdtsc();
+#else
+				return static_cast<u64>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+			}
+
+			const Stats& get_op(u8 opcode) const { return ops_[opcode]; }
+			const Stats& get_cb(u8 opcode) const { return cb_[opcode]; }
+
+			// Sorted by guest cycles; top = 0 lists every opcode that ran
+			std::string table(int top = 40) const;
+			std::string json() const;
+		private:
+			double ns_per_tick() const; // calibrated against steady_clock since reset()
+
+			std::array<Stats, 256> ops_{};
+			std::array<Stats, 256> cb_{};
+			u64 interrupts_ = 0;
+			u64 interrupt_cycles_ = 0;
+			u64 halt_cycles_ = 0;
+			u64 idle_cycles_ = 0;
+			u64 idle_instructions_ = 0;
+
+			u32 period_ = 0;
+			u32 countdown_ = 0;
+			u64 overhead_ = 0; // ticks of an empty timed region
+			u64 start_ticks_ = 0;
+			std::chrono::steady_clock::time_point start_time_;
+	};
+} // namespace gb
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gb {
+	/*
+	 * Read-only ROM file contents, shared by every Cartridge in the process
+	 * that opens the same file (or another file with identical contents).
+	 * The file is mmap'd, so instances also share the host's page cache
+	 * pages instead of holding private copies.
+	 */
+	class RomImage {
+		public:
+			// Cached image for path, mapped on first use. nullptr on error.
+			static std::shared_ptr<const RomImage> open(const std::string &path);
+
+			~RomImage();
+			RomImage(const RomImage&) = delete;
+			RomImage& operator=(const RomImage&) = delete;
+
+			const u8* data() const { return data_; }
+			std::size_t size() const { return size_; }
+			u64 hash() const { return hash_; } // FNV-1a of the contents
+		private:
+			RomImage() = default;
+
+			bool map_file(const std::string &path);
+			bool read_file(const std::string &path);
+
+			const u8* data_ = nullptr;
+			std::size_t size_ = 0;
+			u64 hash_ = 0;
+			void* mapping_ = nullptr;  // mmap'd file, or
+			std::vector<u8> buffer_;   // copy for files mmap can't serve
+	};
+} // namespace gb
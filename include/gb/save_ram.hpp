@@ -0,0 +1,69 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gb {
+	/*
+	 * Battery-backed cartridge RAM living in a MAP_SHARED mapping of its
+	 * .sav file. The emulation thread marks 256-byte pages dirty and hands
+	 * them over with commit(); a background thread msync()s the handed-over
+	 * pages every interval, so the emulation thread never waits on disk.
+	 * Without mmap the RAM is a heap copy written back on destruction.
+	 */
+	class SaveRam {
+		public:
+			static constexpr std::size_t PAGE = 0x100;
+
+			SaveRam() = default;
+			~SaveRam();
+			SaveRam(const SaveRam&) = delete;
+			SaveRam& operator=(const SaveRam&) = delete;
+
+			// Map (creating or growing) path as size bytes of RAM
+			bool open(const std::string &path, std::size_t size);
+
+			u8* data() { return data_; }
+			std::size_t size() const { return size_; }
+
+			// Emulation thread
+			void mark_dirty(std::size_t offset) {
+				std::size_t page = offset / PAGE;
+				dirty_[page / 64] |= 1ull << (page % 64);
+				any_dirty_ = true;
+			}
+			bool commit(); // hand dirty pages to the flusher; false if none
+
+			void set_interval(std::chrono::milliseconds interval);
+		private:
+			void flusher();
+			void write_pending();
+
+			std::string path_;
+			u8* data_ = nullptr;
+			std::size_t size_ = 0;
+			void* mapping_ = nullptr;
+			std::vector<u8> buffer_; // no-mmap fallback
+
+			// Dirty pages since the last commit (emulation thread only), and
+			// pages committed but not yet on disk (shared with the flusher)
+			std::vector<u64> dirty_;
+			bool any_dirty_ = false;
+			std::unique_ptr<std::atomic<u64>[]> pending_;
+
+			std::thread thread_;
+			std::mutex mutex_;
+			std::condition_variable wake_;
+			bool stop_ = false;
+			std::chrono::milliseconds interval_{1000};
+	};
+} // namespace gb
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "gb/types.hpp"
+#include "gb/compositor.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gb {
+	/*
+	 * CPU upscaling of 160x144 shade frames to the final host resolution,
+	 * for presentation without GPU stretching. Edge tests run on shades (one
+	 * byte per pixel) and are vectorized with SSE2 like gb::compose; host
+	 * pixels only appear at the end, through the palette.
+	 */
+	namespace scale {
+		enum class Filter {
+			Nearest, // integer nearest neighbour
+			ScaleNx, // Scale2x (2x), Scale3x (3x), Scale2x twice (4x)
+			XbrLite, // xBR edge rule on 3x3 neighbourhoods, blended corners
+			LcdGrid, // nearest with darkened pixel borders
+		};
+		const char* name(Filter filter);
+		bool parse(const std::string& text, Filter& filter);
+
+		class Scaler {
+			public:
+				explicit Scaler(Filter filter = Filter::Nearest, int factor = 1); // factor 1~4
+
+				Filter get_filter() const { return filter_; }
+				int get_factor() const { return factor_; }
+				int get_width() const { return 160 * factor_; }
+				int get_height() const { return 144 * factor_; }
+				int get_reach() const; // neighbour rows a source row's output depends on
+
+				// Source rows first ~ first + count - 1 to output rows from
+				// first * factor on. out points at the first of them; pitch in bytes.
+				void run(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch);
+			private:
+				void run_nearest(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch);
+				void run_lcd_grid(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch);
+				void run_scale_nx(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch);
+				void run_xbr_lite(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch);
+
+				Filter filter_;
+				int factor_;
+
+				// Scratch, reused across frames
+				std::vector<u8> wide_;   // Scale2x pass of ScaleNx 4x, 320 x 288
+				std::vector<u8> shade_rows_;
+				std::vector<u32> host_;
+				std::vector<u32> dim_;
+		};
+	}
+} // namespace gb
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace gb {
+	// Event sources, one deadline slot each
+	enum class Event : u8 {
+		Timer,  // TIMA overflow
+		PPU,    // next mode transition
+		Joypad, // host key press waiting to raise IF
+		Count,
+	};
+
+	/*
+	 * Global cycle clock with one deadline per event source.
+	 * There are only a handful of sources, so the earliest deadline is kept
+	 * as a cached minimum over a fixed array instead of a heap: advance()
+	 * and due() stay a single add/compare on the per-instruction path.
+	 */
+	class Scheduler {
+		public:
+			static constexpr u64 NEVER = ~0ull;
+
+			Scheduler() { deadlines_.fill(NEVER); }
+
+			u64 now() const { return now_; }
+			void advance(int cycles) { now_ += static_cast<u64>(cycles); }
+			bool due() const { return now_ >= next_; }
+
+			u64 next() const { return next_; }
+			u64 deadline(Event event) const { return deadlines_[index(event)]; }
+
+			void schedule(Event event, u64 when) {
+				deadlines_[index(event)] = when;
+				update_next();
+			}
+			void cancel(Event event) { schedule(event, NEVER); }
+		private:
+			static std::size_t index(Event event) { return static_cast<std::size_t>(event); }
+
+			void update_next() {
+				next_ = NEVER;
+				for(u64 deadline : deadlines_) {
+					if(deadline < next_) next_ = deadline;
+				}
+			}
+
+			u64 now_ = 0;
+			u64 next_ = NEVER;
+			std::array<u64, static_cast<std::size_t>(Event::Count)> deadlines_{};
+	};
+} // namespace gb
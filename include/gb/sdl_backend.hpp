@@ -0,0 +1,67 @@
+#pragma once
+
+#include "gb/types.hpp"
+#include "gb/compositor.hpp"
+#include "gb/input_source.hpp"
+#include "gb/scaler.hpp"
+#include "gb/triple_buffer.hpp"
+#include "gb/video_sink.hpp"
+
+#include <array>
+
+struct SDL_Window;
+struct SDL_Renderer;
+struct SDL_Texture;
+
+namespace gb {
+	/*
+	 * SDL2 window. Only built with GBEMU_SDL; the core never includes SDL.
+	 * Frames cross from the emulation thread through a triple buffer, so
+	 * submit_frame() never waits on present() (which may block on vsync).
+	 * present() converts only the rows that differ from the frame already
+	 * in the texture, straight into SDL_LockTexture() memory. With a filter
+	 * the texture is at the scaled size and the scaler writes those rows.
+	 */
+	class SdlVideoSink : public VideoSink {
+		public:
+			~SdlVideoSink() override;
+			// Window, renderer and texture; false if SDL is unusable. Factor 1
+			// leaves scaling to the renderer.
+			bool open(scale::Filter filter = scale::Filter::Nearest, int factor = 1);
+
+			void submit_frame(const u8* shades) override;
+			bool present() override;
+
+			void set_palette(const Palette& palette) { palette_ = palette; }
+			const Palette& get_palette() const { return palette_; }
+			void invalidate() { shown_valid_ = false; } // next present() redraws every row
+		private:
+			using Frame = std::array<u8, 160 * 144>;
+
+			bool upload_rows(const Frame& frame, int first, int count);
+
+			SDL_Window* window_ = nullptr;
+			SDL_Renderer* renderer_ = nullptr;
+			SDL_Texture* texture_ = nullptr;
+
+			Palette palette_ = DMG_GRAY;
+			scale::Scaler scaler_;
+			TripleBuffer<Frame> frames_; // submit_frame() -> present()
+
+			// present() only: what texture_ holds right now
+			Frame shown_{};
+			Palette shown_palette_{};
+			bool shown_valid_ = false;
+	};
+
+	// SDL keyboard: arrows, X = A, Z = B, Enter = Start, right Shift = Select.
+	// Events come from the SDL_Init() done by SdlVideoSink::open(); render
+	// resets, which may lose texture contents, redraw the video sink in full.
+	class SdlInputSource : public InputSource {
+		public:
+			explicit SdlInputSource(SdlVideoSink* video = nullptr) : video_(video) {}
+			bool poll(Joypad& joypad) override;
+		private:
+			SdlVideoSink* video_;
+	};
+} // namespace gb
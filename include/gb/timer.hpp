@@ -8,6 +8,9 @@ namespace gb {
 			u8 read8(u16 addr) const;
 			void write8(u16 addr, u8 value);
 			bool tick(int cycles);
+
+			// Cycles until the next TIMA overflow (bounded when disabled)
+			int cycles_to_event() const;
 		private:
 			u64 div_cycles = 0;
 			u64 acc_cycles = 0;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <array>
+#include <atomic>
+
+namespace gb {
+	/*
+	 * Single-producer/single-consumer frame handoff without locks.
+	 * The producer fills back() and publish()es it; the consumer acquire()s
+	 * the newest published slot whenever it is ready. Neither side ever
+	 * waits for the other: a frame the consumer did not get to in time is
+	 * simply replaced by the next one.
+	 */
+	template<typename T>
+	class TripleBuffer {
+		public:
+			// Producer
+			T& back() { return slots_[back_]; }
+			void publish() {
+				back_ = latest_.exchange(static_cast<u8>(back_ | FRESH), std::memory_order_acq_rel) & INDEX;
+			}
+
+			// Consumer: true if front() now holds a newer frame
+			bool acquire() {
+				if((latest_.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+				front_ = latest_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+				return true;
+			}
+			const T& front() const { return slots_[front_]; }
+		private:
+			static constexpr u8 INDEX = 0x3;
+			static constexpr u8 FRESH = 0x4; // latest_ holds an unread frame
+
+			std::array<T, 3> slots_{};
+			u8 back_ = 0;              // producer only
+			u8 front_ = 1;             // consumer only
+			std::atomic<u8> latest_{2};
+	};
+} // namespace gb
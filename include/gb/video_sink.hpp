@@ -0,0 +1,39 @@
+#pragma once
+
+#include "gb/types.hpp"
+
+#include <functional>
+#include <utility>
+
+namespace gb {
+	/*
+	 * Where the PPU sends finished frames.
+	 * submit_frame() is called from the emulation thread once per VBlank
+	 * with 160 * 144 shades (0~3), valid only for the duration of the call.
+	 * present() is called from the host (main) thread; it returns false when
+	 * there was nothing new to show.
+	 */
+	class VideoSink {
+		public:
+			virtual ~VideoSink() = default;
+			virtual void submit_frame(const u8* shades) = 0;
+			virtual bool present() { return false; }
+	};
+
+	// Headless: frames are dropped, nothing is converted or drawn
+	class NullVideoSink : public VideoSink {
+		public:
+			void submit_frame(const u8*) override {}
+	};
+
+	// Embedding: hands every frame to a callback on the emulation thread
+	class CallbackVideoSink : public VideoSink {
+		public:
+			using Callback = std::function<void(const u8* shades)>;
+
+			explicit CallbackVideoSink(Callback callback) : callback_(std::move(callback)) {}
+			void submit_frame(const u8* shades) override { if(callback_) callback_(shades); }
+		private:
+			Callback callback_;
+	};
+} // namespace gb
@@ -1,4 +1,4 @@
 #!/bin/bash
 
 cmake --build build/ -j
-./build/gbemu
+./build/gbemu "${@:-roms/Tetris.gb}"
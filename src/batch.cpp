@@ -0,0 +1,276 @@
+#include "gb/batch.hpp"
+#include "gb/emulator.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace gb {
+	namespace {
+		// Cores the process may run on, in order
+		std::vector<int> usable_cores() {
+			std::vector<int> cores;
+#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+				for(int core = 0; core < CPU_SETSIZE; core++) {
+					if(CPU_ISSET(core, &set)) cores.push_back(core);
+				}
+			}
+#endif
+			return cores;
+		}
+
+		std::string hex64(u64 value) {
+			char text[19];
+			std::snprintf(text, sizeof(text), "0x%016llx", static_cast<unsigned long long>(value));
+			return text;
+		}
+	}
+
+	WorkStealingPool::WorkStealingPool(int threads, bool pin) {
+		if(threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+		if(threads <= 0) threads = 1;
+
+		std::vector<int> cores = pin ? usable_cores() : std::vector<int>{};
+		for(int i = 0; i < threads; i++) {
+			workers_.push_back(std::make_unique<Worker>());
+			if(!cores.empty()) workers_[i]->core = cores[i % cores.size()];
+		}
+		for(int i = 0; i < threads; i++) workers_[i]->thread = std::thread(&WorkStealingPool::work, this, i);
+	}
+
+	WorkStealingPool::~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for(auto& worker : workers_) worker->thread.join();
+	}
+
+	void WorkStealingPool::submit(Task task, int worker) {
+		{
+			// Queued and counted under mutex_, so a worker going to sleep
+			// either sees the task or sees submitted_ change
+			std::lock_guard<std::mutex> lock(mutex_);
+			int index = worker >= 0 ? worker % get_threads() : next_++ % get_threads();
+			Worker& target = *workers_[index];
+			std::lock_guard<std::mutex> worker_lock(target.mutex);
+			if(worker >= 0) target.fixed.push_back(std::move(task));
+			else target.tasks.push_back(std::move(task));
+			submitted_++;
+			unfinished_++;
+		}
+		wake_.notify_all();
+	}
+
+	void WorkStealingPool::wait() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [&] { return unfinished_ == 0; });
+	}
+
+	bool WorkStealingPool::pin_to_core(int core) {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if(core < 0) {
+			for(int usable : usable_cores()) CPU_SET(usable, &set);
+		}
+		else if(core < CPU_SETSIZE) CPU_SET(core, &set);
+		else return false;
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		(void)core;
+		return false;
+#endif
+	}
+
+	bool WorkStealingPool::take(int index, Task& task) {
+		// 1. Tasks for this worker only, oldest first
+		// 2. Own deque, newest first
+		Worker& self = *workers_[index];
+		{
+			std::lock_guard<std::mutex> lock(self.mutex);
+			if(!self.fixed.empty()) {
+				task = std::move(self.fixed.front());
+				self.fixed.pop_front();
+				return true;
+			}
+			if(!self.tasks.empty()) {
+				task = std::move(self.tasks.back());
+				self.tasks.pop_back();
+				return true;
+			}
+		}
+
+		// 3. Steal the oldest task of the next worker that has one
+		int threads = get_threads();
+		for(int i = 1; i < threads; i++) {
+			Worker& victim = *workers_[(index + i) % threads];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if(!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkStealingPool::work(int index) {
+		if(workers_[index]->core >= 0) pin_to_core(workers_[index]->core);
+
+		for(;;) {
+			u64 seen;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				seen = submitted_;
+			}
+
+			Task task;
+			if(take(index, task)) {
+				task(index);
+				std::lock_guard<std::mutex> lock(mutex_);
+				if(--unfinished_ == 0) done_.notify_all();
+				continue;
+			}
+
+			// Nothing to run: sleep until something new is submitted
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [&] { return stop_ || submitted_ != seen; });
+			if(stop_ && submitted_ == seen) return;
+		}
+	}
+
+	std::vector<BatchResult> run_batch(WorkStealingPool& pool, const std::vector<BatchJob>& jobs) {
+		std::vector<BatchResult> results(jobs.size());
+		for(std::size_t i = 0; i < jobs.size(); i++) {
+			const BatchJob& job = jobs[i];
+			BatchResult& result = results[i];
+			auto task = [&pool, &job, &result](int worker) {
+				// Jobs for a core other than the worker's move the thread there
+				// for their duration
+				int home = pool.get_core(worker);
+				bool moved = job.core >= 0 && job.core != home;
+				if(moved) WorkStealingPool::pin_to_core(job.core);
+
+				auto start = std::chrono::steady_clock::now();
+				auto emulator = std::make_unique<Emulator>();
+				emulator->set_decoder(job.decoder);
+				emulator->set_frame_hashing(job.frame_hashes);
+				if(!emulator->load(job.bootrom, job.rom)) result.status = "load failed";
+				else {
+					if(job.test_rom) {
+						switch(emulator->run_test(job.cycles)) {
+							case TestVerdict::Passed: result.status = "passed"; break;
+							case TestVerdict::Failed: result.status = "failed"; break;
+							case TestVerdict::Running: result.status = emulator->get_cycles() >= job.cycles ? "timeout" : "stopped"; break;
+						}
+					}
+					else {
+						u64 cycles = emulator->run(job.cycles);
+						result.status = cycles >= job.cycles ? "ok" : "stopped";
+					}
+					result.cycles = emulator->get_cycles();
+					result.instructions = emulator->get_instructions();
+					result.serial = emulator->get_serial();
+					result.state_hash = emulator->state_hash();
+					result.frame_hashes = emulator->get_frame_hashes();
+				}
+				result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				result.worker = worker;
+
+				if(moved) WorkStealingPool::pin_to_core(home);
+			};
+			if(job.core >= 0) pool.submit(task, job.core);
+			else pool.submit(task);
+		}
+		pool.wait();
+		return results;
+	}
+
+	bool succeeded(const BatchResult& result) {
+		return result.status == "ok" || result.status == "passed";
+	}
+
+	std::string json_string(const std::string& text) {
+		std::string out = "\"";
+		for(unsigned char c : text) {
+			switch(c) {
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\t': out += "\\t"; break;
+				default:
+					if(c < 0x20 || c >= 0x7F) {
+						// Guest bytes are not UTF-8: anything outside ASCII as \u00XX
+						char escaped[7];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+						out += escaped;
+					}
+					else out += static_cast<char>(c);
+			}
+		}
+		return out + "\"";
+	}
+
+	std::string batch_report(const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results,
+			double seconds, int threads) {
+		// Hashes are hex strings: JSON numbers do not hold 64 bits everywhere
+		std::string out = "{\n  \"jobs\": [\n";
+		u64 cycles = 0, instructions = 0;
+		int ok = 0;
+		char number[64];
+		for(std::size_t i = 0; i < jobs.size(); i++) {
+			const BatchJob& job = jobs[i];
+			const BatchResult& result = results[i];
+			cycles += result.cycles;
+			instructions += result.instructions;
+			if(succeeded(result)) ok++;
+
+			out += "    {\"name\": " + json_string(job.name);
+			out += ", \"rom\": " + json_string(job.rom);
+			out += ", \"status\": " + json_string(result.status);
+			out += ", \"worker\": " + std::to_string(result.worker);
+			out += ", \"core\": " + std::to_string(job.core);
+			out += ", \"cycles\": " + std::to_string(result.cycles);
+			out += ", \"instructions\": " + std::to_string(result.instructions);
+			std::snprintf(number, sizeof(number), "%.6f", result.seconds);
+			out += ", \"seconds\": " + std::string(number);
+			out += ", \"serial\": " + json_string(result.serial);
+			out += ", \"state_hash\": \"" + hex64(result.state_hash) + "\"";
+			if(job.frame_hashes) {
+				out += ", \"frame_hashes\": [";
+				for(std::size_t k = 0; k < result.frame_hashes.size(); k++) {
+					out += (k ? ", \"" : "\"") + hex64(result.frame_hashes[k]) + "\"";
+				}
+				out += "]";
+			}
+			out += (i + 1 < jobs.size()) ? "},\n" : "}\n";
+		}
+
+		double frames = static_cast<double>(cycles) / Emulator::CYCLES_PER_FRAME;
+		out += "  ],\n  \"totals\": {";
+		out += "\"jobs\": " + std::to_string(jobs.size());
+		out += ", \"ok\": " + std::to_string(ok);
+		out += ", \"threads\": " + std::to_string(threads);
+		out += ", \"cycles\": " + std::to_string(cycles);
+		out += ", \"instructions\": " + std::to_string(instructions);
+		std::snprintf(number, sizeof(number), ", \"seconds\": %.6f", seconds);
+		out += number;
+		std::snprintf(number, sizeof(number), ", \"fps\": %.1f", seconds > 0 ? frames / seconds : 0.0);
+		out += number;
+		std::snprintf(number, sizeof(number), ", \"mips\": %.2f", seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+		out += number;
+		out += "}\n}\n";
+		return out;
+	}
+} // namespace gb
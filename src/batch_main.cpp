@@ -0,0 +1,210 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gb/batch.hpp"
+#include "gb/emulator.hpp"
+
+using my_clock = std::chrono::steady_clock;
+
+namespace {
+	struct Options {
+		std::vector<std::string> roms;
+		std::string jobs_file;
+		std::string report; // empty: JSON to stdout
+		int threads = 0;
+		bool pin = false;
+		int repeat = 1;
+		gb::BatchJob defaults;
+	};
+
+	void usage() {
+		std::cout <<
+			"usage: gbemu_batch [options] <rom>...\n"
+			"  --threads <n>        worker threads (default: one per hardware thread)\n"
+			"  --pin                pin worker i to the i-th usable core\n"
+			"  --repeat <n>         n instances of every ROM\n"
+			"  --frames <n>         run each job for n frames (default 600)\n"
+			"  --cycles <n>         run each job for n cycles\n"
+			"  --decoder <name>     switch, table, cached or jit (default cached)\n"
+			"                       jit is experimental and slower than cached on some hosts\n"
+			"  --bootrom <file>     boot ROM (default roms/bootix_dmg.bin)\n"
+			"  --frame-hashes       report a hash of every frame\n"
+			"  --test               test ROMs: stop at Passed/Failed, frames/cycles is the budget\n"
+			"  --jobs <file>        more jobs, one per line: <rom> then tab-separated\n"
+			"                       name=, frames=, cycles=, core=, decoder=, frame-hashes=0/1,\n"
+			"                       test=0/1\n"
+			"  --report <file>      write the JSON report there and a summary to stdout\n";
+	}
+
+	bool parse_decoder(const std::string& text, gb::Decoder& decoder) {
+		if(text == "switch") decoder = gb::Decoder::Switch;
+		else if(text == "table") decoder = gb::Decoder::Table;
+		else if(text == "cached") decoder = gb::Decoder::Cached;
+		else if(text == "jit") decoder = gb::Decoder::Jit;
+		else return false;
+		return true;
+	}
+
+	std::string job_name(const std::string& rom) {
+		return std::filesystem::path(rom).stem().string();
+	}
+
+	bool parse_options(int argc, char** argv, Options& options) {
+		options.defaults.cycles = 600ull * gb::Emulator::CYCLES_PER_FRAME;
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+			try {
+				if(arg == "--pin") options.pin = true;
+				else if(arg == "--frame-hashes") options.defaults.frame_hashes = true;
+				else if(arg == "--test") options.defaults.test_rom = true;
+				else if(arg == "--threads" || arg == "--repeat" || arg == "--frames" || arg == "--cycles" ||
+								arg == "--decoder" || arg == "--bootrom" || arg == "--jobs" || arg == "--report") {
+					const char* v = value();
+					if(!v) {
+						std::cerr << arg << " needs a value\n";
+						return false;
+					}
+					if(arg == "--threads") options.threads = std::stoi(v);
+					else if(arg == "--repeat") options.repeat = std::stoi(v);
+					else if(arg == "--frames") options.defaults.cycles = std::stoull(v) * gb::Emulator::CYCLES_PER_FRAME;
+					else if(arg == "--cycles") options.defaults.cycles = std::stoull(v);
+					else if(arg == "--bootrom") options.defaults.bootrom = v;
+					else if(arg == "--jobs") options.jobs_file = v;
+					else if(arg == "--report") options.report = v;
+					else if(arg == "--decoder" && !parse_decoder(v, options.defaults.decoder)) {
+						std::cerr << "unknown decoder: " << v << "\n";
+						return false;
+					}
+				}
+				else if(arg == "-h" || arg == "--help") return false;
+				else if(!arg.empty() && arg[0] == '-') {
+					std::cerr << "unknown option: " << arg << "\n";
+					return false;
+				}
+				else options.roms.push_back(arg);
+			} catch(const std::exception&) {
+				std::cerr << "bad value for " << arg << "\n";
+				return false;
+			}
+		}
+		if(options.roms.empty() && options.jobs_file.empty()) return false;
+		if(options.repeat < 1) {
+			std::cerr << "--repeat must be at least 1\n";
+			return false;
+		}
+		return true;
+	}
+
+	// <rom>[\tkey=value]... ; blank lines and # comments are skipped
+	bool read_jobs(const std::string& path, const gb::BatchJob& defaults, std::vector<gb::BatchJob>& jobs) {
+		std::ifstream ifs(path);
+		if(!ifs) {
+			std::cerr << "cannot read " << path << "\n";
+			return false;
+		}
+		std::string line;
+		int number = 0;
+		while(std::getline(ifs, line)) {
+			number++;
+			if(line.empty() || line[0] == '#') continue;
+
+			std::istringstream fields(line);
+			gb::BatchJob job = defaults;
+			std::getline(fields, job.rom, '\t');
+			job.name = job_name(job.rom);
+			std::string field;
+			while(std::getline(fields, field, '\t')) {
+				if(field.empty()) continue;
+				std::size_t eq = field.find('=');
+				std::string key = field.substr(0, eq);
+				std::string v = eq == std::string::npos ? "" : field.substr(eq + 1);
+				try {
+					if(key == "name") job.name = v;
+					else if(key == "frames") job.cycles = std::stoull(v) * gb::Emulator::CYCLES_PER_FRAME;
+					else if(key == "cycles") job.cycles = std::stoull(v);
+					else if(key == "core") job.core = std::stoi(v);
+					else if(key == "frame-hashes") job.frame_hashes = v != "0";
+					else if(key == "test") job.test_rom = v != "0";
+					else if(key == "decoder") {
+						if(!parse_decoder(v, job.decoder)) throw std::invalid_argument(v);
+					}
+					else {
+						std::cerr << path << ":" << number << ": bad field " << field << "\n";
+						return false;
+					}
+				} catch(const std::exception&) {
+					std::cerr << path << ":" << number << ": bad value in " << field << "\n";
+					return false;
+				}
+			}
+			jobs.push_back(job);
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if(!parse_options(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+
+	// 1. Jobs: every ROM argument repeat times, then the jobs file
+	std::vector<gb::BatchJob> jobs;
+	for(const std::string& rom : options.roms) {
+		for(int k = 0; k < options.repeat; k++) {
+			gb::BatchJob job = options.defaults;
+			job.rom = rom;
+			job.name = job_name(rom);
+			if(options.repeat > 1) {
+				job.name += '#';
+				job.name += std::to_string(k);
+			}
+			jobs.push_back(job);
+		}
+	}
+	if(!options.jobs_file.empty() && !read_jobs(options.jobs_file, options.defaults, jobs)) return 1;
+
+	// 2. Run
+	gb::WorkStealingPool pool(options.threads, options.pin);
+	auto start = my_clock::now();
+	std::vector<gb::BatchResult> results = gb::run_batch(pool, jobs);
+	double seconds = std::chrono::duration<double>(my_clock::now() - start).count();
+
+	// 3. Report
+	std::string report = gb::batch_report(jobs, results, seconds, pool.get_threads());
+	if(options.report.empty()) std::cout << report;
+	else {
+		std::ofstream ofs(options.report, std::ios::binary);
+		if(!(ofs << report)) {
+			std::cout << "cannot write " << options.report << "\n";
+			return 1;
+		}
+
+		double frames = 0, instructions = 0;
+		int ok = 0;
+		for(const gb::BatchResult& result : results) {
+			frames += static_cast<double>(result.cycles) / gb::Emulator::CYCLES_PER_FRAME;
+			instructions += static_cast<double>(result.instructions);
+			if(gb::succeeded(result)) ok++;
+		}
+		char line[200];
+		std::snprintf(line, sizeof(line), "%d/%zu jobs ok on %d threads in %.3f s: %.1f fps, %.2f MIPS\n",
+				ok, jobs.size(), pool.get_threads(), seconds, frames / seconds, instructions / seconds / 1e6);
+		std::cout << line;
+	}
+
+	for(const gb::BatchResult& result : results) {
+		if(result.status == "load failed") return 1;
+	}
+	return 0;
+}
@@ -1,114 +1,274 @@
 #include "gb/bus.hpp"
 #include "gb/timer.hpp"
 #include "gb/ppu.hpp"
+#include "gb/joypad.hpp"
 
 #include <fstream>
 #include <iostream>
 
 namespace gb {
-	Bus::Bus(Timer &timer, PPU &ppu, Joypad &joypad) : timer_(timer), ppu_(ppu), joypad_(joypad) {}
+	namespace {
+		// Code-write tracking: WRAM granules 0x000~0x1FF, HRAM granules 0x200~0x207
+		int code_granule(u16 addr) {
+			if(addr >= 0xFF80) return 0x200 + ((addr - 0xFF80) >> 4);
+			return (addr - 0xC000) >> 4;
+		}
+	}
+
+	Bus::Bus(Timer &timer, PPU &ppu, Joypad &joypad) : timer_(timer), ppu_(ppu), joypad_(joypad) {
+		map_pages();
+		scheduler_.schedule(Event::Timer, timer_.cycles_to_event());
+		scheduler_.schedule(Event::PPU, ppu_.cycles_to_event());
+	}
+
+	void Bus::map_pages() {
+		for(int i = 0; i < 0x100; i++) {
+			Page& page = pages_[i];
+			u16 base = static_cast<u16>(i << 8);
+			page = Page{nullptr, nullptr, read_unmapped, write_ignored};
+
+			if(base < 0x8000) page.on_write = write_rom;                               // ROM
+			else if(base < 0xA000) {                                                   // VRAM
+				page.read = ppu_.get_vram() + (base - 0x8000);
+				page.on_write = write_vram;
+			}
+			else if(base < 0xC000) page = Page{nullptr, nullptr, read_cart_ram, write_cart_ram}; // Cartridge RAM
+			else if(base >= 0xC000 && base < 0xE000) {                                 // WRAM
+				page.read = page.write = wram_.data() + (base - 0xC000);
+				page.on_write = write_wram;
+			}
+			else if(base == 0xFE00) page = Page{nullptr, nullptr, read_oam, write_oam}; // OAM
+			else if(base == 0xFF00) page = Page{nullptr, nullptr, read_io, write_io};   // I/O, HRAM, IE
+		}
+		map_cartridge();
+	}
+
+	void Bus::map_cartridge() {
+		const u8* rom0 = cartridge_.get_rom0();
+		const u8* romx = cartridge_.get_romx();
+		for(int i = 0; i < 0x40; i++) {
+			pages_[0x00 + i].read = rom0 ? rom0 + (i << 8) : nullptr;
+			pages_[0x40 + i].read = romx ? romx + (i << 8) : nullptr;
+		}
+		map_cart_ram();
+		map_bootrom();
+	}
+
+	void Bus::map_cart_ram() {
+		// Battery RAM pages get their write pointer back on their first write
+		// (write_cart_ram), so the save file learns which pages changed
+		u8* ram = cartridge_.get_ram();
+		bool direct_writes = !cartridge_.tracks_writes();
+		for(int i = 0; i < 0x20; i++) {
+			pages_[0xA0 + i].read = ram ? ram + (i << 8) : nullptr;
+			pages_[0xA0 + i].write = (ram && direct_writes) ? ram + (i << 8) : nullptr;
+		}
+	}
+
+	void Bus::map_bootrom() {
+		// Only page 0 is shared between bootrom and cartridge
+		pages_[0].read = bootrom_enabled ? bootrom_.data() : cartridge_.get_rom0();
+	}
+
+	void Bus::set_bootrom_enabled(bool flag) {
+		bootrom_enabled = flag;
+		map_bootrom();
+	}
+
+	u8 Bus::read_unmapped(Bus&, u16) {
+		return 0xFF;
+	}
 
-	u8 Bus::read8(u16 addr) const {
+	u8 Bus::read_cart_ram(Bus& bus, u16 addr) {
+		// Disabled RAM or MBC3 RTC registers
+		return bus.cartridge_.read_ram(addr, bus.scheduler_.now());
+	}
+
+	u8 Bus::read_oam(Bus& bus, u16 addr) {
+		if(addr < 0xFEA0) return bus.ppu_.read8(addr);
+		return 0xFF;
+	}
+
+	u8 Bus::read_io(Bus& bus, u16 addr) {
 		// Hooking to Timer class
-		if(addr >= 0xFF04 && addr <= 0xFF07) return timer_.read8(addr);
+		if(addr >= 0xFF04 && addr <= 0xFF07) {
+			bus.sync_timer();
+			return bus.timer_.read8(addr);
+		}
 
 		// Hooking to PPU class
-		if(addr >= 0xFF40 && addr <= 0xFF4B) return ppu_.read8(addr);
+		if(addr >= 0xFF40 && addr <= 0xFF4B) {
+			bus.sync_ppu();
+			return bus.ppu_.read8(addr);
+		}
 
 		// Hooking to Joypad class
-		if(addr == 0xFF00) return joypad_.read8(addr);
-	
-		// Memory access
-		if(bootrom_enabled && addr < 0x100) return bootrom_[addr];
-		else {
-			if(addr < 0x8000) return cartridge_[addr];
-			else if(addr >= 0x8000 && addr < 0xA000) return ppu_.read8(addr);
-			else if(addr >= 0xC000 && addr < 0xE000) return wram_[addr-0xC000];
-			else if(addr >= 0xFE00 && addr < 0xFEA0) return ppu_.read8(addr);
-			else if(addr >= 0xFF00 && addr < 0xFF80) return ioregs_[addr-0xFF00];
-			else if(addr >= 0xFF80 && addr < 0xFFFF) return hram_[addr-0xFF80];
-			else if(addr == 0xFFFF) return intr_reg;
-			else {
-				//std::cout << "invalid addr @0x" << std::hex << addr << "\n";
-				return 0xFF; // return -1
-			}
+		if(addr == 0xFF00) return bus.joypad_.read8(addr);
+
+		if(addr < 0xFF80) return bus.ioregs_[addr-0xFF00];
+		if(addr < 0xFFFF) return bus.hram_[addr-0xFF80];
+		return bus.intr_reg;
+	}
+
+	void Bus::write_ignored(Bus&, u16, u8) {
+		// ROM, bootrom and unmapped areas
+	}
+
+	void Bus::write_rom(Bus& bus, u16 addr, u8 value) {
+		// Mapper registers. A bank switch only repoints the affected pages.
+		Cartridge& cart = bus.cartridge_;
+		const u8* rom0 = cart.get_rom0();
+		const u8* romx = cart.get_romx();
+		u8* ram = cart.get_ram();
+		cart.write_rom(addr, value, bus.scheduler_.now());
+
+		bool rom_switched = false;
+		if(cart.get_rom0() != rom0) {
+			rom0 = cart.get_rom0();
+			for(int i = 0; i < 0x40; i++) bus.pages_[i].read = rom0 + (i << 8);
+			bus.map_bootrom();
+			rom_switched = true;
+		}
+		if(cart.get_romx() != romx) {
+			romx = cart.get_romx();
+			for(int i = 0; i < 0x40; i++) bus.pages_[0x40 + i].read = romx + (i << 8);
+			rom_switched = true;
 		}
+		if(cart.get_ram() != ram) bus.map_cart_ram();
+
+		// The code behind a running block may have changed: make it stop at
+		// the next instruction. Cached blocks stay valid, code_key() already
+		// keys them by bank, so code_gen() is left alone.
+		if(rom_switched) bus.rom_switches_++;
+	}
+
+	void Bus::write_cart_ram(Bus& bus, u16 addr, u8 value) {
+		Cartridge& cart = bus.cartridge_;
+		if(cart.write_ram(addr, value, bus.scheduler_.now())) {
+			bus.pages_[addr >> 8].write = cart.get_ram() + (addr & 0x1F00);
+		}
+	}
+
+	void Bus::write_vram(Bus& bus, u16 addr, u8 value) {
+		bus.ppu_.write8(addr, value);
+	}
+
+	void Bus::write_wram(Bus& bus, u16 addr, u8 value) {
+		// Only pages holding cached code come here (see mark_code)
+		bus.wram_[addr-0xC000] = value;
+		bus.note_code_write(addr);
 	}
 
-	void Bus::write8(u16 addr, u8 value) {
+	void Bus::write_oam(Bus& bus, u16 addr, u8 value) {
+		if(addr < 0xFEA0) bus.ppu_.write8(addr, value);
+	}
+
+	void Bus::write_io(Bus& bus, u16 addr, u8 value) {
 		/* NOTE: It is temporary solution */
 		if(addr == 0xFF50) {
-			bootrom_enabled = false;
+			bus.bootrom_enabled = false;
+			bus.map_bootrom();
+			bus.code_gen_++;
 		}
 
 		// Hooking to Timer class
 		if(addr >= 0xFF04 && addr <= 0xFF07) {
-			timer_.write8(addr, value);
+			bus.sync_timer();
+			bus.timer_.write8(addr, value);
+			bus.sync_timer(); // TIMA/TAC may have moved the overflow
 			return;
 		}
 
 		// Hooking to PPU class
 		if(addr >= 0xFF40 && addr <= 0xFF4B) {
-			ppu_.write8(addr, value);
+			bus.sync_ppu();
+			bus.ppu_.write8(addr, value);
 
 			// OAM DMA
 			if(addr == 0xFF46) {
-				oam_dma(value);
+				bus.oam_dma(value);
 			}
 			return;
 		}
 
 		// Hooking to Joypad class
 		if(addr == 0xFF00) {
-			joypad_.write8(addr, value);
+			bus.joypad_.write8(addr, value);
 			return;
 		}
 
-		if(bootrom_enabled && addr < 0x100) {
-			// bootrom_[addr] = value;
-		}
-		else {
-			if(addr < 0x8000) {
-				//cartridge_[addr] = value;
-			}
-			else if(addr >= 0x8000 && addr < 0xA000) ppu_.write8(addr, value);
-			else if(addr >= 0xC000 && addr < 0xE000) wram_[addr-0xC000] = value;
-			else if(addr >= 0xFE00 && addr < 0xFEA0) ppu_.write8(addr, value);
-			else if(addr >= 0xFF00 && addr < 0xFF80) ioregs_[addr-0xFF00] = value;
-			else if(addr >= 0xFF80 && addr < 0xFFFF) hram_[addr-0xFF80] = value;
-			else if(addr == 0xFFFF) intr_reg = value;
-			else {
-				//std::cout << "invalid addr@=0x" << std::hex << addr << std::endl;
-			}
+		if(addr < 0xFF80) bus.ioregs_[addr-0xFF00] = value;
+		else if(addr < 0xFFFF) {
+			bus.hram_[addr-0xFF80] = value;
+			bus.note_code_write(addr);
 		}
+		else bus.intr_reg = value;
 
 		// NOTE: It is temporal Serial communication impl.
 		if(addr == 0xFF02) {
 			if(value == 0x81) {
-				std::cout << ioregs_[0x01];
-				ioregs_[0x02] = 0;
+				if(bus.serial_out_) bus.serial_out_->push_back(static_cast<char>(bus.ioregs_[0x01]));
+				else std::cout << bus.ioregs_[0x01];
+				bus.ioregs_[0x02] = 0;
 			}
 		}
 	}
 
-	void Bus::tick(int cycles) {
-		// 1. Timer tick
-		bool timer_intr = timer_.tick(cycles);
-		if(timer_intr) {
-			ioregs_[0x0F] |= 0x04;
+	void Bus::run_events() {
+		u64 now = scheduler_.now();
+
+		// 1. Timer overflow
+		if(scheduler_.deadline(Event::Timer) <= now) sync_timer();
+
+		// 2. PPU mode transition
+		if(scheduler_.deadline(Event::PPU) <= now) sync_ppu();
+
+		// 3. Joypad press
+		if(scheduler_.deadline(Event::Joypad) <= now) {
+			scheduler_.cancel(Event::Joypad);
+			if(joypad_.tick()) ioregs_[0x0F] |= 0x10;
 		}
-		
-		// 2. PPU tick
-		u8 ppu_intr = ppu_.tick(cycles);
-		if(ppu_intr != 0) {
-			ioregs_[0x0F] |= ppu_intr;
+	}
+
+	void Bus::sync_timer() {
+		u64 now = scheduler_.now();
+		if(now != timer_synced_) {
+			if(timer_.tick(static_cast<int>(now - timer_synced_))) ioregs_[0x0F] |= 0x04;
+			timer_synced_ = now;
 		}
+		scheduler_.schedule(Event::Timer, now + timer_.cycles_to_event());
+	}
 
-		// 3. Joypad tick
-		bool joypad_intr = joypad_.tick();
-		if(joypad_intr) {
-			ioregs_[0x0F] |= 0x10;
+	void Bus::sync_ppu() {
+		u64 now = scheduler_.now();
+		if(now != ppu_synced_) {
+			u8 ppu_intr = ppu_.tick(static_cast<int>(now - ppu_synced_));
+			if(ppu_intr != 0) ioregs_[0x0F] |= ppu_intr;
+			ppu_synced_ = now;
 		}
+		scheduler_.schedule(Event::PPU, now + ppu_.cycles_to_event());
+	}
+
+	void Bus::poll_input() {
+		// Raised on the next tick, like the old per-instruction Joypad::tick()
+		if(joypad_.poll()) scheduler_.schedule(Event::Joypad, scheduler_.now());
+	}
+
+	void Bus::poll_save() {
+		// Dirty battery RAM goes to the flush thread; its pages are write
+		// protected again to catch the next round of changes
+		if(cartridge_.commit_save()) map_cart_ram();
+	}
+
+	void Bus::set_save_interval(std::chrono::milliseconds interval) {
+		cartridge_.set_save_interval(interval);
+	}
+
+	int Bus::cycles_to_event() const {
+		u64 next = scheduler_.next();
+		u64 now = scheduler_.now();
+		if(next <= now) return 0;
+		return (next - now > 0x7FFFFFFF) ? 0x7FFFFFFF : static_cast<int>(next - now);
 	}
 
 	bool Bus::load_bootrom(const std::string &path) {
@@ -121,24 +281,60 @@ namespace gb {
 		if(size != 0x100) return false; // Bootrom size should be exactly 256B
 		if(!ifs.read(reinterpret_cast<char*>(bootrom_.data()), 0x100)) return false;
 
-		bootrom_enabled = true;
+		set_bootrom_enabled(true);
 		return true;
 	}
 
-	bool Bus::load_cartridge(const std::string &path) {
-		std::ifstream ifs(path, std::ios::binary);
-		if(!ifs) return false;
+	bool Bus::load_cartridge(const std::string &path, bool persist_save) {
+		if(!cartridge_.load(path, persist_save)) return false;
+		map_cartridge();
+		code_gen_++;
+		return true;
+	}
 
-		ifs.seekg(0, std::ios::end);
-		std::streamsize size = ifs.tellg();
-		ifs.seekg(0, std::ios::beg);
-		/* NOTE: It is temporary solution */
-		if(size != 0x8000) {
-			std::cout << size << std::endl;
-			return false;
+	u32 Bus::code_key(u16 addr) const {
+		// Key = (bank << 16) | addr, so the same PC in another bank is another block
+		if(addr < 0x8000) {
+			if(bootrom_enabled && addr < 0x100) return (0xFFFFu << 16) | addr;
+			if(addr < 0x4000) return (static_cast<u32>(cartridge_.get_rom0_bank()) << 16) | addr;
+			return (static_cast<u32>(cartridge_.get_romx_bank()) << 16) | addr;
+		}
+		if(addr >= 0xC000 && addr < 0xE000) return addr;
+		if(addr >= 0xFF80 && addr < 0xFFFF) return addr;
+		return NO_CODE; // VRAM, OAM, I/O: never cached
+	}
+
+	void Bus::mark_code(u16 begin, u16 end) {
+		for(u32 addr = begin; addr < end; addr += 0x10) {
+			code_granule_[code_granule(static_cast<u16>(addr))] = true;
+		}
+		code_granule_[code_granule(static_cast<u16>(end - 1))] = true;
+
+		// WRAM pages holding code lose their direct write pointer so that
+		// stores reach note_code_write()
+		if(begin >= 0xC000 && begin < 0xE000) {
+			for(u32 page = begin >> 8; page <= static_cast<u32>(end - 1) >> 8 && page < 0xE0; page++) {
+				pages_[page].write = nullptr;
+			}
+		}
+	}
+
+	void Bus::note_code_write(u16 addr) {
+		bool& granule = code_granule_[code_granule(addr)];
+		if(granule) {
+			// Cached code overwritten: every RAM block gets re-decoded on next use
+			granule = false;
+			code_gen_++;
+		}
+
+		// Last code granule of a WRAM page gone: back to direct writes
+		if(addr < 0xE000) {
+			int first = code_granule(addr & 0xFF00);
+			for(int i = first; i < first + 0x10; i++) {
+				if(code_granule_[i]) return;
+			}
+			pages_[addr >> 8].write = wram_.data() + ((addr & 0xFF00) - 0xC000);
 		}
-		if(!ifs.read(reinterpret_cast<char*>(cartridge_.data()), size)) return false;
-		return true;
 	}
 
 	void Bus::oam_dma(u8 source) {
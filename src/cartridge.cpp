@@ -0,0 +1,198 @@
+#include "gb/cartridge.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+namespace gb {
+	namespace {
+		// Header byte 0x0149
+		u32 ram_size(u8 code) {
+			switch(code) {
+				case 0x01: return 0x2000; // 2 KiB, rounded up to one bank
+				case 0x02: return 0x2000;
+				case 0x03: return 0x8000;
+				case 0x04: return 0x20000;
+				case 0x05: return 0x10000;
+				default: return 0;
+			}
+		}
+	}
+
+	bool Cartridge::load(const std::string &path, bool persist) {
+		std::shared_ptr<const RomImage> image = RomImage::open(path);
+		if(!image) return false;
+		if(image->size() < 0x8000) {
+			std::cout << "cartridge too small: " << image->size() << std::endl;
+			return false;
+		}
+		const u8* rom = image->data();
+
+		// 1. Mapper type (0x0147)
+		u8 type = rom[0x0147];
+		rtc_present_ = false;
+		rumble_ = false;
+		switch(type) {
+			case 0x00: case 0x08: case 0x09: mapper_ = Mapper::None; break;
+			case 0x01: case 0x02: case 0x03: mapper_ = Mapper::MBC1; break;
+			case 0x0F: case 0x10: rtc_present_ = true; mapper_ = Mapper::MBC3; break;
+			case 0x11: case 0x12: case 0x13: mapper_ = Mapper::MBC3; break;
+			case 0x19: case 0x1A: case 0x1B: mapper_ = Mapper::MBC5; break;
+			case 0x1C: case 0x1D: case 0x1E: rumble_ = true; mapper_ = Mapper::MBC5; break;
+			default:
+				std::cout << "unsupported cartridge type 0x" << std::hex << static_cast<int>(type) << std::dec << std::endl;
+				return false;
+		}
+		battery_ = (type == 0x03 || type == 0x09 || type == 0x0F || type == 0x10 ||
+								type == 0x13 || type == 0x1B || type == 0x1E);
+
+		rom_ = image;
+
+		// 2. External RAM (0x0149), persisted to <rom>.sav with a battery
+		ram_size_ = ram_size(rom[0x0149]);
+		save_.reset();
+		ram_buffer_.clear();
+		if(battery_ && persist && ram_size_ > 0) {
+			std::string save_path = std::filesystem::path(path).replace_extension(".sav").string();
+			save_ = std::make_unique<SaveRam>();
+			save_->open(save_path, ram_size_);
+			ram_ = save_->data();
+		}
+		else {
+			ram_buffer_.assign(ram_size_, 0);
+			ram_ = ram_buffer_.data();
+		}
+
+		// 3. Power-on mapper state
+		ram_enabled_ = (mapper_ == Mapper::None);
+		rom_bank_ = 1;
+		bank_hi_ = 0;
+		mbc1_mode_ = false;
+		rtc_.fill(0);
+		rtc_latched_.fill(0);
+		rtc_latch_ = 0xFF;
+		rtc_cycles_ = 0;
+		update_banks();
+		return true;
+	}
+
+	void Cartridge::write_rom(u16 addr, u8 value, u64 now) {
+		switch(mapper_) {
+			case Mapper::None:
+				return;
+			case Mapper::MBC1:
+				if(addr < 0x2000) ram_enabled_ = (value & 0x0F) == 0x0A;
+				else if(addr < 0x4000) rom_bank_ = value & 0x1F;
+				else if(addr < 0x6000) bank_hi_ = value & 0x03;
+				else mbc1_mode_ = value & 0x01;
+				break;
+			case Mapper::MBC3:
+				if(addr < 0x2000) ram_enabled_ = (value & 0x0F) == 0x0A;
+				else if(addr < 0x4000) rom_bank_ = value & 0x7F;
+				else if(addr < 0x6000) bank_hi_ = value & 0x0F;
+				else {
+					// 0x00 then 0x01 copies the running clock into the readable registers
+					if(rtc_latch_ == 0x00 && value == 0x01) {
+						sync_rtc(now);
+						rtc_latched_ = rtc_;
+					}
+					rtc_latch_ = value;
+				}
+				break;
+			case Mapper::MBC5:
+				if(addr < 0x2000) ram_enabled_ = (value & 0x0F) == 0x0A;
+				else if(addr < 0x3000) rom_bank_ = static_cast<u16>((rom_bank_ & 0x100) | value);
+				else if(addr < 0x4000) rom_bank_ = static_cast<u16>((rom_bank_ & 0xFF) | ((value & 0x01) << 8));
+				else if(addr < 0x6000) bank_hi_ = value & (rumble_ ? 0x07 : 0x0F); // Bit 3 drives the motor
+				break;
+		}
+		update_banks();
+	}
+
+	void Cartridge::update_banks() {
+		u32 rom_banks = static_cast<u32>(rom_->size() / ROM_BANK);
+		u32 ram_banks = ram_size_ / RAM_BANK;
+		u32 rom0 = 0, romx = 1, ram = 0;
+
+		switch(mapper_) {
+			case Mapper::None:
+				break;
+			case Mapper::MBC1:
+				// Bank 0 in the low 5 bits always reads as 1 (0x20 -> 0x21...)
+				romx = (bank_hi_ << 5) | (rom_bank_ == 0 ? 1 : rom_bank_);
+				if(mbc1_mode_) {
+					rom0 = bank_hi_ << 5;
+					ram = bank_hi_;
+				}
+				break;
+			case Mapper::MBC3:
+				romx = (rom_bank_ == 0) ? 1 : rom_bank_;
+				ram = bank_hi_;
+				break;
+			case Mapper::MBC5:
+				romx = rom_bank_; // Bank 0 is selectable
+				ram = bank_hi_;
+				break;
+		}
+
+		rom0_bank_ = static_cast<u16>(rom0 % rom_banks);
+		romx_bank_ = static_cast<u16>(romx % rom_banks);
+		ram_bank_ = static_cast<u8>(ram_banks ? ram % ram_banks : 0);
+	}
+
+	u8* Cartridge::get_ram() {
+		if(!ram_enabled_ || ram_size_ == 0) return nullptr;
+		if(mapper_ == Mapper::MBC3 && bank_hi_ >= 0x08) return nullptr; // RTC register
+		return ram_ + ram_bank_ * RAM_BANK;
+	}
+
+	u8 Cartridge::read_ram(u16 addr, u64 now) {
+		if(!ram_enabled_) return 0xFF;
+		if(rtc_present_ && bank_hi_ >= 0x08 && bank_hi_ <= 0x0C) {
+			sync_rtc(now);
+			return rtc_latched_[bank_hi_ - 0x08];
+		}
+		if(u8* ram = get_ram()) return ram[addr - 0xA000];
+		return 0xFF;
+	}
+
+	bool Cartridge::write_ram(u16 addr, u8 value, u64 now) {
+		if(!ram_enabled_) return false;
+		if(rtc_present_ && bank_hi_ >= 0x08 && bank_hi_ <= 0x0C) {
+			static constexpr std::array<u8, 5> MASK = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+			sync_rtc(now);
+			u8 reg = bank_hi_ - 0x08;
+			rtc_[reg] = value & MASK[reg];
+			if(reg == 0) rtc_cycles_ = 0; // Writing seconds restarts the second
+			return false;
+		}
+
+		u8* ram = get_ram();
+		if(!ram) return false;
+		ram[addr - 0xA000] = value;
+		if(save_) save_->mark_dirty(static_cast<std::size_t>(ram - ram_) + (addr - 0xA000));
+		return true;
+	}
+
+	void Cartridge::sync_rtc(u64 now) {
+		u64 elapsed = now - rtc_synced_;
+		rtc_synced_ = now;
+		if(rtc_[4] & 0x40) return; // Halted
+
+		rtc_cycles_ += elapsed;
+		u64 seconds = rtc_cycles_ / RTC_HZ;
+		rtc_cycles_ %= RTC_HZ;
+		if(seconds == 0) return;
+
+		// Carry through s/m/h/days; registers may hold out-of-range values
+		u64 s = rtc_[0] + seconds;
+		u64 m = rtc_[1] + s / 60;
+		u64 h = rtc_[2] + m / 60;
+		u64 d = ((static_cast<u64>(rtc_[4] & 0x01) << 8) | rtc_[3]) + h / 24;
+		rtc_[0] = static_cast<u8>(s % 60);
+		rtc_[1] = static_cast<u8>(m % 60);
+		rtc_[2] = static_cast<u8>(h % 24);
+		rtc_[3] = static_cast<u8>(d & 0xFF);
+		rtc_[4] = static_cast<u8>((rtc_[4] & 0xC0) | ((d >> 8) & 0x01));
+		if(d > 0x1FF) rtc_[4] |= 0x80; // Day counter overflow
+	}
+} // namespace gb
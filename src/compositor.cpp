@@ -0,0 +1,135 @@
+#include "gb/compositor.hpp"
+
+#ifndef GBEMU_SIMD
+#define GBEMU_SIMD 1
+#endif
+
+#if GBEMU_SIMD && defined(__AVX2__)
+#define GBEMU_COMPOSE_AVX2 1
+#include <immintrin.h>
+#elif GBEMU_SIMD && (defined(__SSE2__) || defined(_M_X64))
+#define GBEMU_COMPOSE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace gb::compose {
+	namespace {
+		u8 lookup(u8 pal, u8 index) {
+			return (pal >> (index * 2)) & 0x3;
+		}
+
+#if defined(GBEMU_COMPOSE_SSE2) || defined(GBEMU_COMPOSE_AVX2)
+		// 4-entry byte lookup with compares (SSE2 has no byte shuffle)
+		__m128i lookup4(__m128i index, u8 e0, u8 e1, u8 e2, u8 e3) {
+			__m128i r = _mm_and_si128(_mm_cmpeq_epi8(index, _mm_setzero_si128()), _mm_set1_epi8(static_cast<char>(e0)));
+			r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(1)), _mm_set1_epi8(static_cast<char>(e1))));
+			r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(2)), _mm_set1_epi8(static_cast<char>(e2))));
+			r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(index, _mm_set1_epi8(3)), _mm_set1_epi8(static_cast<char>(e3))));
+			return r;
+		}
+
+		__m128i palette_lookup(__m128i index, u8 pal) {
+			return lookup4(index, lookup(pal, 0), lookup(pal, 1), lookup(pal, 2), lookup(pal, 3));
+		}
+#endif
+	}
+
+	void palette(const u8* indices, u8 pal, u8* shades, int count) {
+		int i = 0;
+#if defined(GBEMU_COMPOSE_AVX2)
+		// vpshufb works per 128-bit lane: the 4-entry table goes in both
+		const __m256i lut = _mm256_setr_epi8(
+				lookup(pal, 0), lookup(pal, 1), lookup(pal, 2), lookup(pal, 3), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+				lookup(pal, 0), lookup(pal, 1), lookup(pal, 2), lookup(pal, 3), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		for(; i + 32 <= count; i += 32) {
+			__m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(shades + i), _mm256_shuffle_epi8(lut, index));
+		}
+#endif
+#if defined(GBEMU_COMPOSE_SSE2) || defined(GBEMU_COMPOSE_AVX2)
+		for(; i + 16 <= count; i += 16) {
+			__m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(shades + i), palette_lookup(index, pal));
+		}
+#endif
+		for(; i < count; i++) shades[i] = lookup(pal, indices[i]);
+	}
+
+	void sprite(u8* line, const u8* bg, const u8* indices, u8 pal, u8 attr) {
+		// 1. X flip: mirror the row before anything is checked per column
+		u8 flipped[8];
+		if(attr & 0x20) {
+			for(int x = 0; x < 8; x++) flipped[x] = indices[7 - x];
+			indices = flipped;
+		}
+
+#if defined(GBEMU_COMPOSE_SSE2) || defined(GBEMU_COMPOSE_AVX2)
+		// 2. Opaque and not behind the background -> take the sprite shade
+		__m128i index = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices));
+		__m128i zero = _mm_setzero_si128();
+		__m128i mask = _mm_andnot_si128(_mm_cmpeq_epi8(index, zero), _mm_set1_epi8(-1));
+		if(attr & 0x80) {
+			__m128i under = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bg));
+			mask = _mm_and_si128(mask, _mm_cmpeq_epi8(under, zero));
+		}
+		__m128i dst = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(line));
+		__m128i src = palette_lookup(index, pal);
+		dst = _mm_or_si128(_mm_andnot_si128(mask, dst), _mm_and_si128(mask, src));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(line), dst);
+#else
+		// 2. Opaque and not behind the background -> take the sprite shade
+		for(int x = 0; x < 8; x++) {
+			if(indices[x] == 0) continue;
+			if((attr & 0x80) && bg[x] != 0) continue;
+			line[x] = lookup(pal, indices[x]);
+		}
+#endif
+	}
+
+	void convert(const u8* shades, const Palette& palette, u32* out, int count) {
+		int i = 0;
+#if defined(GBEMU_COMPOSE_AVX2)
+		const __m256i lut = _mm256_setr_epi32(
+				static_cast<int>(palette[0]), static_cast<int>(palette[1]), static_cast<int>(palette[2]), static_cast<int>(palette[3]),
+				static_cast<int>(palette[0]), static_cast<int>(palette[1]), static_cast<int>(palette[2]), static_cast<int>(palette[3]));
+		const __m256i mask = _mm256_set1_epi32(0x3);
+		for(; i + 8 <= count; i += 8) {
+			__m256i shade = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(shades + i)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permutevar8x32_epi32(lut, _mm256_and_si256(shade, mask)));
+		}
+#elif defined(GBEMU_COMPOSE_SSE2)
+		__m128i entry[4];
+		for(int k = 0; k < 4; k++) entry[k] = _mm_set1_epi32(static_cast<int>(palette[k]));
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i mask = _mm_set1_epi8(0x3);
+		for(; i + 16 <= count; i += 16) {
+			__m128i shade = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + i)), mask);
+			__m128i lo = _mm_unpacklo_epi8(shade, zero);
+			__m128i hi = _mm_unpackhi_epi8(shade, zero);
+			__m128i quad[4] = {
+				_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+				_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero),
+			};
+			// 4 pixels at a time: select the entry whose shade matches
+			for(int q = 0; q < 4; q++) {
+				__m128i pixel = _mm_and_si128(_mm_cmpeq_epi32(quad[q], zero), entry[0]);
+				for(int k = 1; k < 4; k++) {
+					pixel = _mm_or_si128(pixel, _mm_and_si128(_mm_cmpeq_epi32(quad[q], _mm_set1_epi32(k)), entry[k]));
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + q * 4), pixel);
+			}
+		}
+#endif
+		for(; i < count; i++) out[i] = palette[shades[i] & 0x3];
+	}
+
+	const char* backend() {
+#if defined(GBEMU_COMPOSE_AVX2)
+		return "avx2";
+#elif defined(GBEMU_COMPOSE_SSE2)
+		return "sse2";
+#else
+		return "scalar";
+#endif
+	}
+} // namespace gb::compose
@@ -8,23 +8,19 @@ namespace gb {
 
 	void CPU::reset() {
 		regs.a = 0;
-		regs.b = 0;
-		regs.c = 0;
-		regs.d = 0;
-		regs.e = 0;
-		regs.f = 0;
-		regs.h = 0;
-		regs.l = 0;
+		regs.bc = 0;
+		regs.de = 0;
+		regs.hl = 0;
 
 		regs.pc = 0x0000;
 		regs.sp = 0xFFFE;
 
-		flags.z = 0;
-		flags.n = 0;
-		flags.h = 0;
-		flags.c = 0;
+		flags.set(0);
 
 		halted_ = false;
+
+		blocks_.clear();
+		block_lookup_.fill(nullptr);
 	}
   void CPU::isr_vec(u8 intr_num, u16 vec) {
     // 1. De-assert IME, IF
@@ -39,6 +35,7 @@ namespace gb {
 
     // 3. Jump to $vec
     regs.pc = vec;
+    if constexpr (GBEMU_PROFILE) { if(guest_) guest_->call(GuestProfiler::IRQ_KEY | vec, regs.sp); }
 
     // 4. Return
     return;
@@ -90,40 +87,85 @@ namespace gb {
 	int CPU::step() {
     // 1. Check pending interrupt
 		int intr_res = isr_handler();
-		if(intr_res == 20) return 20;
+		if(intr_res == 20) {
+			if constexpr (GBEMU_PROFILE) {
+				if(profile_) profile_->record_interrupt(20);
+				guest_cycles(regs.pc, 20);
+			}
+			return 20;
+		}
 
     // 2. Check whether CPU is halted
-		if(halted_) return 4; // HALT
+		if(halted_) { // HALT
+			if constexpr (GBEMU_PROFILE) {
+				if(profile_) profile_->record_halt(4);
+				guest_cycles(regs.pc, 4, GuestProfiler::Leaf::Halt);
+			}
+			return 4;
+		}
 
     // 3. Execute instructions
+		u16 pc = regs.pc;
 		u8 opcode = bus_.read8(regs.pc);
+		instructions_++;
 		if(!halt_bug) regs.pc++;
 		else halt_bug = false;
 
-		if(regs.pc == 0x01c0) std::cout << "success\n";
 		//std::cout << "current opcode=0x" << std::hex << (int)opcode << ", pc=0x" << (int)regs.pc << std::endl;
 
+		auto run_op = [&] { return (decoder_ == Decoder::Table) ? op_table_[opcode](*this) : execute(opcode); };
+		if constexpr (GBEMU_PROFILE) {
+			int cycles = profile_ ? profile_op(opcode, (opcode == 0xCB) ? bus_.read8(regs.pc) : 0, run_op) : run_op();
+			guest_cycles(pc, cycles);
+			if(guest_ && (GuestProfiler::is_call(opcode) || GuestProfiler::is_ret(opcode))) guest_stack(pc, opcode);
+			return cycles;
+		}
+		return run_op();
+	}
+
+	void CPU::guest_sample(u16 pc, GuestProfiler::Leaf leaf) {
+		// Without a profiler the countdown just starts over
+		if(!guest_) {
+			guest_countdown_ = GUEST_OFF;
+			return;
+		}
+		int period = static_cast<int>(guest_->get_period());
+		int due = 1 + -guest_countdown_ / period;
+		guest_countdown_ += due * period;
+		guest_->sample(guest_key(pc), regs.sp, leaf, due);
+	}
+
+	u32 CPU::guest_key(u16 pc) const {
+		u32 key = bus_.code_key(pc);
+		return (key == Bus::NO_CODE) ? pc : key;
+	}
+
+	int CPU::halt() {
+		if(ime_) {
+			// Enter IDLE mode
+			halted_ = true;
+		}
+		else {
+			u8 intr_flags = bus_.read8(0xFF0F);
+			u8 intr_enable = bus_.read8(0xFFFF);
+
+			// Case 1: No pending interrupts
+			if((intr_flags & intr_enable) == 0) {
+				halted_ = true;
+			}
+			// Case 2: Pending interrupts exist
+			else {
+				halt_bug = true;
+				halted_ = false;
+			}
+		}
+		return 4;
+	}
+
+	int CPU::execute(u8 opcode) {
 		if((opcode & 0xC0) == 0x40) { // LD r8, r8; 0x40 ~ 0x7F
 			if(opcode == 0x76) { // HALT
-				if(ime_) {
-					// Enter IDLE mode
-					halted_ = true;
-				}
-				else {
-					u8 intr_flags = bus_.read8(0xFF0F);
-					u8 intr_enable = bus_.read8(0xFFFF);
-
-					// Case 1: No pending interrupts
-					if((intr_flags & intr_enable) == 0) {
-						halted_ = true;
-					}
-					// Case 2: Pending interrupts exist
-					else {
-						halt_bug = true;
-						halted_ = false;
-					}
-				}
-				return 4;
+				return halt();
 			}
 			u8 src = opcode & 0x07;
 			u8 dest = (opcode & 0x38) >> 3;
@@ -149,7 +191,7 @@ namespace gb {
 					break;
 				case 6:
 					{
-						u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+						u16 hl = regs.hl;
 						src_val = bus_.read8(hl);
 						break;
 					}
@@ -178,7 +220,7 @@ namespace gb {
 					break;
 				case 6:
 					{
-						u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+						u16 hl = regs.hl;
 						bus_.write8(hl, src_val);
 						break;
 					}
@@ -214,7 +256,7 @@ namespace gb {
 					break;
 				case 6: 
 					{
-						u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+						u16 hl = regs.hl;
 						reg_val = bus_.read8(hl);
 						break;
 					}
@@ -227,21 +269,21 @@ namespace gb {
 				case 0: // ADD A, r8
 					{
 						u16 temp = regs.a + reg_val;
-						flags.z = ((temp & 0xFF) == 0) ? 1 : 0;
-						flags.n = 0;
-						flags.c = (temp > 0xFF) ? 1 : 0;
-						flags.h = ((((regs.a & 0x0F) + (reg_val & 0x0F)) & 0x10) == 0x10) ? 1 : 0;
+						flags.set_z(((temp & 0xFF) == 0) ? 1 : 0);
+						flags.set_n(0);
+						flags.set_c((temp > 0xFF) ? 1 : 0);
+						flags.set_h(((((regs.a & 0x0F) + (reg_val & 0x0F)) & 0x10) == 0x10) ? 1 : 0);
 						regs.a = temp & 0xFF;
 						return (reg == 6) ? 8 : 4;
 					}
 				case 1: // ADC A, r8
 					{
-						u8 carry = (flags.c) ? 1 : 0;
+						u8 carry = (flags.c()) ? 1 : 0;
 						u16 temp = regs.a + reg_val + carry;
-						flags.z = ((temp & 0xFF) == 0) ? 1 : 0;
-						flags.n = 0;
-						flags.c = (temp > 0xFF) ? 1 : 0;
-						flags.h = ((((regs.a & 0x0F) + (reg_val & 0x0F) + carry) & 0x10) == 0x10) ? 1 : 0;
+						flags.set_z(((temp & 0xFF) == 0) ? 1 : 0);
+						flags.set_n(0);
+						flags.set_c((temp > 0xFF) ? 1 : 0);
+						flags.set_h(((((regs.a & 0x0F) + (reg_val & 0x0F) + carry) & 0x10) == 0x10) ? 1 : 0);
 						regs.a = temp & 0xFF;
 						return (reg == 6) ? 8 : 4;
 					}
@@ -249,51 +291,51 @@ namespace gb {
 				case 7: // CP A, r8
 					{
 						u16 temp = regs.a - reg_val;
-						flags.z = ((temp & 0xFF) == 0) ? 1 : 0;
-						flags.n = 1;
-						flags.h = ((regs.a & 0x0F) < (reg_val & 0x0F)) ? 1 : 0;
-						flags.c = (regs.a < reg_val) ? 1 : 0;
+						flags.set_z(((temp & 0xFF) == 0) ? 1 : 0);
+						flags.set_n(1);
+						flags.set_h(((regs.a & 0x0F) < (reg_val & 0x0F)) ? 1 : 0);
+						flags.set_c((regs.a < reg_val) ? 1 : 0);
 						if(op == 2) regs.a = temp & 0xFF;
 						return (reg == 6) ? 8 : 4;
 					}
 				case 3: // SBC A, r8
 					{
-						u8 carry = (flags.c) ? 1 : 0;
+						u8 carry = (flags.c()) ? 1 : 0;
 						u16 temp = regs.a - (reg_val + carry);
-						flags.z = ((temp & 0xFF) == 0) ? 1 : 0;
-						flags.n = 1;
-						flags.c = (regs.a < reg_val + carry) ? 1 : 0;
-						flags.h = ((regs.a & 0x0F) < ((reg_val & 0x0F) + carry)) ? 1 : 0;
+						flags.set_z(((temp & 0xFF) == 0) ? 1 : 0);
+						flags.set_n(1);
+						flags.set_c((regs.a < reg_val + carry) ? 1 : 0);
+						flags.set_h(((regs.a & 0x0F) < ((reg_val & 0x0F) + carry)) ? 1 : 0);
 						regs.a = temp & 0xFF;
 						return (reg == 6) ? 8 : 4;
 					}
 				case 4: // AND A, r8
 					{
 						u8 result = regs.a & reg_val;
-						flags.z = (result == 0) ? 1 : 0;
-						flags.n = 0;
-						flags.h = 1;
-						flags.c = 0;
+						flags.set_z((result == 0) ? 1 : 0);
+						flags.set_n(0);
+						flags.set_h(1);
+						flags.set_c(0);
 						regs.a = result;
 						return (reg == 6) ? 8 : 4;
 					}
 				case 5: // XOR A, r8
 					{
 						u8 result = regs.a ^ reg_val;
-						flags.z = (result == 0) ? 1 : 0;
-						flags.n = 0;
-						flags.h = 0;
-						flags.c = 0;
+						flags.set_z((result == 0) ? 1 : 0);
+						flags.set_n(0);
+						flags.set_h(0);
+						flags.set_c(0);
 						regs.a = result;
 						return (reg == 6) ? 8 : 4;
 					}
 				case 6: // OR A, r8
 					{
 						u8 result = regs.a | reg_val;
-						flags.z = (result == 0) ? 1 : 0;
-						flags.n = 0;
-						flags.h = 0;
-						flags.c = 0;
+						flags.set_z((result == 0) ? 1 : 0);
+						flags.set_n(0);
+						flags.set_h(0);
+						flags.set_c(0);
 						regs.a = result;
 						return (reg == 6) ? 8 : 4;
 					}
@@ -329,7 +371,7 @@ namespace gb {
 					break;
 				case 6: 
 					{
-						u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+						u16 hl = regs.hl;
 						reg_val = bus_.read8(hl);
 						break;
 					}
@@ -345,52 +387,52 @@ namespace gb {
 						{
 							u8 hi = (reg_val & 0x80) >> 7;
 							reg_val = static_cast<u8>((reg_val << 1) | hi);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (hi == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((hi == 1) ? 1 : 0);
 							break;
 						}
 					case 1: // RRC r8
 						{
 							u8 lo = (reg_val & 0x01);
 							reg_val = static_cast<u8>((reg_val >> 1) | (lo << 7));
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (lo == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((lo == 1) ? 1 : 0);
 							break;
 						}
 					case 2: // RL r8
 						{
 							u8 hi = (reg_val & 0x80) >> 7;
-							u8 carry = (flags.c) ? 1 : 0;
+							u8 carry = (flags.c()) ? 1 : 0;
 							reg_val = static_cast<u8>((reg_val << 1) | carry);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (hi == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((hi == 1) ? 1 : 0);
 							break;
 						}
 					case 3: // RR r8
 						{
 							u8 lo = (reg_val & 0x01);
-							u8 carry = (flags.c) ? 1 : 0;
+							u8 carry = (flags.c()) ? 1 : 0;
 							reg_val = static_cast<u8>((reg_val >> 1) | (carry << 7));
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (lo == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((lo == 1) ? 1 : 0);
 							break;
 						}
 					case 4: // SLA r8
 						{
 							u8 hi = (reg_val & 0x80) >> 7;
 							reg_val = static_cast<u8>((reg_val << 1) & 0xFE);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (hi == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((hi == 1) ? 1 : 0);
 							break;
 						}
 					case 5: // SRA r8
@@ -398,10 +440,10 @@ namespace gb {
 							u8 lo = (reg_val & 0x01);
 							u8 hi = (reg_val & 0x80);
 							reg_val = static_cast<u8>((reg_val >> 1) | hi);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (lo == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((lo == 1) ? 1 : 0);
 							break;
 						}
 					case 6: // SWAP r8
@@ -409,20 +451,20 @@ namespace gb {
 							u8 lo = (reg_val & 0x0F) << 4;
 							u8 hi = (reg_val & 0xF0) >> 4; 
 							reg_val = static_cast<u8>(lo | hi);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c(0);
 							break;
 						}
 					case 7: // SRL r8
 						{
 							u8 lo = (reg_val & 0x01);
 							reg_val = static_cast<u8>((reg_val >> 1) & 0x7F);
-							flags.z = (reg_val == 0) ? 1 : 0;
-							flags.n = 0;
-							flags.h = 0;
-							flags.c = (lo == 1) ? 1 : 0;
+							flags.set_z((reg_val == 0) ? 1 : 0);
+							flags.set_n(0);
+							flags.set_h(0);
+							flags.set_c((lo == 1) ? 1 : 0);
 							break;
 						}
 				}
@@ -448,7 +490,7 @@ namespace gb {
 						break;
 					case 6: 
 						{
-							u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+							u16 hl = regs.hl;
 							bus_.write8(hl, reg_val);
 							break;
 						}
@@ -464,9 +506,9 @@ namespace gb {
 			int idx = static_cast<int>(bit);
 			if(op == 1) { // BIT u3, r8
 				u8 test = (reg_val >> idx) & 0x01;
-				flags.z = (test == 0) ? 1 : 0;
-				flags.n = 0;
-				flags.h = 1;
+				flags.set_z((test == 0) ? 1 : 0);
+				flags.set_n(0);
+				flags.set_h(1);
 				return (reg == 6) ? 12 : 8;
 			}
 			if(op == 2) {
@@ -496,7 +538,7 @@ namespace gb {
 					break;
 				case 6: 
 					{
-						u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+						u16 hl = regs.hl;
 						bus_.write8(hl, reg_val);
 						break;
 					}
@@ -520,33 +562,32 @@ namespace gb {
 				}
 			case 0x02: // LD [BC], A
 				{
-					u16 bc = (static_cast<u16>(regs.b) << 8) | regs.c;
+					u16 bc = regs.bc;
 					bus_.write8(bc, regs.a);	
 					return 8;
 				}
 			case 0x03: // INC BC
 				{
-					u16 bc = (static_cast<u16>(regs.b) << 8) | regs.c;
+					u16 bc = regs.bc;
 					bc++;
-					regs.b = static_cast<u8>(bc >> 8);
-					regs.c = static_cast<u8>(bc & 0xFF);
+					regs.bc = bc;
 					return 8;
 				}
 			case 0x04: // INC B
 				{
 					u16 tmp = static_cast<u16>(regs.b + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.b = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x05: // DEC B
 				{
 					u8 tmp = regs.b - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.b = tmp;
 					return 4;
 				}
@@ -560,8 +601,10 @@ namespace gb {
 				{
 					u8 hi = (regs.a & 0x80) >> 7;
 					regs.a = (regs.a << 1) | hi;
-					flags.z = flags.n = flags.h = 0;
-					flags.c = hi;
+					flags.set_z(0);
+					flags.set_n(0);
+					flags.set_h(0);
+					flags.set_c(hi);
 					return 4;
 				}
 			case 0x08: // LD [a16], SP
@@ -577,46 +620,44 @@ namespace gb {
 				}
 			case 0x09: // ADD HL, BC
 				{
-					u16 bc = static_cast<u16>(regs.c) | (static_cast<u16>(regs.b) << 8);
-					u16 hl = static_cast<u16>(regs.l) | (static_cast<u16>(regs.h) << 8);
+					u16 bc = regs.bc;
+					u16 hl = regs.hl;
 					u32 tmp = hl + bc;
-					flags.n = 0;
-					flags.h = ((hl & 0x0FFF) + (bc & 0x0FFF) > 0x0FFF) ? 1 : 0;
-					flags.c = (tmp > 0xFFFF) ? 1 : 0;
+					flags.set_n(0);
+					flags.set_h(((hl & 0x0FFF) + (bc & 0x0FFF) > 0x0FFF) ? 1 : 0);
+					flags.set_c((tmp > 0xFFFF) ? 1 : 0);
 					hl = static_cast<u16>(tmp & 0xFFFF);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0x00FF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x0A: // LD A, [BC]
 				{
-					u16 bc = (static_cast<u16>(regs.b) << 8) | regs.c;
+					u16 bc = regs.bc;
 					regs.a = bus_.read8(bc);
 					return 8;
 				}
 			case 0x0B: // DEC BC
 				{
-					u16 bc = (static_cast<u16>(regs.b) << 8) | regs.c;
+					u16 bc = regs.bc;
 					bc--;
-					regs.b = static_cast<u8>(bc >> 8);
-					regs.c = static_cast<u8>(bc & 0xFF);
+					regs.bc = bc;
 					return 8;
 				}
 			case 0x0C: // INC C
 				{
 					u16 tmp = static_cast<u16>(regs.c + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.c = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x0D: // DEC C
 				{
 					u8 tmp = regs.c - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.c = tmp;
 					return 4;
 				}
@@ -630,8 +671,10 @@ namespace gb {
 				{
 					u8 lo = (regs.a & 0x01);
 					regs.a = (regs.a >> 1) | (lo << 7);
-					flags.z = flags.n = flags.h = 0;
-					flags.c = (lo == 1) ? 1 : 0;
+					flags.set_z(0);
+					flags.set_n(0);
+					flags.set_h(0);
+					flags.set_c((lo == 1) ? 1 : 0);
 					return 4;
 				}
 			case 0x11: // LD DE, n16
@@ -644,33 +687,32 @@ namespace gb {
 				}
 			case 0x12: // LD [DE], A
 				{
-					u16 de = (static_cast<u16>(regs.d) << 8) | regs.e;
+					u16 de = regs.de;
 					bus_.write8(de, regs.a);	
 					return 8;
 				}
 			case 0x13: // INC DE
 				{
-					u16 de = (static_cast<u16>(regs.d) << 8) | regs.e;
+					u16 de = regs.de;
 					de++;
-					regs.d = static_cast<u8>(de >> 8);
-					regs.e = static_cast<u8>(de & 0xFF);
+					regs.de = de;
 					return 8;
 				}
 			case 0x14: // INC D
 				{
 					u16 tmp = static_cast<u16>(regs.d + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.d = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x15: // DEC D
 				{
 					u8 tmp = regs.d - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.d = tmp;
 					return 4;
 				}
@@ -683,9 +725,11 @@ namespace gb {
 			case 0x17: // RLA
 				{
 					u8 hi = (regs.a & 0x80) >> 7;
-					regs.a = (regs.a << 1) | static_cast<u8>(flags.c);
-					flags.z = flags.h = flags.n = 0;
-					flags.c = (hi == 1) ? 1 : 0;
+					regs.a = (regs.a << 1) | static_cast<u8>(flags.c());
+					flags.set_z(0);
+					flags.set_h(0);
+					flags.set_n(0);
+					flags.set_c((hi == 1) ? 1 : 0);
 					return 4;
 				}
 			case 0x18: // JR e8
@@ -696,46 +740,44 @@ namespace gb {
 				}
 			case 0x19: // ADD HL, DE
 				{
-					u16 de = static_cast<u16>(regs.e) | (static_cast<u16>(regs.d) << 8);
-					u16 hl = static_cast<u16>(regs.l) | (static_cast<u16>(regs.h) << 8);
+					u16 de = regs.de;
+					u16 hl = regs.hl;
 					u32 tmp = hl + de;
-					flags.n = 0;
-					flags.h = ((hl & 0x0FFF) + (de & 0x0FFF) > 0x0FFF) ? 1 : 0;
-					flags.c = (tmp > 0xFFFF) ? 1 : 0;
+					flags.set_n(0);
+					flags.set_h(((hl & 0x0FFF) + (de & 0x0FFF) > 0x0FFF) ? 1 : 0);
+					flags.set_c((tmp > 0xFFFF) ? 1 : 0);
 					hl = static_cast<u16>(tmp & 0xFFFF);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0x00FF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x1A: // LD A, [DE]
 				{
-					u16 de = (static_cast<u16>(regs.d) << 8) | regs.e;
+					u16 de = regs.de;
 					regs.a = bus_.read8(de);
 					return 8;
 				}
 			case 0x1B: // DEC DE
 				{
-					u16 de = (static_cast<u16>(regs.d) << 8) | regs.e;
+					u16 de = regs.de;
 					de--;
-					regs.d = static_cast<u8>(de >> 8);
-					regs.e = static_cast<u8>(de & 0xFF);
+					regs.de = de;
 					return 8;
 				}
 			case 0x1C: // INC E
 				{
 					u16 tmp = static_cast<u16>(regs.e + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.e = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x1D: // DEC E
 				{
 					u8 tmp = regs.e - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.e = tmp;
 					return 4;
 				}
@@ -748,16 +790,18 @@ namespace gb {
 			case 0x1F: // RRA
 				{
 					u8 lo = (regs.a & 0x01);
-					u8 carry = static_cast<u8>(flags.c);
+					u8 carry = static_cast<u8>(flags.c());
 					regs.a = (regs.a >> 1) | (carry << 7);
-					flags.z = flags.n = flags.h = 0;
-					flags.c = (lo == 1) ? 1 : 0;
+					flags.set_z(0);
+					flags.set_n(0);
+					flags.set_h(0);
+					flags.set_c((lo == 1) ? 1 : 0);
 					return 4;
 				}
 			case 0x20: // JR NZ, e8
 				{
 					int8_t offset = static_cast<int8_t>(bus_.read8(regs.pc++));
-					if(!flags.z) {
+					if(!flags.z()) {
 						regs.pc = static_cast<u16>(regs.pc + offset);
 						return 12;
 					}
@@ -773,36 +817,34 @@ namespace gb {
 				}
 			case 0x22: // LD [HL+], A
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					bus_.write8(hl, regs.a);	
 					hl++;
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x23: // INC HL
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					hl++;
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x24: // INC H
 				{
 					u16 tmp = static_cast<u16>(regs.h + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.h = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x25: // DEC H
 				{
 					u8 tmp = regs.h - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.h = tmp;
 					return 4;
 				}
@@ -815,27 +857,27 @@ namespace gb {
 			case 0x27: // DAA
 				{
 					u8 adj = 0;
-					if(!flags.n) {
-						if(flags.h || ((regs.a & 0xF) > 0x9)) adj += 0x6;
-						if(flags.c || (regs.a > 0x99)) {
+					if(!flags.n()) {
+						if(flags.h() || ((regs.a & 0xF) > 0x9)) adj += 0x6;
+						if(flags.c() || (regs.a > 0x99)) {
 							adj += 0x60;
-							flags.c = 1;
+							flags.set_c(1);
 						}
 						regs.a += adj;
 					}
 					else {
-						if(flags.h) adj += 0x6;
-						if(flags.c) adj += 0x60;
+						if(flags.h()) adj += 0x6;
+						if(flags.c()) adj += 0x60;
 						regs.a -= adj;
 					}
-					flags.z = (regs.a == 0) ? 1 : 0;
-					flags.h = 0;
+					flags.set_z((regs.a == 0) ? 1 : 0);
+					flags.set_h(0);
 					return 4;
 				}
 			case 0x28: // JR Z, e8
 				{
 					int8_t offset = static_cast<int8_t>(bus_.read8(regs.pc++));
-					if(flags.z) {
+					if(flags.z()) {
 						regs.pc += offset;
 						return 12;
 					}
@@ -843,47 +885,44 @@ namespace gb {
 				}
 			case 0x29: // ADD HL, HL
 				{
-					u16 hl = static_cast<u16>(regs.l) | (static_cast<u16>(regs.h) << 8);
+					u16 hl = regs.hl;
 					u32 tmp = hl + hl;
-					flags.n = 0;
-					flags.h = ((hl & 0x0FFF) + (hl & 0x0FFF) > 0x0FFF) ? 1 : 0;
-					flags.c = (tmp > 0xFFFF) ? 1 : 0;
+					flags.set_n(0);
+					flags.set_h(((hl & 0x0FFF) + (hl & 0x0FFF) > 0x0FFF) ? 1 : 0);
+					flags.set_c((tmp > 0xFFFF) ? 1 : 0);
 					hl = static_cast<u16>(tmp & 0xFFFF);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0x00FF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x2A: // LD A, [HL+]
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					regs.a = bus_.read8(hl++);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x2B: // DEC HL
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					hl--;
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x2C: // INC L
 				{
 					u16 tmp = static_cast<u16>(regs.l + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.l = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x2D: // DEC L
 				{
 					u8 tmp = regs.l - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.l = tmp;
 					return 4;
 				}
@@ -896,13 +935,14 @@ namespace gb {
 			case 0x2F: // CPL
 				{
 					regs.a = ~regs.a;
-					flags.n = flags.h = 1;
+					flags.set_n(1);
+					flags.set_h(1);
 					return 4;
 				}
 			case 0x30: // JR NC, e8
 				{
 					int8_t offset = static_cast<int8_t>(bus_.read8(regs.pc++));
-					if(!flags.c) {
+					if(!flags.c()) {
 						regs.pc = static_cast<u16>(regs.pc + offset);
 						return 12;
 					}
@@ -917,11 +957,10 @@ namespace gb {
 				}
 			case 0x32: // LD [HL-], A
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					bus_.write8(hl, regs.a);	
 					hl--;
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x33: // INC SP
@@ -931,42 +970,42 @@ namespace gb {
 				}
 			case 0x34: // INC [HL]
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					u16 tmp = static_cast<u16>(bus_.read8(hl) + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					bus_.write8(hl, static_cast<u8>(tmp));
 					return 12;
 				}
 			case 0x35: // DEC [HL]
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					u8 tmp = bus_.read8(hl) - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					bus_.write8(hl, tmp);
 					return 12;
 				}
 			case 0x36: // LD [HL], n8
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | static_cast<u16>(regs.l);
+					u16 hl = regs.hl;
 					u8 imm = bus_.read8(regs.pc++);
 					bus_.write8(hl, imm);
 					return 12;
 				}
 			case 0x37: // SCF
 				{
-					flags.c = 1;
-					flags.n = 0;
-					flags.h = 0;
+					flags.set_c(1);
+					flags.set_n(0);
+					flags.set_h(0);
 					return 4;
 				}
 			case 0x38: // JR C, e8
 				{
 					int8_t offset = static_cast<int8_t>(bus_.read8(regs.pc++));
-					if(flags.c) {
+					if(flags.c()) {
 						regs.pc += offset;
 						return 12;
 					}
@@ -974,22 +1013,20 @@ namespace gb {
 				}
 			case 0x39: // ADD HL, SP
 				{
-					u16 hl = static_cast<u16>(regs.l) | (static_cast<u16>(regs.h) << 8);
+					u16 hl = regs.hl;
 					u32 tmp = hl + regs.sp;
-					flags.n = 0;
-					flags.h = ((hl & 0x0FFF) + (regs.sp & 0x0FFF) > 0x0FFF) ? 1 : 0;
-					flags.c = (tmp > 0xFFFF) ? 1 : 0;
+					flags.set_n(0);
+					flags.set_h(((hl & 0x0FFF) + (regs.sp & 0x0FFF) > 0x0FFF) ? 1 : 0);
+					flags.set_c((tmp > 0xFFFF) ? 1 : 0);
 					hl = static_cast<u16>(tmp & 0xFFFF);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0x00FF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x3A: // LD A, [HL-]
 				{
-					u16 hl = (static_cast<u16>(regs.h) << 8) | regs.l;
+					u16 hl = regs.hl;
 					regs.a = bus_.read8(hl--);
-					regs.h = static_cast<u8>(hl >> 8);
-					regs.l = static_cast<u8>(hl & 0xFF);
+					regs.hl = hl;
 					return 8;
 				}
 			case 0x3B: // DEC SP
@@ -1000,18 +1037,18 @@ namespace gb {
 			case 0x3C: // INC A
 				{
 					u16 tmp = static_cast<u16>(regs.a + 1);
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = ((tmp & 0x0F) == 0) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(((tmp & 0x0F) == 0) ? 1 : 0);
 					regs.a = static_cast<u8>(tmp);
 					return 4;
 				}
 			case 0x3D: // DEC A
 				{
 					u8 tmp = regs.a - 1;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((tmp & 0x0F) == 0x0F) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((tmp & 0x0F) == 0x0F) ? 1 : 0);
 					regs.a = tmp;
 					return 4;
 				}
@@ -1023,13 +1060,14 @@ namespace gb {
 				}
 			case 0x3F: // CCF
 				{
-					flags.c = !flags.c;
-					flags.n = flags.h = 0;
+					flags.set_c(!flags.c());
+					flags.set_n(0);
+					flags.set_h(0);
 					return 4;
 				}
 			case 0xC0: // RET NZ
 				{
-					if(!flags.z) {
+					if(!flags.z()) {
 						u8 pc_lo = bus_.read8(regs.sp++);
 						u8 pc_hi = bus_.read8(regs.sp++);
 						u16 pc = static_cast<u16>(pc_lo) | (static_cast<u16>(pc_hi) << 8);
@@ -1052,7 +1090,7 @@ namespace gb {
 					u8 addr_lo = bus_.read8(regs.pc++);
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = static_cast<u16>(addr_lo) | (static_cast<u16>(addr_hi) << 8);
-					if(!flags.z) {
+					if(!flags.z()) {
 						regs.pc = addr;
 						return 16;
 					}
@@ -1072,7 +1110,7 @@ namespace gb {
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = static_cast<u16>(addr_lo) | (static_cast<u16>(addr_hi) << 8);
 
-					if(!flags.z) {
+					if(!flags.z()) {
 						u8 pc_lo = static_cast<u8>(regs.pc & 0xFF);
 						u8 pc_hi = static_cast<u8>(regs.pc >> 8);
 						bus_.write8(--regs.sp, pc_hi);
@@ -1093,10 +1131,10 @@ namespace gb {
 				{
 					u16 imm = static_cast<u16>(bus_.read8(regs.pc++));
 					u16 tmp = static_cast<u16>(regs.a) + imm; 
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = (((regs.a & 0xF) + (imm & 0xF)) > 0xF) ? 1 : 0;
-					flags.c = (tmp > 0xFF) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h((((regs.a & 0xF) + (imm & 0xF)) > 0xF) ? 1 : 0);
+					flags.set_c((tmp > 0xFF) ? 1 : 0);
 					regs.a = static_cast<u8>(tmp & 0xFF);
 					return 8;
 				}
@@ -1113,7 +1151,7 @@ namespace gb {
 				}
 			case 0xC8: // RET Z
 				{
-					if(flags.z) {
+					if(flags.z()) {
 						u8 pc_lo = bus_.read8(regs.sp++);
 						u8 pc_hi = bus_.read8(regs.sp++);
 						regs.pc = (static_cast<u16>(pc_hi) << 8) | static_cast<u16>(pc_lo);
@@ -1133,7 +1171,7 @@ namespace gb {
 					u8 addr_lo = bus_.read8(regs.pc++);
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = addr_lo | (static_cast<u16>(addr_hi) << 8);
-					if(flags.z) {
+					if(flags.z()) {
 						regs.pc = addr;
 						return 16;
 					}
@@ -1148,7 +1186,7 @@ namespace gb {
 					u8 pc_lo = (regs.pc & 0xFF);
 					u8 pc_hi = static_cast<u8>(regs.pc >> 8);
 
-					if(flags.z) {
+					if(flags.z()) {
 						bus_.write8(--regs.sp, pc_hi);
 						bus_.write8(--regs.sp, pc_lo);
 						regs.pc = addr;
@@ -1172,13 +1210,13 @@ namespace gb {
 				}
 			case 0xCE: // ADC A, n8
 				{
-					u8 carry = static_cast<u8>(flags.c);
+					u8 carry = static_cast<u8>(flags.c());
 					u16 imm = static_cast<u16>(bus_.read8(regs.pc++));
 					u16 tmp = static_cast<u16>(regs.a) + imm + carry; 
-					flags.z = ((tmp & 0xFF) == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = (((regs.a & 0xF) + (imm & 0xF) + carry) > 0xF) ? 1 : 0;
-					flags.c = (tmp > 0xFF) ? 1 : 0;
+					flags.set_z(((tmp & 0xFF) == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h((((regs.a & 0xF) + (imm & 0xF) + carry) > 0xF) ? 1 : 0);
+					flags.set_c((tmp > 0xFF) ? 1 : 0);
 					regs.a = static_cast<u8>(tmp & 0xFF);
 					return 8;
 				}
@@ -1195,7 +1233,7 @@ namespace gb {
 				}
 			case 0xD0: // RET NC
 				{
-					if(!flags.c) {
+					if(!flags.c()) {
 						u8 pc_lo = bus_.read8(regs.sp++);
 						u8 pc_hi = bus_.read8(regs.sp++);
 						u16 pc = static_cast<u16>(pc_lo) | (static_cast<u16>(pc_hi) << 8);
@@ -1218,7 +1256,7 @@ namespace gb {
 					u8 addr_lo = bus_.read8(regs.pc++);
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = static_cast<u16>(addr_lo) | (static_cast<u16>(addr_hi) << 8);
-					if(!flags.c) {
+					if(!flags.c()) {
 						regs.pc = addr;
 						return 16;
 					}
@@ -1230,7 +1268,7 @@ namespace gb {
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = static_cast<u16>(addr_lo) | (static_cast<u16>(addr_hi) << 8);
 
-					if(!flags.c) {
+					if(!flags.c()) {
 						u8 pc_lo = static_cast<u8>(regs.pc & 0xFF);
 						u8 pc_hi = static_cast<u8>(regs.pc >> 8);
 						bus_.write8(--regs.sp, pc_hi);
@@ -1251,10 +1289,10 @@ namespace gb {
 				{
 					u8 imm = bus_.read8(regs.pc++);
 					u8 tmp = regs.a - imm;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((regs.a & 0xF) < (imm & 0xF)) ? 1 : 0;
-					flags.c = (regs.a < imm) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((regs.a & 0xF) < (imm & 0xF)) ? 1 : 0);
+					flags.set_c((regs.a < imm) ? 1 : 0);
 					regs.a = tmp;
 					return 8;
 				}
@@ -1271,7 +1309,7 @@ namespace gb {
 				}
 			case 0xD8: // RET C
 				{
-					if(flags.c) {
+					if(flags.c()) {
 						u8 pc_lo = bus_.read8(regs.sp++);
 						u8 pc_hi = bus_.read8(regs.sp++);
 						regs.pc = (static_cast<u16>(pc_hi) << 8) | static_cast<u16>(pc_lo);
@@ -1292,7 +1330,7 @@ namespace gb {
 					u8 addr_lo = bus_.read8(regs.pc++);
 					u8 addr_hi = bus_.read8(regs.pc++);
 					u16 addr = addr_lo | (static_cast<u16>(addr_hi) << 8);
-					if(flags.c) {
+					if(flags.c()) {
 						regs.pc = addr;
 						return 16;
 					}
@@ -1307,7 +1345,7 @@ namespace gb {
 					u8 pc_lo = (regs.pc & 0xFF);
 					u8 pc_hi = static_cast<u8>(regs.pc >> 8);
 
-					if(flags.c) {
+					if(flags.c()) {
 						bus_.write8(--regs.sp, pc_hi);
 						bus_.write8(--regs.sp, pc_lo);
 						regs.pc = addr;
@@ -1318,12 +1356,12 @@ namespace gb {
 			case 0xDE: // SBC A, n8
 				{
 					u8 imm = bus_.read8(regs.pc++);
-					u8 carry = static_cast<u8>(flags.c);
+					u8 carry = static_cast<u8>(flags.c());
 					u8 tmp = regs.a - (imm + carry);
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((regs.a & 0xF) < ((imm & 0xF) + carry)) ? 1 : 0;
-					flags.c = (regs.a < (imm + carry)) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((regs.a & 0xF) < ((imm & 0xF) + carry)) ? 1 : 0);
+					flags.set_c((regs.a < (imm + carry)) ? 1 : 0);
 					regs.a = tmp;
 					return 8;
 				}
@@ -1368,10 +1406,10 @@ namespace gb {
 				{
 					u8 imm = bus_.read8(regs.pc++);
 					regs.a &= imm;
-					flags.z = (regs.a == 0) ? 1 : 0;
-					flags.n = 0;
-					flags.h = 1;
-					flags.c = 0;
+					flags.set_z((regs.a == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(1);
+					flags.set_c(0);
 					return 8;
 				}
 			case 0xE7: // RST $20
@@ -1389,16 +1427,17 @@ namespace gb {
 				{
 					s8 offset = static_cast<s8>(bus_.read8(regs.pc++));
 					u16 temp = regs.sp + offset;
-					flags.z = flags.n = 0;
+					flags.set_z(0);
+					flags.set_n(0);
 					u8 imm = static_cast<u8>(offset);
-					flags.h = (((regs.sp & 0xF) + (imm & 0xF)) > 0xF);
-					flags.c = (((regs.sp & 0xFF) + imm) > 0xFF);
+					flags.set_h((((regs.sp & 0xF) + (imm & 0xF)) > 0xF));
+					flags.set_c((((regs.sp & 0xFF) + imm) > 0xFF));
 					regs.sp = temp;
 					return 16;
 				}
 			case 0xE9: // JP HL
 				{
-					u16 hl = static_cast<u16>(regs.l) | (static_cast<u16>(regs.h) << 8);
+					u16 hl = regs.hl;
 					regs.pc = hl;
 					return 4;
 				}
@@ -1414,8 +1453,10 @@ namespace gb {
 				{
 					u8 imm = bus_.read8(regs.pc++);
 					regs.a ^= imm;
-					flags.z = (regs.a == 0) ? 1 : 0;
-					flags.n = flags.h = flags.c = 0;
+					flags.set_z((regs.a == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(0);
+					flags.set_c(0);
 					return 8;
 				}
 			case 0xEF: // RST $28
@@ -1439,10 +1480,7 @@ namespace gb {
 				{
 					u8 f = bus_.read8(regs.sp++);
 					u8 a = bus_.read8(regs.sp++);
-					flags.z = static_cast<bool>((f & 0x80) >> 7);
-					flags.n = static_cast<bool>((f & 0x40) >> 6);
-					flags.h = static_cast<bool>((f & 0x20) >> 5); 
-					flags.c = static_cast<bool>((f & 0x10) >> 4); 
+					flags.set(f);
 					regs.a = a;
 					return 12;
 				}
@@ -1460,19 +1498,17 @@ namespace gb {
 			case 0xF5: // PUSH AF
 				{
 					bus_.write8(--regs.sp, regs.a);
-					u8 regf = (static_cast<u8>(flags.z) << 7) |
-						(static_cast<u8>(flags.n) << 6) |
-						(static_cast<u8>(flags.h) << 5) |
-						(static_cast<u8>(flags.c) << 4);
-					bus_.write8(--regs.sp, regf);
+					bus_.write8(--regs.sp, flags.get());
 					return 16;
 				}
 			case 0xF6: // OR A, n8
 				{
 					u8 imm = bus_.read8(regs.pc++);
 					regs.a |= imm;
-					flags.z = (regs.a == 0) ? 1 : 0;
-					flags.n = flags.h = flags.c = 0;
+					flags.set_z((regs.a == 0) ? 1 : 0);
+					flags.set_n(0);
+					flags.set_h(0);
+					flags.set_c(0);
 					return 8;
 				}
 			case 0xF7: // RST $30
@@ -1490,17 +1526,17 @@ namespace gb {
 				{
 					s8 offset = static_cast<s8>(bus_.read8(regs.pc++));
 					u16 temp = regs.sp + offset;
-					regs.h = static_cast<u8>(temp >> 8);
-					regs.l = static_cast<u8>(temp & 0x00FF);
-					flags.z = flags.n = 0;
+					regs.hl = temp;
+					flags.set_z(0);
+					flags.set_n(0);
 					u8 imm = static_cast<u8>(offset);
-					flags.h = (((regs.sp & 0xF) + (imm & 0xF)) > 0xF);
-					flags.c = (((regs.sp & 0xFF) + imm) > 0xFF);
+					flags.set_h((((regs.sp & 0xF) + (imm & 0xF)) > 0xF));
+					flags.set_c((((regs.sp & 0xFF) + imm) > 0xFF));
 					return 12;
 				}
 			case 0xF9: // LD SP, HL
 				{
-					u16 hl = regs.l | (static_cast<u16>(regs.h) << 8);
+					u16 hl = regs.hl;
 					regs.sp = hl;
 					return 8;
 				}
@@ -1522,10 +1558,10 @@ namespace gb {
 				{
 					u8 imm = bus_.read8(regs.pc++);
 					u8 tmp = regs.a - imm;
-					flags.z = (tmp == 0) ? 1 : 0;
-					flags.n = 1;
-					flags.h = ((regs.a & 0xF) < (imm & 0xF)) ? 1 : 0;
-					flags.c = (regs.a < imm) ? 1 : 0;
+					flags.set_z((tmp == 0) ? 1 : 0);
+					flags.set_n(1);
+					flags.set_h(((regs.a & 0xF) < (imm & 0xF)) ? 1 : 0);
+					flags.set_c((regs.a < imm) ? 1 : 0);
 					return 8;
 				}
 			case 0xFF: // RST $38
@@ -0,0 +1,410 @@
+#include "gb/cpu.hpp"
+#include "gb/bus.hpp"
+
+#include <algorithm>
+
+namespace gb {
+	namespace {
+		struct OpInfo {
+			u8 length;      // 0: not cacheable (STOP, unused slots)
+			bool ends_block;
+		};
+
+		constexpr OpInfo op_info(u8 op) {
+			switch(op) {
+				case 0x10: // STOP
+				case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4:
+				case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+					return {0, true};
+				case 0x76: // HALT
+				case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET
+				case 0xE9: // JP HL
+					return {1, true};
+				case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+					return {2, true};
+				case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP
+				case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+					return {3, true};
+				case 0x01: case 0x11: case 0x21: case 0x31: // LD r16, n16
+				case 0x08: case 0xEA: case 0xFA:
+					return {3, false};
+				case 0xCB:
+				case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, n8
+				case 0xE0: case 0xF0: case 0xE8: case 0xF8:
+					return {2, false};
+			}
+			if((op & 0xC7) == 0x06) return {2, false}; // LD r8, n8
+			if((op & 0xC7) == 0xC7) return {1, true};  // RST
+			return {1, false};
+		}
+
+		template<std::size_t... I>
+		constexpr std::array<OpInfo, 256> make_op_info(std::index_sequence<I...>) {
+			return {{ op_info(static_cast<u8>(I))... }};
+		}
+
+		constexpr std::array<OpInfo, 256> OP_INFO = make_op_info(std::make_index_sequence<256>{});
+
+		constexpr u8 JIT_THRESHOLD = 8; // executions before a block is translated
+
+		// Register masks for the idle-loop check: bits 0-7 follow the r8
+		// encoding (B, C, D, E, H, L, -, A), bits 8-11 are the Z/N/H/C flags
+		constexpr u16 R_BC = 0x03, R_DE = 0x0C, R_HL = 0x30, R_A = 0x80;
+		constexpr u16 F_Z = 0x100, F_N = 0x200, F_H = 0x400, F_C = 0x800, F_ALL = 0xF00;
+
+		constexpr u16 r8_mask(u8 r) { return (r == 6) ? R_HL : static_cast<u16>(1 << r); }
+
+		struct LoopOp {
+			bool ok; // no side effects besides registers/flags
+			u16 reads;
+			u16 writes;
+		};
+
+		// Instructions allowed in a polling loop
+		constexpr LoopOp loop_op(u8 op, u16 imm) {
+			if(op == 0x00) return {true, 0, 0}; // NOP
+			if((op & 0xC0) == 0x40 && op != 0x76) { // LD r8, r8 / LD r8, [HL]
+				u8 dst = (op >> 3) & 0x07;
+				if(dst == 6) return {false, 0, 0};
+				return {true, r8_mask(op & 0x07), r8_mask(dst)};
+			}
+			if(op == 0x0A) return {true, R_BC, R_A}; // LD A, [BC]
+			if(op == 0x1A) return {true, R_DE, R_A}; // LD A, [DE]
+			if(op == 0xF0 || op == 0xFA) return {true, 0, R_A}; // LDH A, [a8] / LD A, [a16]
+			if(op == 0xF2) return {true, 0x02, R_A}; // LDH A, [C]
+			if((op & 0xC0) == 0x80 || (op & 0xC7) == 0xC6) { // ALU A, r8 / n8
+				u8 alu = (op >> 3) & 0x07;
+				u16 reads = R_A | (((op & 0xC0) == 0x80) ? r8_mask(op & 0x07) : 0);
+				if(alu == 1 || alu == 3) reads |= F_C;
+				return {true, reads, static_cast<u16>(F_ALL | ((alu == 7) ? 0 : R_A))};
+			}
+			if((op & 0xC6) == 0x04) { // INC r8 / DEC r8
+				u8 r = (op >> 3) & 0x07;
+				if(r == 6) return {false, 0, 0};
+				return {true, r8_mask(r), static_cast<u16>(r8_mask(r) | F_Z | F_N | F_H)};
+			}
+			if(op == 0xCB && (imm & 0xC0) == 0x40) return {true, r8_mask(imm & 0x07), F_Z | F_N | F_H}; // BIT
+			if(op == 0x18 || op == 0xC3) return {true, 0, 0}; // JR / JP
+			if((op & 0xE7) == 0x20 || (op & 0xE7) == 0xC2) return {true, (op & 0x10) ? F_C : F_Z, 0}; // JR cc / JP cc
+			return {false, 0, 0};
+		}
+	}
+
+	int CPU::run(int budget) {
+		bus_.poll_input();
+		bus_.poll_save();
+
+		int elapsed = 0;
+		while(elapsed < budget) {
+			int cycles;
+			if(halted_ && (bus_.read8(0xFF0F) & bus_.read8(0xFFFF)) == 0) {
+				cycles = skip_halt(budget - elapsed);
+			}
+			else if(decoder_ == Decoder::Cached || decoder_ == Decoder::Jit) {
+				cycles = run_block(budget - elapsed);
+			}
+			else {
+				cycles = step();
+				bus_.tick(cycles);
+			}
+			if(cycles == 0) return 0;
+			elapsed += cycles;
+		}
+		return elapsed;
+	}
+
+	int CPU::run_block(int budget) {
+		// 1. Interrupt entry, HALT and the HALT bug take the regular path
+		if(halted_ || halt_bug || (ime_ && bus_.pending_interrupts())) {
+			int cycles = step();
+			bus_.tick(cycles);
+			return cycles;
+		}
+
+		// 2. Code that is not cacheable (VRAM, I/O, STOP) is stepped as well
+		Block* block = find_block(regs.pc);
+		if(!block) {
+			int cycles = step();
+			bus_.tick(cycles);
+			return cycles;
+		}
+
+		// 3. Hot ROM blocks run natively, chained from one to the next; none
+		//    runs past the next PPU/timer event, so batching ticks is invisible
+		bool native = decoder_ == Decoder::Jit && !block->ram;
+		if constexpr (GBEMU_PROFILE) native = native && !profile_ && !guest_;
+		if(native) {
+			if(!block->jit && block->hits < JIT_THRESHOLD && ++block->hits == JIT_THRESHOLD) compile_block(*block);
+			if(block->jit) {
+				int horizon = bus_.cycles_to_event();
+				int cycles = run_jit(*block, budget);
+				if(block->idle && regs.pc == (block->key & 0xFFFF) && cycles < horizon) cycles += skip_idle_loop(*block, cycles, budget - cycles);
+				return cycles;
+			}
+		}
+
+		// 4. Execute the block, still ticking the bus after every instruction so
+		//    peripherals see exactly the same timing as with step()
+		u32 epoch = bus_.code_epoch();
+		int horizon = bus_.cycles_to_event();
+		int elapsed = 0;
+		int executed = 0;
+		u16 pc = regs.pc;
+
+		// GBEMU_PROFILE: the guest sample countdown only moves when a sample
+		// is due and once after the pass
+		int guest_due = guest_countdown_;
+		int guest_told = 0;
+
+		for(int i = 0; i < block->count; i++) {
+			const MicroOp& op = block->ops[i];
+			pc = regs.pc;
+			regs.pc += op.length;
+			imm_ = op.imm;
+			int cycles;
+			if constexpr (GBEMU_PROFILE) cycles = profile_ ? profile_op(op.opcode, static_cast<u8>(op.imm), [&] { return op.fn(*this); }) : op.fn(*this);
+			else cycles = op.fn(*this);
+			bus_.tick(cycles);
+			elapsed += cycles;
+			executed++;
+			if constexpr (GBEMU_PROFILE) {
+				if(elapsed >= guest_due) {
+					guest_cycles(pc, elapsed - guest_told);
+					guest_told = elapsed;
+					guest_due = elapsed + guest_countdown_;
+				}
+			}
+
+			// Leave at the next instruction boundary when an interrupt becomes
+			// serviceable or the code we are running may have been overwritten
+			if(elapsed >= budget) break;
+			if(ime_ && bus_.pending_interrupts()) break;
+			if(bus_.code_epoch() != epoch) break;
+		}
+		instructions_ += executed;
+		if constexpr (GBEMU_PROFILE) {
+			guest_countdown_ -= elapsed - guest_told; // short of guest_due: no sample
+			if(block->calls && guest_ && executed == block->count) guest_stack(pc, block->ops[block->count - 1].opcode);
+		}
+
+		// 5. A polling loop that came back to its top can skip ahead, provided
+		//    no event fired during this pass (its reads may already be stale)
+		if(block->idle && regs.pc == (block->key & 0xFFFF) && bus_.code_epoch() == epoch && elapsed < horizon) {
+			elapsed += skip_idle_loop(*block, elapsed, budget - elapsed);
+		}
+		return elapsed;
+	}
+
+	int CPU::skip_halt(int budget) {
+		// Nothing can wake us before the next event: jump to the HALT step that
+		// reaches it, exactly where step() would have got in 4-cycle slices
+		int to_event = bus_.cycles_to_event();
+		if(to_event > budget) to_event = budget;
+		int cycles = ((to_event + 3) / 4) * 4;
+		if(cycles == 0) cycles = 4;
+		bus_.tick(cycles);
+		if constexpr (GBEMU_PROFILE) {
+			if(profile_) profile_->record_halt(cycles);
+			guest_cycles(regs.pc, cycles, GuestProfiler::Leaf::Halt);
+		}
+		return cycles;
+	}
+
+	int CPU::skip_idle_loop(const Block& block, int cycles, int budget) {
+		// Every further pass reads the same values until the next event, so
+		// skip the whole passes that end no later than it and fit the budget
+		if(ime_ && bus_.pending_interrupts()) return 0;
+		if(idle_reads_timer(block)) return 0;
+
+		int limit = bus_.cycles_to_event();
+		if(limit > budget) limit = budget;
+		int passes = limit / cycles;
+		if(passes > 0) bus_.tick(passes * cycles);
+		instructions_ += static_cast<u64>(passes) * block.count;
+		if constexpr (GBEMU_PROFILE) {
+			if(profile_) profile_->record_idle(passes * cycles, static_cast<u64>(passes) * block.count);
+			if(passes > 0) guest_cycles(regs.pc, passes * cycles, GuestProfiler::Leaf::Idle);
+		}
+		return passes * cycles;
+	}
+
+	bool CPU::idle_reads_timer(const Block& block) {
+		// DIV/TIMA count between events, so loops polling them must really run
+		for(int i = 0; i < block.count; i++) {
+			const MicroOp& op = block.ops[i];
+			u16 addr;
+			if(op.opcode == 0xF0) addr = 0xFF00 | (op.imm & 0xFF);
+			else if(op.opcode == 0xFA) addr = op.imm;
+			else if(op.opcode == 0xF2) addr = 0xFF00 | regs.c;
+			else if(op.opcode == 0x0A) addr = regs.bc;
+			else if(op.opcode == 0x1A) addr = regs.de;
+			else if((op.opcode & 0xC7) == 0x46 || (op.opcode & 0xC7) == 0x86 ||
+					op.opcode == 0xCB) addr = regs.hl; // [HL] operands (BIT: any r8, harmless)
+			else continue;
+			if(addr >= 0xFF04 && addr <= 0xFF07) return true;
+		}
+		return false;
+	}
+
+	bool CPU::is_idle_loop(const Block& block, u16 pc) {
+		if(block.count == 0) return false;
+
+		// 1. Last instruction branches back to the first one
+		u16 last_pc = pc;
+		for(int i = 0; i < block.count - 1; i++) last_pc = static_cast<u16>(last_pc + block.ops[i].length);
+		const MicroOp& last = block.ops[block.count - 1];
+		u16 target;
+		if(last.opcode == 0x18 || (last.opcode & 0xE7) == 0x20) target = static_cast<u16>(last_pc + 2 + static_cast<s8>(last.imm & 0xFF));
+		else if(last.opcode == 0xC3 || (last.opcode & 0xE7) == 0xC2) target = last.imm;
+		else return false;
+		if(target != pc) return false;
+
+		// 2. Only side-effect-free instructions
+		u16 written = 0;
+		for(int i = 0; i < block.count; i++) {
+			LoopOp info = loop_op(block.ops[i].opcode, block.ops[i].imm);
+			if(!info.ok) return false;
+			written |= info.writes;
+		}
+
+		// 3. Nothing carried between passes: a register the body changes must be
+		//    written before it is read, so every pass computes the same state
+		u16 defined = 0;
+		for(int i = 0; i < block.count; i++) {
+			LoopOp info = loop_op(block.ops[i].opcode, block.ops[i].imm);
+			if(info.reads & written & ~defined) return false;
+			defined |= info.writes;
+		}
+		return true;
+	}
+
+	CPU::Block* CPU::find_block(u16 pc) {
+		u32 key = bus_.code_key(pc);
+		if(key == Bus::NO_CODE) return nullptr;
+
+		Block*& slot = block_lookup_[pc & (block_lookup_.size() - 1)];
+		if(!slot || slot->key != key) {
+			slot = &blocks_[key];
+			if(slot->key != key || slot->count == 0) decode_block(*slot, pc, key);
+		}
+		if(slot->ram && slot->gen != bus_.code_gen()) decode_block(*slot, pc, key);
+		return (slot->count > 0) ? slot : nullptr;
+	}
+
+	void CPU::decode_block(Block& block, u16 pc, u32 key) {
+		u32 bank = key & 0xFFFF0000;
+		u16 addr = pc;
+
+		block.key = key;
+		block.ram = (pc >= 0x8000);
+		block.count = 0;
+		block.jit = nullptr;
+		block.hits = 0;
+
+		while(block.count < Block::MAX_OPS) {
+			// Every byte of the instruction must come from the same bank/region
+			u8 opcode = bus_.read8(addr);
+			const OpInfo& info = OP_INFO[opcode];
+			if(info.length == 0) break;
+
+			bool mapped = true;
+			for(u8 i = 0; i < info.length; i++) {
+				u16 byte_addr = static_cast<u16>(addr + i);
+				if(byte_addr < addr || bus_.code_key(byte_addr) != (bank | byte_addr)) mapped = false;
+			}
+			if(!mapped) break;
+
+			MicroOp& op = block.ops[block.count++];
+			op.length = info.length;
+			op.opcode = opcode;
+			op.imm = 0;
+			if(opcode == 0xCB) {
+				op.imm = bus_.read8(addr + 1);
+				op.fn = cb_table_[op.imm];
+			}
+			else {
+				op.fn = block_table_[opcode];
+				if(info.length >= 2) op.imm = bus_.read8(addr + 1);
+				if(info.length == 3) op.imm |= static_cast<u16>(bus_.read8(addr + 2)) << 8;
+			}
+			addr += info.length;
+
+			if(info.ends_block) break;
+		}
+
+		block.idle = is_idle_loop(block, pc);
+		block.calls = block.count > 0 && (GuestProfiler::is_call(block.ops[block.count - 1].opcode) ||
+				GuestProfiler::is_ret(block.ops[block.count - 1].opcode));
+		if(block.ram && block.count > 0) bus_.mark_code(pc, addr);
+		block.gen = bus_.code_gen();
+	}
+
+	void CPU::compile_block(Block& block) {
+		if(!jit_) jit_ = std::make_unique<Jit>(bus_);
+		if(!jit_->available()) return;
+
+		std::array<JitInsn, Block::MAX_OPS> insns;
+		for(int i = 0; i < block.count; i++) {
+			insns[i] = {block.ops[i].opcode, block.ops[i].length, block.ops[i].imm};
+		}
+		u16 pc = static_cast<u16>(block.key & 0xFFFF);
+		block.jit = jit_->compile(insns.data(), block.count, pc);
+
+		// Code buffer exhausted: drop every translation and start over
+		if(!block.jit && jit_->full()) {
+			jit_->reset();
+			for(auto& entry : blocks_) {
+				entry.second.jit = nullptr;
+				entry.second.hits = 0;
+			}
+			block.jit = jit_->compile(insns.data(), block.count, pc);
+		}
+	}
+
+	int CPU::run_jit(Block& block, int budget) {
+		JitContext& ctx = jit_->context();
+		ctx.pc = regs.pc;
+		ctx.sp = regs.sp;
+		ctx.a = regs.a;
+		ctx.bc = regs.bc;
+		ctx.de = regs.de;
+		ctx.hl = regs.hl;
+		ctx.f = flags.get();
+		ctx.ime = ime_;
+
+		// Each pass stops at the budget or the next PPU/timer event, whichever
+		// comes first: the one instruction boundary where the interpreter could
+		// notice a change besides those the helpers report through ctx.exit
+		int elapsed = 0;
+		for(const Block* next = &block;;) {
+			ctx.exit = 0;
+			ctx.ticked = 0;
+			ctx.limit = static_cast<u32>(std::min(budget - elapsed, bus_.cycles_to_event()));
+			ctx.epoch = bus_.code_epoch();
+			next->jit(&ctx);
+
+			// Helpers already ticked up to their access; feed the rest
+			bus_.tick(static_cast<int>(ctx.cycles - ctx.ticked));
+			elapsed += static_cast<int>(ctx.cycles);
+			instructions_ += ctx.insns;
+
+			// Chain into the next translated block with the guest state still
+			// in ctx, unless a helper asked to stop, the budget is spent, an
+			// event made an interrupt serviceable or an idle loop (skipped by
+			// run_block) is involved
+			if(ctx.exit || elapsed >= budget || next->idle) break;
+			if(ime_ && bus_.pending_interrupts()) break;
+			next = find_block(ctx.pc);
+			if(!next || next->ram || !next->jit || next->idle) break;
+		}
+
+		regs.pc = ctx.pc;
+		regs.sp = ctx.sp;
+		regs.a = ctx.a;
+		regs.bc = ctx.bc;
+		regs.de = ctx.de;
+		regs.hl = ctx.hl;
+		flags.set(ctx.f);
+		return elapsed;
+	}
+}
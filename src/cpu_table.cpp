@@ -0,0 +1,504 @@
+#include "gb/cpu.hpp"
+#include "gb/bus.hpp"
+
+#include <iostream>
+#include <utility>
+
+namespace gb {
+	/*
+	 * Table-driven decoder.
+	 * Every opcode gets its own handler instantiated from op<OP, Src>/op_cb<OP>,
+	 * so register operands and condition codes are resolved at compile time
+	 * and CPU::step() only pays for a single indirect call.
+	 * Src selects where immediate operands come from, which lets the block
+	 * cache (cpu_block.cpp) reuse the same handlers on pre-decoded code.
+	 */
+	struct CPUOps {
+		// Operand encoding in opcode bits: B, C, D, E, H, L, [HL], A
+		static constexpr u8 HL_IND = 6;
+
+		// Operand sources: read from the bus at PC, or taken from the operand
+		// pre-decoded into a micro-op (PC has already been advanced by then)
+		struct BusOperand {
+			static u8 fetch8(CPU& cpu) {
+				return cpu.bus_.read8(cpu.regs.pc++);
+			}
+
+			static u16 fetch16(CPU& cpu) {
+				u8 lo = fetch8(cpu);
+				u8 hi = fetch8(cpu);
+				return static_cast<u16>(lo) | (static_cast<u16>(hi) << 8);
+			}
+		};
+
+		struct BlockOperand {
+			static u8 fetch8(CPU& cpu) {
+				return static_cast<u8>(cpu.imm_ & 0xFF);
+			}
+
+			static u16 fetch16(CPU& cpu) {
+				return cpu.imm_;
+			}
+		};
+
+		static void push16(CPU& cpu, u16 value) {
+			cpu.bus_.write8(--cpu.regs.sp, static_cast<u8>(value >> 8));
+			cpu.bus_.write8(--cpu.regs.sp, static_cast<u8>(value & 0xFF));
+		}
+
+		static u16 pop16(CPU& cpu) {
+			u8 lo = cpu.bus_.read8(cpu.regs.sp++);
+			u8 hi = cpu.bus_.read8(cpu.regs.sp++);
+			return static_cast<u16>(lo) | (static_cast<u16>(hi) << 8);
+		}
+
+		static u16 hl(CPU& cpu) {
+			return cpu.regs.hl;
+		}
+
+		static void set_hl(CPU& cpu, u16 value) {
+			cpu.regs.hl = value;
+		}
+
+		template<u8 R>
+		static u8 get_r8(CPU& cpu) {
+			if constexpr (R == 0) return cpu.regs.b;
+			else if constexpr (R == 1) return cpu.regs.c;
+			else if constexpr (R == 2) return cpu.regs.d;
+			else if constexpr (R == 3) return cpu.regs.e;
+			else if constexpr (R == 4) return cpu.regs.h;
+			else if constexpr (R == 5) return cpu.regs.l;
+			else if constexpr (R == HL_IND) return cpu.bus_.read8(hl(cpu));
+			else return cpu.regs.a;
+		}
+
+		template<u8 R>
+		static void set_r8(CPU& cpu, u8 value) {
+			if constexpr (R == 0) cpu.regs.b = value;
+			else if constexpr (R == 1) cpu.regs.c = value;
+			else if constexpr (R == 2) cpu.regs.d = value;
+			else if constexpr (R == 3) cpu.regs.e = value;
+			else if constexpr (R == 4) cpu.regs.h = value;
+			else if constexpr (R == 5) cpu.regs.l = value;
+			else if constexpr (R == HL_IND) cpu.bus_.write8(hl(cpu), value);
+			else cpu.regs.a = value;
+		}
+
+		// 16-bit operand encoding in opcode bits [5:4]: BC, DE, HL, SP
+		template<u8 RR>
+		static u16 get_r16(CPU& cpu) {
+			if constexpr (RR == 0) return cpu.regs.bc;
+			else if constexpr (RR == 1) return cpu.regs.de;
+			else if constexpr (RR == 2) return cpu.regs.hl;
+			else return cpu.regs.sp;
+		}
+
+		template<u8 RR>
+		static void set_r16(CPU& cpu, u16 value) {
+			if constexpr (RR == 0) cpu.regs.bc = value;
+			else if constexpr (RR == 1) cpu.regs.de = value;
+			else if constexpr (RR == 2) cpu.regs.hl = value;
+			else cpu.regs.sp = value;
+		}
+
+		// Condition encoding in opcode bits [4:3]: NZ, Z, NC, C
+		template<u8 CC>
+		static bool cond(CPU& cpu) {
+			if constexpr (CC == 0) return !cpu.flags.z();
+			else if constexpr (CC == 1) return cpu.flags.z();
+			else if constexpr (CC == 2) return !cpu.flags.c();
+			else return cpu.flags.c();
+		}
+
+		// ALU encoding in opcode bits [5:3]: ADD, ADC, SUB, SBC, AND, XOR, OR, CP
+		// Flags are only recorded here (see Flags::defer_*)
+		template<u8 ALU>
+		static void alu8(CPU& cpu, u8 value) {
+			Registers& r = cpu.regs;
+			Flags& f = cpu.flags;
+			if constexpr (ALU == 0 || ALU == 1) { // ADD, ADC
+				u8 carry = (ALU == 1 && f.c()) ? 1 : 0;
+				f.defer_add(r.a, value, carry);
+				r.a = static_cast<u8>(r.a + value + carry);
+			}
+			else if constexpr (ALU == 2 || ALU == 3 || ALU == 7) { // SUB, SBC, CP
+				u8 carry = (ALU == 3 && f.c()) ? 1 : 0;
+				f.defer_sub(r.a, value, carry);
+				if constexpr (ALU != 7) r.a = static_cast<u8>(r.a - value - carry);
+			}
+			else { // AND, XOR, OR
+				if constexpr (ALU == 4) r.a &= value;
+				else if constexpr (ALU == 5) r.a ^= value;
+				else r.a |= value;
+				if constexpr (ALU == 4) f.defer_and(r.a);
+				else f.defer_or(r.a);
+			}
+		}
+
+		// CB rotate/shift encoding in opcode bits [5:3]: RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+		template<u8 ROT>
+		static u8 rot8(CPU& cpu, u8 value) {
+			Flags& f = cpu.flags;
+			bool carry;
+			if constexpr (ROT == 0) { carry = value & 0x80; value = static_cast<u8>((value << 1) | (value >> 7)); }
+			else if constexpr (ROT == 1) { carry = value & 0x01; value = static_cast<u8>((value >> 1) | (value << 7)); }
+			else if constexpr (ROT == 2) { carry = value & 0x80; value = static_cast<u8>((value << 1) | (f.c() ? 1 : 0)); }
+			else if constexpr (ROT == 3) { carry = value & 0x01; value = static_cast<u8>((value >> 1) | (f.c() ? 0x80 : 0)); }
+			else if constexpr (ROT == 4) { carry = value & 0x80; value = static_cast<u8>(value << 1); }
+			else if constexpr (ROT == 5) { carry = value & 0x01; value = static_cast<u8>((value >> 1) | (value & 0x80)); }
+			else if constexpr (ROT == 6) { carry = false; value = static_cast<u8>((value << 4) | (value >> 4)); }
+			else { carry = value & 0x01; value = static_cast<u8>(value >> 1); }
+			f.set(((value == 0) ? Flags::Z : 0) | (carry ? Flags::C : 0));
+			return value;
+		}
+
+		static int unimplemented(CPU& cpu, u8 opcode) {
+			std::cout << "unimplemented opcode detected @pc=" << cpu.regs.pc << ", opcode=0x" << std::hex << static_cast<int>(opcode) << std::endl;
+			return 0;
+		}
+
+		template<u8 OP, class Src>
+		static int op(CPU& cpu) {
+			Registers& r = cpu.regs;
+			Flags& f = cpu.flags;
+			Bus& bus = cpu.bus_;
+
+			if constexpr (OP == 0x00) { // NOP
+				return 4;
+			}
+			else if constexpr (OP == 0x76) { // HALT
+				return cpu.halt();
+			}
+			else if constexpr ((OP & 0xC0) == 0x40) { // LD r8, r8
+				constexpr u8 dst = (OP >> 3) & 0x07;
+				constexpr u8 src = OP & 0x07;
+				set_r8<dst>(cpu, get_r8<src>(cpu));
+				return (src == HL_IND || dst == HL_IND) ? 8 : 4;
+			}
+			else if constexpr ((OP & 0xC0) == 0x80) { // ALU A, r8
+				constexpr u8 src = OP & 0x07;
+				alu8<(OP >> 3) & 0x07>(cpu, get_r8<src>(cpu));
+				return (src == HL_IND) ? 8 : 4;
+			}
+			else if constexpr ((OP & 0xC7) == 0xC6) { // ALU A, n8
+				alu8<(OP >> 3) & 0x07>(cpu, Src::fetch8(cpu));
+				return 8;
+			}
+			else if constexpr (OP == 0xCB) { // CB prefix
+				u8 cb = Src::fetch8(cpu);
+				return CPU::cb_table_[cb](cpu);
+			}
+			else if constexpr ((OP & 0xCF) == 0x01) { // LD r16, n16
+				set_r16<(OP >> 4) & 0x03>(cpu, Src::fetch16(cpu));
+				return 12;
+			}
+			else if constexpr ((OP & 0xCF) == 0x03) { // INC r16
+				constexpr u8 rr = (OP >> 4) & 0x03;
+				set_r16<rr>(cpu, static_cast<u16>(get_r16<rr>(cpu) + 1));
+				return 8;
+			}
+			else if constexpr ((OP & 0xCF) == 0x0B) { // DEC r16
+				constexpr u8 rr = (OP >> 4) & 0x03;
+				set_r16<rr>(cpu, static_cast<u16>(get_r16<rr>(cpu) - 1));
+				return 8;
+			}
+			else if constexpr ((OP & 0xCF) == 0x09) { // ADD HL, r16
+				u16 hl_val = hl(cpu);
+				u16 rr_val = get_r16<(OP >> 4) & 0x03>(cpu);
+				u32 tmp = hl_val + rr_val;
+				u8 flags = f.get() & Flags::Z;
+				if((hl_val & 0x0FFF) + (rr_val & 0x0FFF) > 0x0FFF) flags |= Flags::H;
+				if(tmp > 0xFFFF) flags |= Flags::C;
+				f.set(flags);
+				set_hl(cpu, static_cast<u16>(tmp & 0xFFFF));
+				return 8;
+			}
+			else if constexpr ((OP & 0xC7) == 0x04) { // INC r8
+				constexpr u8 dst = (OP >> 3) & 0x07;
+				u8 tmp = static_cast<u8>(get_r8<dst>(cpu) + 1);
+				f.defer_inc(tmp);
+				set_r8<dst>(cpu, tmp);
+				return (dst == HL_IND) ? 12 : 4;
+			}
+			else if constexpr ((OP & 0xC7) == 0x05) { // DEC r8
+				constexpr u8 dst = (OP >> 3) & 0x07;
+				u8 tmp = static_cast<u8>(get_r8<dst>(cpu) - 1);
+				f.defer_dec(tmp);
+				set_r8<dst>(cpu, tmp);
+				return (dst == HL_IND) ? 12 : 4;
+			}
+			else if constexpr ((OP & 0xC7) == 0x06) { // LD r8, n8
+				constexpr u8 dst = (OP >> 3) & 0x07;
+				if constexpr (dst == HL_IND) {
+					u16 addr = hl(cpu);
+					bus.write8(addr, Src::fetch8(cpu));
+					return 12;
+				}
+				else {
+					set_r8<dst>(cpu, Src::fetch8(cpu));
+					return 8;
+				}
+			}
+			else if constexpr (OP == 0x02 || OP == 0x12) { // LD [BC], A / LD [DE], A
+				bus.write8(get_r16<(OP >> 4) & 0x03>(cpu), r.a);
+				return 8;
+			}
+			else if constexpr (OP == 0x0A || OP == 0x1A) { // LD A, [BC] / LD A, [DE]
+				r.a = bus.read8(get_r16<(OP >> 4) & 0x03>(cpu));
+				return 8;
+			}
+			else if constexpr (OP == 0x22 || OP == 0x32) { // LD [HL+], A / LD [HL-], A
+				u16 addr = hl(cpu);
+				bus.write8(addr, r.a);
+				set_hl(cpu, (OP == 0x22) ? addr + 1 : addr - 1);
+				return 8;
+			}
+			else if constexpr (OP == 0x2A || OP == 0x3A) { // LD A, [HL+] / LD A, [HL-]
+				u16 addr = hl(cpu);
+				r.a = bus.read8(addr);
+				set_hl(cpu, (OP == 0x2A) ? addr + 1 : addr - 1);
+				return 8;
+			}
+			else if constexpr (OP == 0x07) { // RLCA
+				u8 hi = (r.a & 0x80) >> 7;
+				r.a = static_cast<u8>((r.a << 1) | hi);
+				f.set(hi ? Flags::C : 0);
+				return 4;
+			}
+			else if constexpr (OP == 0x0F) { // RRCA
+				u8 lo = r.a & 0x01;
+				r.a = static_cast<u8>((r.a >> 1) | (lo << 7));
+				f.set(lo ? Flags::C : 0);
+				return 4;
+			}
+			else if constexpr (OP == 0x17) { // RLA
+				u8 hi = (r.a & 0x80) >> 7;
+				r.a = static_cast<u8>((r.a << 1) | (f.c() ? 1 : 0));
+				f.set(hi ? Flags::C : 0);
+				return 4;
+			}
+			else if constexpr (OP == 0x1F) { // RRA
+				u8 lo = r.a & 0x01;
+				r.a = static_cast<u8>((r.a >> 1) | (f.c() ? 0x80 : 0));
+				f.set(lo ? Flags::C : 0);
+				return 4;
+			}
+			else if constexpr (OP == 0x08) { // LD [a16], SP
+				u16 addr = Src::fetch16(cpu);
+				bus.write8(addr, static_cast<u8>(r.sp & 0xFF));
+				bus.write8(addr + 1, static_cast<u8>(r.sp >> 8));
+				return 20;
+			}
+			else if constexpr (OP == 0x18) { // JR e8
+				s8 offset = static_cast<s8>(Src::fetch8(cpu));
+				r.pc = static_cast<u16>(r.pc + offset);
+				return 12;
+			}
+			else if constexpr ((OP & 0xE7) == 0x20) { // JR cc, e8
+				s8 offset = static_cast<s8>(Src::fetch8(cpu));
+				if(cond<(OP >> 3) & 0x03>(cpu)) {
+					r.pc = static_cast<u16>(r.pc + offset);
+					return 12;
+				}
+				return 8;
+			}
+			else if constexpr (OP == 0x27) { // DAA
+				u8 flags = f.get();
+				u8 adj = 0;
+				if(!(flags & Flags::N)) {
+					if((flags & Flags::H) || ((r.a & 0xF) > 0x9)) adj += 0x6;
+					if((flags & Flags::C) || (r.a > 0x99)) {
+						adj += 0x60;
+						flags |= Flags::C;
+					}
+					r.a += adj;
+				}
+				else {
+					if(flags & Flags::H) adj += 0x6;
+					if(flags & Flags::C) adj += 0x60;
+					r.a -= adj;
+				}
+				flags &= Flags::N | Flags::C;
+				if(r.a == 0) flags |= Flags::Z;
+				f.set(flags);
+				return 4;
+			}
+			else if constexpr (OP == 0x2F) { // CPL
+				r.a = ~r.a;
+				f.set(f.get() | Flags::N | Flags::H);
+				return 4;
+			}
+			else if constexpr (OP == 0x37) { // SCF
+				f.set((f.get() & Flags::Z) | Flags::C);
+				return 4;
+			}
+			else if constexpr (OP == 0x3F) { // CCF
+				f.set((f.get() & (Flags::Z | Flags::C)) ^ Flags::C);
+				return 4;
+			}
+			else if constexpr ((OP & 0xE7) == 0xC0) { // RET cc
+				if(cond<(OP >> 3) & 0x03>(cpu)) {
+					r.pc = pop16(cpu);
+					return 20;
+				}
+				return 8;
+			}
+			else if constexpr (OP == 0xC9 || OP == 0xD9) { // RET / RETI
+				if constexpr (OP == 0xD9) cpu.ime_ = true;
+				r.pc = pop16(cpu);
+				return 16;
+			}
+			else if constexpr ((OP & 0xE7) == 0xC2) { // JP cc, a16
+				u16 addr = Src::fetch16(cpu);
+				if(cond<(OP >> 3) & 0x03>(cpu)) {
+					r.pc = addr;
+					return 16;
+				}
+				return 12;
+			}
+			else if constexpr (OP == 0xC3) { // JP a16
+				r.pc = Src::fetch16(cpu);
+				return 16;
+			}
+			else if constexpr ((OP & 0xE7) == 0xC4) { // CALL cc, a16
+				u16 addr = Src::fetch16(cpu);
+				if(cond<(OP >> 3) & 0x03>(cpu)) {
+					push16(cpu, r.pc);
+					r.pc = addr;
+					return 24;
+				}
+				return 12;
+			}
+			else if constexpr (OP == 0xCD) { // CALL a16
+				u16 addr = Src::fetch16(cpu);
+				push16(cpu, r.pc);
+				r.pc = addr;
+				return 24;
+			}
+			else if constexpr ((OP & 0xC7) == 0xC7) { // RST vec
+				push16(cpu, r.pc);
+				r.pc = OP & 0x38;
+				return 16;
+			}
+			else if constexpr (OP == 0xF1) { // POP AF
+				u16 af = pop16(cpu);
+				f.set(static_cast<u8>(af & 0xFF));
+				r.a = static_cast<u8>(af >> 8);
+				return 12;
+			}
+			else if constexpr ((OP & 0xCF) == 0xC1) { // POP r16
+				set_r16<(OP >> 4) & 0x03>(cpu, pop16(cpu));
+				return 12;
+			}
+			else if constexpr (OP == 0xF5) { // PUSH AF
+				push16(cpu, static_cast<u16>((r.a << 8) | f.get()));
+				return 16;
+			}
+			else if constexpr ((OP & 0xCF) == 0xC5) { // PUSH r16
+				push16(cpu, get_r16<(OP >> 4) & 0x03>(cpu));
+				return 16;
+			}
+			else if constexpr (OP == 0xE0) { // LDH [a8], A
+				u16 addr = 0xFF00 + static_cast<u16>(Src::fetch8(cpu));
+				bus.write8(addr, r.a);
+				return 12;
+			}
+			else if constexpr (OP == 0xF0) { // LDH A, [a8]
+				u16 addr = 0xFF00 + static_cast<u16>(Src::fetch8(cpu));
+				r.a = bus.read8(addr);
+				return 12;
+			}
+			else if constexpr (OP == 0xE2) { // LDH [C], A
+				bus.write8(0xFF00 + static_cast<u16>(r.c), r.a);
+				return 8;
+			}
+			else if constexpr (OP == 0xF2) { // LDH A, [C]
+				r.a = bus.read8(0xFF00 + static_cast<u16>(r.c));
+				return 8;
+			}
+			else if constexpr (OP == 0xEA) { // LD [a16], A
+				bus.write8(Src::fetch16(cpu), r.a);
+				return 16;
+			}
+			else if constexpr (OP == 0xFA) { // LD A, [a16]
+				r.a = bus.read8(Src::fetch16(cpu));
+				return 16;
+			}
+			else if constexpr (OP == 0xE8 || OP == 0xF8) { // ADD SP, e8 / LD HL, SP + e8
+				s8 offset = static_cast<s8>(Src::fetch8(cpu));
+				u8 imm = static_cast<u8>(offset);
+				u16 temp = static_cast<u16>(r.sp + offset);
+				u8 flags = 0;
+				if(((r.sp & 0xF) + (imm & 0xF)) > 0xF) flags |= Flags::H;
+				if(((r.sp & 0xFF) + imm) > 0xFF) flags |= Flags::C;
+				f.set(flags);
+				if constexpr (OP == 0xE8) {
+					r.sp = temp;
+					return 16;
+				}
+				else {
+					set_hl(cpu, temp);
+					return 12;
+				}
+			}
+			else if constexpr (OP == 0xE9) { // JP HL
+				r.pc = hl(cpu);
+				return 4;
+			}
+			else if constexpr (OP == 0xF9) { // LD SP, HL
+				r.sp = hl(cpu);
+				return 8;
+			}
+			else if constexpr (OP == 0xF3) { // DI
+				cpu.ime_ = false;
+				return 4;
+			}
+			else if constexpr (OP == 0xFB) { // EI
+				cpu.ime_ = true;
+				return 4;
+			}
+			else { // STOP and the unused slots
+				return unimplemented(cpu, OP);
+			}
+		}
+
+		template<u8 OP>
+		static int op_cb(CPU& cpu) {
+			constexpr u8 reg = OP & 0x07;
+			constexpr u8 bit = (OP >> 3) & 0x07;
+
+			if constexpr ((OP >> 6) == 0) { // RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+				set_r8<reg>(cpu, rot8<bit>(cpu, get_r8<reg>(cpu)));
+				return (reg == HL_IND) ? 16 : 8;
+			}
+			else if constexpr ((OP >> 6) == 1) { // BIT u3, r8
+				u8 flags = (cpu.flags.get() & Flags::C) | Flags::H;
+				if(((get_r8<reg>(cpu) >> bit) & 0x01) == 0) flags |= Flags::Z;
+				cpu.flags.set(flags);
+				return (reg == HL_IND) ? 12 : 8;
+			}
+			else if constexpr ((OP >> 6) == 2) { // RES u3, r8
+				set_r8<reg>(cpu, get_r8<reg>(cpu) & static_cast<u8>(~(0x01 << bit)));
+				return (reg == HL_IND) ? 16 : 8;
+			}
+			else { // SET u3, r8
+				set_r8<reg>(cpu, get_r8<reg>(cpu) | static_cast<u8>(0x01 << bit));
+				return (reg == HL_IND) ? 16 : 8;
+			}
+		}
+
+		template<class Src, std::size_t... I>
+		static constexpr std::array<CPU::Handler, 256> make_table(std::index_sequence<I...>) {
+			return {{ &op<static_cast<u8>(I), Src>... }};
+		}
+
+		template<std::size_t... I>
+		static constexpr std::array<CPU::Handler, 256> make_cb_table(std::index_sequence<I...>) {
+			return {{ &op_cb<static_cast<u8>(I)>... }};
+		}
+	};
+
+	const std::array<CPU::Handler, 256> CPU::op_table_ = CPUOps::make_table<CPUOps::BusOperand>(std::make_index_sequence<256>{});
+	const std::array<CPU::Handler, 256> CPU::block_table_ = CPUOps::make_table<CPUOps::BlockOperand>(std::make_index_sequence<256>{});
+	const std::array<CPU::Handler, 256> CPU::cb_table_ = CPUOps::make_cb_table(std::make_index_sequence<256>{});
+} // namespace gb
@@ -0,0 +1,88 @@
+#include "gb/emulator.hpp"
+
+#include <algorithm>
+
+namespace gb {
+	u64 fnv1a(const u8* data, std::size_t size, u64 hash) {
+		for(std::size_t i = 0; i < size; i++) {
+			hash ^= data[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	Emulator::Emulator()
+		: bus_(timer_, ppu_, joypad_), cpu_(bus_),
+			frame_sink_([this](const u8* shades) { frame_hashes_.push_back(fnv1a(shades, 160 * 144)); }) {
+		cpu_.reset();
+		bus_.set_serial_output(&serial_);
+	}
+
+	bool Emulator::load(const std::string& bootrom, const std::string& rom, bool persist_save) {
+		return bus_.load_bootrom(bootrom) && bus_.load_cartridge(rom, persist_save);
+	}
+
+	u64 Emulator::run(u64 cycles) {
+		// Frame-sized slices, as gbemu runs them
+		u64 done = 0;
+		while(done < cycles) {
+			int budget = static_cast<int>(std::min<u64>(cycles - done, CYCLES_PER_FRAME));
+			int ran = cpu_.run(budget);
+			if(ran == 0) break;
+			done += ran;
+		}
+		cycles_ += done;
+		return done;
+	}
+
+	TestVerdict Emulator::test_verdict() {
+		if(serial_.find("Passed") != std::string::npos) return TestVerdict::Passed;
+		if(serial_.find("Failed") != std::string::npos) return TestVerdict::Failed;
+
+		Registers regs = cpu_.get_registers();
+		if(regs.b == 3 && regs.c == 5 && regs.d == 8 && regs.e == 13 && regs.h == 21 && regs.l == 34) return TestVerdict::Passed;
+		if(regs.b == 0x42 && regs.c == 0x42 && regs.d == 0x42 && regs.e == 0x42 && regs.h == 0x42 && regs.l == 0x42) return TestVerdict::Failed;
+		return TestVerdict::Running;
+	}
+
+	TestVerdict Emulator::run_test(u64 budget) {
+		TestVerdict verdict = TestVerdict::Running;
+		u64 start = cycles_;
+		while(cycles_ - start < budget) {
+			std::size_t sent = serial_.size();
+			if(run(std::min<u64>(budget - (cycles_ - start), CYCLES_PER_FRAME)) == 0) break;
+
+			// Decided: only wait for the serial text to finish (failure details)
+			if(verdict != TestVerdict::Running) {
+				if(serial_.size() == sent) break;
+				continue;
+			}
+			verdict = test_verdict();
+		}
+		return verdict;
+	}
+
+	void Emulator::set_frame_hashing(bool enabled) {
+		ppu_.set_video_sink(enabled ? &frame_sink_ : nullptr);
+	}
+
+	u64 Emulator::state_hash() {
+		// 1. Registers
+		Registers regs = cpu_.get_registers();
+		u8 cpu_state[12] = {
+			regs.a, regs.f, regs.b, regs.c, regs.d, regs.e, regs.h, regs.l,
+			static_cast<u8>(regs.pc), static_cast<u8>(regs.pc >> 8),
+			static_cast<u8>(regs.sp), static_cast<u8>(regs.sp >> 8),
+		};
+		u64 hash = fnv1a(cpu_state, sizeof(cpu_state));
+		u8 cpu_mode = static_cast<u8>(cpu_.get_ime() | (cpu_.get_halted() << 1));
+		hash = fnv1a(&cpu_mode, 1, hash);
+
+		// 2. Memory through the bus, so banked and lazily synced state counts
+		for(u32 addr = 0x8000; addr <= 0xFFFF; addr++) {
+			u8 value = bus_.read8(static_cast<u16>(addr));
+			hash = fnv1a(&value, 1, hash);
+		}
+		return hash;
+	}
+} // namespace gb
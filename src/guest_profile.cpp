@@ -0,0 +1,199 @@
+#include "gb/guest_profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace gb {
+	namespace {
+		const u32 BOOT_BANK = 0xFFFF;
+
+		u64 count_key(u32 node, GuestProfiler::Leaf leaf, u32 key) {
+			return (static_cast<u64>(node) << 34) | (static_cast<u64>(leaf) << 32) | key;
+		}
+	}
+
+	void GuestProfiler::reset() {
+		samples_ = 0;
+		depth_ = resolved_ = 0;
+		nodes_.assign(1, {0, 0});
+		children_.clear();
+		counts_.clear();
+		last_id_ = ~0ull;
+		last_count_ = nullptr;
+	}
+
+	bool GuestProfiler::load_symbols(const std::string& path) {
+		std::ifstream ifs(path);
+		if(!ifs) return false;
+
+		std::string line;
+		while(std::getline(ifs, line)) {
+			std::size_t comment = line.find(';');
+			if(comment != std::string::npos) line.resize(comment);
+
+			unsigned bank, addr;
+			char name[256];
+			if(std::sscanf(line.c_str(), " %x:%x %255s", &bank, &addr, name) != 3 || addr > 0xFFFF) continue;
+			symbols_[region((bank << 16) | addr)].push_back({static_cast<u16>(addr), name});
+		}
+		for(auto& [region, symbols] : symbols_) {
+			std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+		}
+		return true;
+	}
+
+	void GuestProfiler::sample(u32 key, u16 sp, Leaf leaf, int count) {
+		unwind(sp);
+		u64 id = count_key(resolve(), leaf, key);
+		if(id != last_id_) {
+			last_id_ = id;
+			last_count_ = &counts_[id];
+		}
+		*last_count_ += count;
+		samples_ += count;
+	}
+
+	u32 GuestProfiler::resolve() {
+		for(; resolved_ < depth_; resolved_++) {
+			Frame& frame = stack_[resolved_];
+			frame.node = child(resolved_ ? stack_[resolved_ - 1].node : 0, frame.key);
+		}
+		return depth_ ? stack_[depth_ - 1].node : 0;
+	}
+
+	u32 GuestProfiler::child(u32 parent, u32 key) {
+		auto [it, inserted] = children_.try_emplace((static_cast<u64>(parent) << 32) | key, static_cast<u32>(nodes_.size()));
+		if(inserted) nodes_.push_back({parent, key});
+		return it->second;
+	}
+
+	u32 GuestProfiler::region(u32 key) {
+		// ROMX symbols are per bank; RAM ones are not (RGBDS numbers WRAMX
+		// banks even on DMG), and each memory area is its own namespace so a
+		// ROM label never names a WRAM address
+		u32 bank = key >> 16;
+		u32 addr = key & 0xFFFF;
+		if(addr < 0x4000) return 0;
+		if(addr < 0x8000) return (bank << 8) | 1;
+		return addr >> 13;
+	}
+
+	const GuestProfiler::Symbol* GuestProfiler::lookup(u32 key) const {
+		if((key >> 16) == BOOT_BANK || (key >> 16) == (IRQ_KEY >> 16)) return nullptr;
+		auto found = symbols_.find(region(key));
+		if(found == symbols_.end()) return nullptr;
+
+		// Nearest label at or before the address
+		const std::vector<Symbol>& symbols = found->second;
+		u16 addr = static_cast<u16>(key);
+		auto it = std::upper_bound(symbols.begin(), symbols.end(), addr, [](u16 a, const Symbol& s) { return a < s.addr; });
+		return it == symbols.begin() ? nullptr : &*(it - 1);
+	}
+
+	std::string GuestProfiler::location(u32 key) const {
+		char text[16];
+		if((key >> 16) == BOOT_BANK) std::snprintf(text, sizeof(text), "boot:%04X", key & 0xFFFF);
+		else std::snprintf(text, sizeof(text), "%02X:%04X", key >> 16, key & 0xFFFF);
+		return text;
+	}
+
+	std::string GuestProfiler::function_name(u32 key) const {
+		const Symbol* symbol = lookup(key);
+		return symbol ? symbol->name : location(key);
+	}
+
+	std::string GuestProfiler::frame_name(u32 key) const {
+		if((key >> 16) == (IRQ_KEY >> 16)) {
+			switch(key & 0xFFFF) {
+				case 0x40: return "[irq vblank]";
+				case 0x48: return "[irq stat]";
+				case 0x50: return "[irq timer]";
+				case 0x58: return "[irq serial]";
+				case 0x60: return "[irq joypad]";
+			}
+			return "[irq]";
+		}
+		return function_name(key);
+	}
+
+	std::string GuestProfiler::folded() const {
+		// Different PCs in one function fold into the same line
+		std::map<std::string, u64> lines;
+		std::vector<std::string> names;
+		for(const auto& [id, count] : counts_) {
+			u32 key = static_cast<u32>(id);
+			Leaf leaf = static_cast<Leaf>((id >> 32) & 3);
+
+			// 1. Frames from the root down
+			names.clear();
+			for(u32 node = static_cast<u32>(id >> 34); node != 0; node = nodes_[node].parent) names.push_back(frame_name(nodes_[node].key));
+			std::string stack;
+			for(auto it = names.rbegin(); it != names.rend(); ++it) stack += *it + ";";
+
+			// 2. The sampled function, and what the CPU was doing there
+			stack += function_name(key);
+			if(leaf == Leaf::Halt) stack += ";[halt]";
+			else if(leaf == Leaf::Idle) stack += ";[idle skip]";
+			lines[stack] += count;
+		}
+
+		std::string out;
+		for(const auto& [stack, count] : lines) out += stack + " " + std::to_string(count) + "\n";
+		return out;
+	}
+
+	std::string GuestProfiler::hot_pcs(int top) const {
+		struct Hot {
+			u32 key;
+			u64 total = 0;
+			u64 halt = 0;
+			u64 idle = 0;
+		};
+		std::unordered_map<u32, Hot> by_pc;
+		for(const auto& [id, count] : counts_) {
+			u32 key = static_cast<u32>(id);
+			Hot& hot = by_pc.try_emplace(key, Hot{key}).first->second;
+			hot.total += count;
+			switch(static_cast<Leaf>((id >> 32) & 3)) {
+				case Leaf::Halt: hot.halt += count; break;
+				case Leaf::Idle: hot.idle += count; break;
+				default: break;
+			}
+		}
+		std::vector<Hot> hots;
+		for(const auto& [key, hot] : by_pc) hots.push_back(hot);
+		std::sort(hots.begin(), hots.end(), [](const Hot& a, const Hot& b) {
+			return a.total != b.total ? a.total > b.total : a.key < b.key;
+		});
+
+		auto percent = [&](u64 part) { return samples_ ? 100.0 * static_cast<double>(part) / static_cast<double>(samples_) : 0.0; };
+		std::string out;
+		char line[200];
+		std::snprintf(line, sizeof(line), "%llu samples, one every %u cycles\n", static_cast<unsigned long long>(samples_), period_);
+		out += line;
+		out += "\nlocation   samples        %    halt    idle  symbol\n";
+		int shown = 0;
+		for(const Hot& hot : hots) {
+			if(top > 0 && shown++ >= top) break;
+
+			// Symbol+offset of the sampled PC
+			std::string name;
+			if(const Symbol* symbol = lookup(hot.key)) {
+				name = symbol->name;
+				u16 offset = static_cast<u16>((hot.key & 0xFFFF) - symbol->addr);
+				if(offset) {
+					char plus[8];
+					std::snprintf(plus, sizeof(plus), "+0x%X", offset);
+					name += plus;
+				}
+			}
+			std::snprintf(line, sizeof(line), "%-9s %8llu  %6.2f%% %6.1f%% %6.1f%%  %s\n", location(hot.key).c_str(),
+					static_cast<unsigned long long>(hot.total), percent(hot.total),
+					100.0 * static_cast<double>(hot.halt) / static_cast<double>(hot.total),
+					100.0 * static_cast<double>(hot.idle) / static_cast<double>(hot.total), name.c_str());
+			out += line;
+		}
+		return out;
+	}
+} // namespace gb
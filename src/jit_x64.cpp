@@ -0,0 +1,854 @@
+#include "gb/jit.hpp"
+#include "gb/bus.hpp"
+
+#if defined(GBEMU_JIT) && defined(__x86_64__)
+#define GB_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <deque>
+#include <initializer_list>
+#include <vector>
+#endif
+
+namespace gb {
+#if GB_JIT_X64
+	namespace {
+		constexpr std::size_t CODE_SIZE = 8 << 20;
+
+		std::size_t page_size() {
+			static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+			return size;
+		}
+
+		enum HostReg : int {
+			RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15,
+		};
+
+		// Homes of the guest state inside generated code (all callee-saved)
+		constexpr int CTX = RBX;
+		constexpr int REG_A = R12;
+		constexpr int REG_BC = R13;
+		constexpr int REG_DE = R14;
+		constexpr int REG_HL = R15;
+		constexpr int REG_F = RBP;
+
+		constexpr s32 OFF_PC = offsetof(JitContext, pc);
+		constexpr s32 OFF_SP = offsetof(JitContext, sp);
+		constexpr s32 OFF_BC = offsetof(JitContext, bc);
+		constexpr s32 OFF_DE = offsetof(JitContext, de);
+		constexpr s32 OFF_HL = offsetof(JitContext, hl);
+		constexpr s32 OFF_A = offsetof(JitContext, a);
+		constexpr s32 OFF_F = offsetof(JitContext, f);
+		constexpr s32 OFF_EXIT = offsetof(JitContext, exit);
+		constexpr s32 OFF_TMP = offsetof(JitContext, tmp);
+		constexpr s32 OFF_CYCLES = offsetof(JitContext, cycles);
+		constexpr s32 OFF_INSNS = offsetof(JitContext, insns);
+		constexpr s32 OFF_LIMIT = offsetof(JitContext, limit);
+		constexpr s32 OFF_WRAM = offsetof(JitContext, wram);
+		constexpr s32 OFF_HRAM = offsetof(JitContext, hram);
+		constexpr s32 OFF_GRANULE = offsetof(JitContext, code_granule);
+		constexpr s32 OFF_LUT = offsetof(JitContext, flag_lut);
+
+		enum Alu : u8 { ADD, OR, ADC, SBB, AND, SUB, XOR, CMP };
+		enum Shift : u8 { ROL, ROR, RCL, RCR, SHL, SHR, SAR = 7 };
+		enum Cond : u8 { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_BE = 6 };
+
+		/* Minimal x86-64 encoder for the forms the translator needs. */
+		class Emitter {
+			public:
+				struct Label {
+					std::size_t pos = SIZE_MAX;
+					std::vector<std::size_t> fixups;
+				};
+
+				Emitter(u8* buf, std::size_t cap) : buf_(buf), cap_(cap) {}
+				std::size_t size() const { return pos_; }
+				bool overflow() const { return pos_ > cap_; }
+
+				void byte(u8 b) {
+					if(pos_ < cap_) buf_[pos_] = b;
+					pos_++;
+				}
+				void dword(u32 v) {
+					for(int i = 0; i < 4; i++) byte(static_cast<u8>(v >> (8 * i)));
+				}
+				void qword(u64 v) {
+					for(int i = 0; i < 8; i++) byte(static_cast<u8>(v >> (8 * i)));
+				}
+
+				void bind(Label& label) {
+					label.pos = pos_;
+					for(std::size_t at : label.fixups) patch(at, label.pos);
+				}
+				void jmp(Label& label) { byte(0xE9); ref(label); }
+				void jcc(u8 cc, Label& label) { byte(0x0F); byte(0x80 + cc); ref(label); }
+
+				// Register-register forms (32-bit unless noted)
+				void mov(int dst, int src) { rr({0x89}, src, dst); }
+				void mov64(int dst, int src) { rr({0x89}, src, dst, true); }
+				void mov_imm(int dst, u32 imm) { rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm); }
+				void movzx8(int dst, int src) { rr({0x0F, 0xB6}, dst, src, false, src >= 4 && src < 8); }
+				void movzx16(int dst, int src) { rr({0x0F, 0xB7}, dst, src); }
+				void movzx_ah(int dst) { byte(0x0F); byte(0xB6); byte(0xC0 | ((dst & 7) << 3) | 4); }
+				void alu(Alu op, int dst, int src) { rr({static_cast<u8>(op * 8 + 1)}, src, dst); }
+				void alu8(Alu op, int dst, int src) { rr({static_cast<u8>(op * 8)}, src, dst, false, needs_rex8(dst) || needs_rex8(src)); }
+				void alu_imm(Alu op, int dst, u32 imm) { rex(false, 0, 0, dst); byte(0x81); modrm_rr(op, dst); dword(imm); }
+				void alu8_imm(Alu op, int dst, u8 imm) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0x80); modrm_rr(op, dst); byte(imm); }
+				void shift(Shift op, int dst, u8 count) { rex(false, 0, 0, dst); byte(0xC1); modrm_rr(op, dst); byte(count); }
+				void shift8_1(Shift op, int dst) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0xD0); modrm_rr(op, dst); }
+				void shift8(Shift op, int dst, u8 count) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0xC0); modrm_rr(op, dst); byte(count); }
+				void test_imm(int dst, u32 imm) { rex(false, 0, 0, dst); byte(0xF7); modrm_rr(0, dst); dword(imm); }
+				void test8(int a, int b) { rr({0x84}, b, a, false, needs_rex8(a) || needs_rex8(b)); }
+				void test8_imm(int dst, u8 imm) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0xF6); modrm_rr(0, dst); byte(imm); }
+				void inc8(int dst) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0xFE); modrm_rr(0, dst); }
+				void dec8(int dst) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0xFE); modrm_rr(1, dst); }
+				void bt_imm(int dst, u8 bit) { rex(false, 0, 0, dst); byte(0x0F); byte(0xBA); modrm_rr(4, dst); byte(bit); }
+				void setcc(u8 cc, int dst) { rex(false, 0, 0, dst, needs_rex8(dst)); byte(0x0F); byte(0x90 + cc); modrm_rr(0, dst); }
+				void lahf() { byte(0x9F); }
+				void clc() { byte(0xF8); }
+
+				// Memory forms: [base + index + disp32], index < 0 for none
+				void load8(int dst, int base, int index, s32 disp) { rm({0x0F, 0xB6}, dst, base, index, disp); }
+				void load16(int dst, int base, s32 disp) { rm({0x0F, 0xB7}, dst, base, -1, disp); }
+				void load64(int dst, int base, s32 disp) { rm({0x8B}, dst, base, -1, disp, true); }
+				void store8(int src, int base, int index, s32 disp) { rm({0x88}, src, base, index, disp, false, needs_rex8(src)); }
+				void store16(int src, int base, s32 disp) { byte(0x66); rm({0x89}, src, base, -1, disp); }
+				void store16_imm(int base, s32 disp, u16 imm) { byte(0x66); rm({0xC7}, 0, base, -1, disp); byte(imm & 0xFF); byte(imm >> 8); }
+				void store32_imm(int base, s32 disp, u32 imm) { rm({0xC7}, 0, base, -1, disp); dword(imm); }
+				void cmp8_mem_imm(int base, int index, s32 disp, u8 imm) { rm({0x80}, 7, base, index, disp); byte(imm); }
+				void cmp32_mem_imm(int base, s32 disp, u32 imm) { rm({0x81}, 7, base, -1, disp); dword(imm); }
+
+				void push(int reg) { rex(false, 0, 0, reg); byte(0x50 + (reg & 7)); }
+				void pop(int reg) { rex(false, 0, 0, reg); byte(0x58 + (reg & 7)); }
+				void sub_rsp(u8 imm) { byte(0x48); byte(0x83); byte(0xEC); byte(imm); }
+				void add_rsp(u8 imm) { byte(0x48); byte(0x83); byte(0xC4); byte(imm); }
+				void ret() { byte(0xC3); }
+				void call(const void* fn) {
+					byte(0x48); byte(0xB8); qword(reinterpret_cast<u64>(fn)); // mov rax, imm64
+					byte(0xFF); byte(0xD0);                                    // call rax
+				}
+			private:
+				static bool needs_rex8(int reg) { return reg >= 4 && reg < 8; } // SPL/BPL/SIL/DIL
+
+				void rex(bool w, int reg, int index, int base, bool force = false) {
+					u8 v = 0x40 | (w ? 0x08 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+					if(v != 0x40 || force) byte(v);
+				}
+				void modrm_rr(int reg, int rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+				void rr(std::initializer_list<u8> op, int reg, int rm, bool w = false, bool force = false) {
+					rex(w, reg, 0, rm, force);
+					for(u8 b : op) byte(b);
+					modrm_rr(reg, rm);
+				}
+				void rm(std::initializer_list<u8> op, int reg, int base, int index, s32 disp, bool w = false, bool force = false) {
+					rex(w, reg, index < 0 ? 0 : index, base, force);
+					for(u8 b : op) byte(b);
+					if(index < 0 && (base & 7) != RSP) {
+						byte(0x80 | ((reg & 7) << 3) | (base & 7));
+					}
+					else {
+						byte(0x84 | ((reg & 7) << 3));
+						byte((((index < 0) ? RSP : index) & 7) << 3 | (base & 7));
+					}
+					dword(static_cast<u32>(disp));
+				}
+				void ref(Label& label) {
+					if(label.pos != SIZE_MAX) {
+						dword(static_cast<u32>(static_cast<s32>(label.pos - (pos_ + 4))));
+					}
+					else {
+						label.fixups.push_back(pos_);
+						dword(0);
+					}
+				}
+				void patch(std::size_t at, std::size_t target) {
+					if(at + 4 > cap_) return;
+					u32 rel = static_cast<u32>(static_cast<s32>(target - (at + 4)));
+					for(int i = 0; i < 4; i++) buf_[at + i] = static_cast<u8>(rel >> (8 * i));
+				}
+
+				u8* buf_;
+				std::size_t cap_;
+				std::size_t pos_ = 0;
+		};
+
+		// Bring the peripherals up to the start of the current instruction
+		void catch_up(JitContext* ctx, u32 elapsed) {
+			if(elapsed > ctx->ticked) {
+				ctx->bus->tick(static_cast<int>(elapsed - ctx->ticked));
+				ctx->ticked = elapsed;
+			}
+		}
+
+		u32 read_helper(JitContext* ctx, u32 addr, u32 elapsed) {
+			catch_up(ctx, elapsed);
+			return ctx->bus->read8(static_cast<u16>(addr));
+		}
+
+		void write_helper(JitContext* ctx, u32 addr, u32 value, u32 elapsed) {
+			catch_up(ctx, elapsed);
+			ctx->bus->write8(static_cast<u16>(addr), static_cast<u8>(value));
+
+			// Leave at the next boundary when an interrupt became serviceable,
+			// cached code was overwritten, or the timer event horizon moved
+			if(ctx->ime && ctx->bus->pending_interrupts()) ctx->exit = 1;
+			if(ctx->bus->code_epoch() != ctx->epoch) ctx->exit = 1;
+			if(addr >= 0xFF04 && addr <= 0xFF07) ctx->exit = 1;
+		}
+
+		/* Translates SM83 instructions into the emitter, tracking cycles. */
+		class Translator {
+			public:
+				explicit Translator(Emitter& e) : e_(e) {}
+
+				u32 elapsed = 0;      // cycles of the instructions already emitted
+				u32 insns = 0;        // instructions emitted, including the current one
+				bool terminated = false;
+				Emitter::Label epilogue;
+
+				static bool supported(const JitInsn& insn);
+				void translate(const JitInsn& insn, u16 pc);
+
+				void exit_const(u16 pc, u32 cycles) { exit_at(pc, cycles, insns); }
+
+				// Boundary exits, out of the straight-line path
+				void emit_stubs() {
+					for(Stub& stub : stubs_) {
+						e_.bind(stub.label);
+						exit_at(stub.pc, stub.cycles, stub.insns);
+					}
+				}
+			private:
+				struct Stub {
+					Emitter::Label label;
+					u16 pc;
+					u32 cycles;
+					u32 insns;
+				};
+
+				void exit_at(u16 pc, u32 cycles, u32 count) {
+					e_.store16_imm(CTX, OFF_PC, pc);
+					e_.store32_imm(CTX, OFF_CYCLES, cycles);
+					e_.store32_imm(CTX, OFF_INSNS, count);
+					e_.jmp(epilogue);
+				}
+
+				static int pair_of(u8 r) { return (r < 2) ? REG_BC : (r < 4) ? REG_DE : REG_HL; }
+
+				void exit_dynamic(u32 cycles) { // PC in EAX
+					e_.store16(RAX, CTX, OFF_PC);
+					e_.store32_imm(CTX, OFF_CYCLES, cycles);
+					e_.store32_imm(CTX, OFF_INSNS, insns);
+					e_.jmp(epilogue);
+				}
+
+				// addr in ECX -> EAX
+				void read8() {
+					Emitter::Label wram, slow, done;
+					e_.mov(RAX, RCX);
+					e_.alu_imm(SUB, RAX, 0xC000);
+					e_.alu_imm(CMP, RAX, 0x2000);
+					e_.jcc(CC_B, wram);
+					e_.mov(RAX, RCX);
+					e_.alu_imm(SUB, RAX, 0xFF80);
+					e_.alu_imm(CMP, RAX, 0x7F);
+					e_.jcc(CC_AE, slow);
+					e_.load64(RDX, CTX, OFF_HRAM);
+					e_.load8(RAX, RDX, RAX, 0);
+					e_.jmp(done);
+					e_.bind(wram);
+					e_.load64(RDX, CTX, OFF_WRAM);
+					e_.load8(RAX, RDX, RAX, 0);
+					e_.jmp(done);
+					e_.bind(slow);
+					e_.mov(RSI, RCX);
+					e_.mov_imm(RDX, elapsed);
+					e_.mov64(RDI, CTX);
+					e_.call(reinterpret_cast<const void*>(&read_helper));
+					e_.bind(done);
+					helper_ = true;
+				}
+
+				// addr in ECX, value in EAX
+				void write8() {
+					Emitter::Label hram, slow, done;
+					e_.mov(RDX, RCX);
+					e_.alu_imm(SUB, RDX, 0xC000);
+					e_.alu_imm(CMP, RDX, 0x2000);
+					e_.jcc(CC_AE, hram);
+					e_.mov(RSI, RDX);
+					e_.shift(SHR, RSI, 4);
+					e_.load64(RDI, CTX, OFF_GRANULE);
+					e_.cmp8_mem_imm(RDI, RSI, 0, 0);
+					e_.jcc(CC_NE, slow); // cached code lives here: let Bus invalidate it
+					e_.load64(RDI, CTX, OFF_WRAM);
+					e_.store8(RAX, RDI, RDX, 0);
+					e_.jmp(done);
+					e_.bind(hram); // granules 0x200~0x207, same rule
+					e_.mov(RDX, RCX);
+					e_.alu_imm(SUB, RDX, 0xFF80);
+					e_.alu_imm(CMP, RDX, 0x7F);
+					e_.jcc(CC_AE, slow);
+					e_.mov(RSI, RDX);
+					e_.shift(SHR, RSI, 4);
+					e_.load64(RDI, CTX, OFF_GRANULE);
+					e_.cmp8_mem_imm(RDI, RSI, 0x200, 0);
+					e_.jcc(CC_NE, slow);
+					e_.load64(RDI, CTX, OFF_HRAM);
+					e_.store8(RAX, RDI, RDX, 0);
+					e_.jmp(done);
+					e_.bind(slow);
+					e_.mov(RDX, RAX);
+					e_.mov(RSI, RCX);
+					e_.mov_imm(RCX, elapsed);
+					e_.mov64(RDI, CTX);
+					e_.call(reinterpret_cast<const void*>(&write_helper));
+					e_.bind(done);
+					helper_ = true;
+				}
+
+				// Guest r8 (B, C, D, E, H, L, [HL], A) <-> EAX
+				void load_r8(u8 r) {
+					if(r == 7) e_.mov(RAX, REG_A);
+					else if(r == 6) {
+						e_.mov(RCX, REG_HL);
+						read8();
+					}
+					else if((r & 1) == 0) {
+						e_.mov(RAX, pair_of(r));
+						e_.shift(SHR, RAX, 8);
+					}
+					else e_.movzx8(RAX, pair_of(r));
+				}
+
+				void store_r8(u8 r) {
+					if(r == 7) e_.mov(REG_A, RAX);
+					else if(r == 6) {
+						e_.mov(RCX, REG_HL);
+						write8();
+					}
+					else if((r & 1) == 0) {
+						e_.alu_imm(AND, pair_of(r), 0x00FF);
+						e_.shift(SHL, RAX, 8);
+						e_.alu(OR, pair_of(r), RAX);
+					}
+					else {
+						e_.alu_imm(AND, pair_of(r), 0xFF00);
+						e_.alu(OR, pair_of(r), RAX);
+					}
+				}
+
+				// x86 flags -> F through the LAHF lookup table
+				void flags_from_lahf(u8 lut_mask, u8 keep, u8 set) {
+					e_.lahf();
+					e_.movzx_ah(RDX);
+					e_.load8(RDX, CTX, RDX, OFF_LUT);
+					if(lut_mask != 0xB0) e_.alu_imm(AND, RDX, lut_mask);
+					if(keep) {
+						e_.alu_imm(AND, REG_F, keep);
+						e_.alu(OR, REG_F, RDX);
+					}
+					else e_.mov(REG_F, RDX);
+					if(set) e_.alu_imm(OR, REG_F, set);
+				}
+
+				// F = Z from the x86 ZF, plus constant bits
+				void flags_z_only(u8 set) {
+					e_.setcc(CC_E, RDX);
+					e_.movzx8(REG_F, RDX);
+					e_.shift(SHL, REG_F, 7);
+					if(set) e_.alu_imm(OR, REG_F, set);
+				}
+
+				// ALU A, EAX
+				void alu_a(u8 op) {
+					switch(op) {
+						case 0: e_.alu8(ADD, REG_A, RAX); flags_from_lahf(0xB0, 0, 0); break;
+						case 1: e_.bt_imm(REG_F, 4); e_.alu8(ADC, REG_A, RAX); flags_from_lahf(0xB0, 0, 0); break;
+						case 2: e_.alu8(SUB, REG_A, RAX); flags_from_lahf(0xB0, 0, 0x40); break;
+						case 3: e_.bt_imm(REG_F, 4); e_.alu8(SBB, REG_A, RAX); flags_from_lahf(0xB0, 0, 0x40); break;
+						case 4: e_.alu8(AND, REG_A, RAX); flags_z_only(0x20); break;
+						case 5: e_.alu8(XOR, REG_A, RAX); flags_z_only(0); break;
+						case 6: e_.alu8(OR, REG_A, RAX); flags_z_only(0); break;
+						case 7: e_.alu8(CMP, REG_A, RAX); flags_from_lahf(0xB0, 0, 0x40); break;
+					}
+				}
+
+				// Jump to `skip` when condition cc (NZ, Z, NC, C) does not hold
+				void branch_unless(u8 cc, Emitter::Label& skip) {
+					e_.test_imm(REG_F, (cc & 2) ? 0x10 : 0x80);
+					e_.jcc((cc & 1) ? CC_E : CC_NE, skip);
+				}
+
+				void sp_step(Alu op) { // SP +/- 1, new SP in ECX
+					e_.load16(RCX, CTX, OFF_SP);
+					e_.alu_imm(op, RCX, 1);
+					e_.movzx16(RCX, RCX);
+					e_.store16(RCX, CTX, OFF_SP);
+				}
+
+				// Push the value produced by load_hi()/load_lo() into EAX
+				template<class Hi, class Lo>
+				void push16(Hi load_hi, Lo load_lo) {
+					sp_step(SUB);
+					load_hi();
+					write8();
+					sp_step(SUB);
+					load_lo();
+					write8();
+				}
+
+				void push_imm(u16 value) {
+					push16([&] { e_.mov_imm(RAX, value >> 8); }, [&] { e_.mov_imm(RAX, value & 0xFF); });
+				}
+
+				// Pop into EAX (low byte also left in ctx.tmp)
+				void pop16() {
+					e_.load16(RCX, CTX, OFF_SP);
+					read8();
+					e_.store8(RAX, CTX, -1, OFF_TMP);
+					sp_step(ADD);
+					read8();
+					e_.shift(SHL, RAX, 8);
+					e_.load8(RDX, CTX, -1, OFF_TMP);
+					e_.alu(OR, RAX, RDX);
+					sp_step(ADD);
+				}
+
+				void translate_cb(u8 cb);
+
+				Emitter& e_;
+				bool helper_ = false;
+				std::deque<Stub> stubs_; // labels stay put while more are added
+		};
+
+		bool Translator::supported(const JitInsn& insn) {
+			switch(insn.opcode) {
+				case 0x08: // LD [a16], SP
+				case 0x10: // STOP
+				case 0x27: // DAA
+				case 0x76: // HALT
+				case 0xD9: // RETI
+				case 0xE8: case 0xF8: // SP + e8
+				case 0xF3: case 0xFB: // DI / EI
+				case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4:
+				case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+					return false;
+				default:
+					return true;
+			}
+		}
+
+		void Translator::translate_cb(u8 cb) {
+			u8 r = cb & 0x07;
+			u8 bit = (cb >> 3) & 0x07;
+			u32 cycles;
+
+			load_r8(r);
+			switch(cb >> 6) {
+				case 0: // RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+					switch(bit) {
+						case 0: e_.shift8_1(ROL, RAX); break;
+						case 1: e_.shift8_1(ROR, RAX); break;
+						case 2: e_.bt_imm(REG_F, 4); e_.shift8_1(RCL, RAX); break;
+						case 3: e_.bt_imm(REG_F, 4); e_.shift8_1(RCR, RAX); break;
+						case 4: e_.shift8_1(SHL, RAX); break;
+						case 5: e_.shift8_1(SAR, RAX); break;
+						case 6: e_.shift8(ROL, RAX, 4); e_.clc(); break;
+						case 7: e_.shift8_1(SHR, RAX); break;
+					}
+					e_.setcc(CC_B, RDX);
+					e_.test8(RAX, RAX);
+					e_.setcc(CC_E, RCX);
+					e_.movzx8(REG_F, RDX);
+					e_.shift(SHL, REG_F, 4);
+					e_.movzx8(RCX, RCX);
+					e_.shift(SHL, RCX, 7);
+					e_.alu(OR, REG_F, RCX);
+					e_.movzx8(RAX, RAX);
+					store_r8(r);
+					cycles = (r == 6) ? 16 : 8;
+					break;
+				case 1: // BIT
+					e_.test8_imm(RAX, static_cast<u8>(1 << bit));
+					e_.setcc(CC_E, RDX);
+					e_.movzx8(RDX, RDX);
+					e_.shift(SHL, RDX, 7);
+					e_.alu_imm(AND, REG_F, 0x10);
+					e_.alu_imm(OR, REG_F, 0x20);
+					e_.alu(OR, REG_F, RDX);
+					cycles = (r == 6) ? 12 : 8;
+					break;
+				case 2: // RES
+					e_.alu_imm(AND, RAX, ~(1u << bit) & 0xFF);
+					store_r8(r);
+					cycles = (r == 6) ? 16 : 8;
+					break;
+				default: // SET
+					e_.alu_imm(OR, RAX, 1u << bit);
+					store_r8(r);
+					cycles = (r == 6) ? 16 : 8;
+					break;
+			}
+			elapsed += cycles;
+		}
+
+		void Translator::translate(const JitInsn& insn, u16 pc) {
+			const u8 op = insn.opcode;
+			const u16 imm = insn.imm;
+			const u16 next = static_cast<u16>(pc + insn.length);
+			helper_ = false;
+			insns++;
+
+			if(op == 0x00) { // NOP
+				elapsed += 4;
+			}
+			else if((op & 0xC0) == 0x40) { // LD r8, r8
+				u8 dst = (op >> 3) & 0x07, src = op & 0x07;
+				load_r8(src);
+				store_r8(dst);
+				elapsed += (src == 6 || dst == 6) ? 8 : 4;
+			}
+			else if((op & 0xC0) == 0x80) { // ALU A, r8
+				load_r8(op & 0x07);
+				alu_a((op >> 3) & 0x07);
+				elapsed += ((op & 0x07) == 6) ? 8 : 4;
+			}
+			else if((op & 0xC7) == 0xC6) { // ALU A, n8
+				e_.mov_imm(RAX, imm & 0xFF);
+				alu_a((op >> 3) & 0x07);
+				elapsed += 8;
+			}
+			else if(op == 0xCB) {
+				translate_cb(static_cast<u8>(imm));
+			}
+			else if((op & 0xC7) == 0x04 || (op & 0xC7) == 0x05) { // INC r8 / DEC r8
+				u8 r = (op >> 3) & 0x07;
+				bool dec = (op & 0x01);
+				load_r8(r);
+				if(dec) e_.dec8(RAX);
+				else e_.inc8(RAX);
+				flags_from_lahf(0xA0, 0x10, dec ? 0x40 : 0);
+				e_.movzx8(RAX, RAX);
+				store_r8(r);
+				elapsed += (r == 6) ? 12 : 4;
+			}
+			else if((op & 0xC7) == 0x06) { // LD r8, n8
+				u8 r = (op >> 3) & 0x07;
+				e_.mov_imm(RAX, imm & 0xFF);
+				store_r8(r);
+				elapsed += (r == 6) ? 12 : 8;
+			}
+			else if((op & 0xCF) == 0x01) { // LD r16, n16
+				u8 rr = (op >> 4) & 0x03;
+				if(rr == 3) e_.store16_imm(CTX, OFF_SP, imm);
+				else e_.mov_imm(pair_of(rr * 2), imm);
+				elapsed += 12;
+			}
+			else if((op & 0xCF) == 0x03 || (op & 0xCF) == 0x0B) { // INC r16 / DEC r16
+				u8 rr = (op >> 4) & 0x03;
+				Alu alu = (op & 0x08) ? SUB : ADD;
+				if(rr == 3) sp_step(alu);
+				else {
+					e_.alu_imm(alu, pair_of(rr * 2), 1);
+					e_.movzx16(pair_of(rr * 2), pair_of(rr * 2));
+				}
+				elapsed += 8;
+			}
+			else if((op & 0xCF) == 0x09) { // ADD HL, r16
+				u8 rr = (op >> 4) & 0x03;
+				if(rr == 3) e_.load16(RCX, CTX, OFF_SP);
+				else e_.mov(RCX, pair_of(rr * 2));
+				e_.mov(RAX, REG_HL);
+				e_.alu(ADD, RAX, RCX);
+				e_.mov(RDX, REG_HL); // H: carry into bit 12
+				e_.alu(XOR, RDX, RCX);
+				e_.alu(XOR, RDX, RAX);
+				e_.shift(SHR, RDX, 7);
+				e_.alu_imm(AND, RDX, 0x20);
+				e_.mov(RSI, RAX);    // C: carry into bit 16
+				e_.shift(SHR, RSI, 12);
+				e_.alu_imm(AND, RSI, 0x10);
+				e_.alu_imm(AND, REG_F, 0x80);
+				e_.alu(OR, REG_F, RDX);
+				e_.alu(OR, REG_F, RSI);
+				e_.movzx16(REG_HL, RAX);
+				elapsed += 8;
+			}
+			else if(op == 0x02 || op == 0x12) { // LD [BC], A / LD [DE], A
+				e_.mov(RCX, pair_of((op >> 4) * 2));
+				e_.mov(RAX, REG_A);
+				write8();
+				elapsed += 8;
+			}
+			else if(op == 0x0A || op == 0x1A) { // LD A, [BC] / LD A, [DE]
+				e_.mov(RCX, pair_of((op >> 4) * 2));
+				read8();
+				e_.mov(REG_A, RAX);
+				elapsed += 8;
+			}
+			else if(op == 0x22 || op == 0x32) { // LD [HL+], A / LD [HL-], A
+				e_.mov(RCX, REG_HL);
+				e_.mov(RAX, REG_A);
+				write8();
+				e_.alu_imm((op == 0x22) ? ADD : SUB, REG_HL, 1);
+				e_.movzx16(REG_HL, REG_HL);
+				elapsed += 8;
+			}
+			else if(op == 0x2A || op == 0x3A) { // LD A, [HL+] / LD A, [HL-]
+				e_.mov(RCX, REG_HL);
+				read8();
+				e_.mov(REG_A, RAX);
+				e_.alu_imm((op == 0x2A) ? ADD : SUB, REG_HL, 1);
+				e_.movzx16(REG_HL, REG_HL);
+				elapsed += 8;
+			}
+			else if(op == 0x07 || op == 0x0F || op == 0x17 || op == 0x1F) { // RLCA, RRCA, RLA, RRA
+				if(op == 0x17 || op == 0x1F) e_.bt_imm(REG_F, 4);
+				e_.shift8_1((op == 0x07) ? ROL : (op == 0x0F) ? ROR : (op == 0x17) ? RCL : RCR, REG_A);
+				e_.setcc(CC_B, RDX);
+				e_.movzx8(REG_F, RDX);
+				e_.shift(SHL, REG_F, 4);
+				elapsed += 4;
+			}
+			else if(op == 0x2F) { // CPL
+				e_.alu_imm(XOR, REG_A, 0xFF);
+				e_.alu_imm(OR, REG_F, 0x60);
+				elapsed += 4;
+			}
+			else if(op == 0x37) { // SCF
+				e_.alu_imm(AND, REG_F, 0x80);
+				e_.alu_imm(OR, REG_F, 0x10);
+				elapsed += 4;
+			}
+			else if(op == 0x3F) { // CCF
+				e_.alu_imm(AND, REG_F, 0x90);
+				e_.alu_imm(XOR, REG_F, 0x10);
+				elapsed += 4;
+			}
+			else if(op == 0xE0 || op == 0xEA) { // LDH [a8], A / LD [a16], A
+				e_.mov_imm(RCX, (op == 0xE0) ? (0xFF00 | (imm & 0xFF)) : imm);
+				e_.mov(RAX, REG_A);
+				write8();
+				elapsed += (op == 0xE0) ? 12 : 16;
+			}
+			else if(op == 0xF0 || op == 0xFA) { // LDH A, [a8] / LD A, [a16]
+				e_.mov_imm(RCX, (op == 0xF0) ? (0xFF00 | (imm & 0xFF)) : imm);
+				read8();
+				e_.mov(REG_A, RAX);
+				elapsed += (op == 0xF0) ? 12 : 16;
+			}
+			else if(op == 0xE2 || op == 0xF2) { // LDH [C], A / LDH A, [C]
+				e_.movzx8(RCX, REG_BC);
+				e_.alu_imm(OR, RCX, 0xFF00);
+				if(op == 0xE2) {
+					e_.mov(RAX, REG_A);
+					write8();
+				}
+				else {
+					read8();
+					e_.mov(REG_A, RAX);
+				}
+				elapsed += 8;
+			}
+			else if(op == 0xF9) { // LD SP, HL
+				e_.store16(REG_HL, CTX, OFF_SP);
+				elapsed += 8;
+			}
+			else if((op & 0xCF) == 0xC5) { // PUSH r16
+				u8 rr = (op >> 4) & 0x03;
+				if(rr == 3) {
+					push16([&] { e_.mov(RAX, REG_A); }, [&] { e_.mov(RAX, REG_F); });
+				}
+				else {
+					int pair = pair_of(rr * 2);
+					push16([&] { e_.mov(RAX, pair); e_.shift(SHR, RAX, 8); }, [&] { e_.movzx8(RAX, pair); });
+				}
+				elapsed += 16;
+			}
+			else if((op & 0xCF) == 0xC1) { // POP r16
+				u8 rr = (op >> 4) & 0x03;
+				pop16();
+				if(rr == 3) {
+					e_.shift(SHR, RAX, 8);
+					e_.mov(REG_A, RAX);
+					e_.load8(REG_F, CTX, -1, OFF_TMP);
+					e_.alu_imm(AND, REG_F, 0xF0);
+				}
+				else e_.mov(pair_of(rr * 2), RAX);
+				elapsed += 12;
+			}
+			// Block terminators
+			else if(op == 0x18) { // JR e8
+				terminated = true;
+				exit_const(static_cast<u16>(next + static_cast<s8>(imm & 0xFF)), elapsed + 12);
+			}
+			else if((op & 0xE7) == 0x20) { // JR cc, e8
+				Emitter::Label skip;
+				terminated = true;
+				branch_unless((op >> 3) & 0x03, skip);
+				exit_const(static_cast<u16>(next + static_cast<s8>(imm & 0xFF)), elapsed + 12);
+				e_.bind(skip);
+				exit_const(next, elapsed + 8);
+			}
+			else if(op == 0xC3) { // JP a16
+				terminated = true;
+				exit_const(imm, elapsed + 16);
+			}
+			else if((op & 0xE7) == 0xC2) { // JP cc, a16
+				Emitter::Label skip;
+				terminated = true;
+				branch_unless((op >> 3) & 0x03, skip);
+				exit_const(imm, elapsed + 16);
+				e_.bind(skip);
+				exit_const(next, elapsed + 12);
+			}
+			else if(op == 0xE9) { // JP HL
+				terminated = true;
+				e_.mov(RAX, REG_HL);
+				exit_dynamic(elapsed + 4);
+			}
+			else if(op == 0xCD) { // CALL a16
+				terminated = true;
+				push_imm(next);
+				exit_const(imm, elapsed + 24);
+			}
+			else if((op & 0xE7) == 0xC4) { // CALL cc, a16
+				Emitter::Label skip;
+				terminated = true;
+				branch_unless((op >> 3) & 0x03, skip);
+				push_imm(next);
+				exit_const(imm, elapsed + 24);
+				e_.bind(skip);
+				exit_const(next, elapsed + 12);
+			}
+			else if((op & 0xC7) == 0xC7) { // RST vec
+				terminated = true;
+				push_imm(next);
+				exit_const(op & 0x38, elapsed + 16);
+			}
+			else if(op == 0xC9) { // RET
+				terminated = true;
+				pop16();
+				exit_dynamic(elapsed + 16);
+			}
+			else if((op & 0xE7) == 0xC0) { // RET cc
+				Emitter::Label skip;
+				terminated = true;
+				branch_unless((op >> 3) & 0x03, skip);
+				pop16();
+				exit_dynamic(elapsed + 20);
+				e_.bind(skip);
+				exit_const(next, elapsed + 8);
+			}
+
+			// Stop at this boundary when a Bus callback asked to, or once the
+			// next event is due (ctx.limit): where the interpreter would
+			if(!terminated) {
+				Stub& stub = stubs_.emplace_back();
+				stub.pc = next;
+				stub.cycles = elapsed;
+				stub.insns = insns;
+				if(helper_) {
+					e_.cmp8_mem_imm(CTX, -1, OFF_EXIT, 0);
+					e_.jcc(CC_NE, stub.label);
+				}
+				e_.cmp32_mem_imm(CTX, OFF_LIMIT, elapsed);
+				e_.jcc(CC_BE, stub.label);
+			}
+		}
+	}
+
+	Jit::Jit(Bus& bus) : bus_(bus) {
+		// Never writable and executable at once: pages turn executable once
+		// the translations in them are emitted (see compile())
+		void* mem = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mem != MAP_FAILED) code_ = static_cast<u8*>(mem);
+
+		ctx_.bus = &bus_;
+		ctx_.wram = bus_.wram_.data();
+		ctx_.hram = bus_.hram_.data();
+		ctx_.code_granule = bus_.code_granule_.data();
+		for(int ah = 0; ah < 256; ah++) {
+			ctx_.flag_lut[ah] = ((ah & 0x40) ? 0x80 : 0) | // ZF -> Z
+			                    ((ah & 0x10) ? 0x20 : 0) | // AF -> H
+			                    ((ah & 0x01) ? 0x10 : 0);  // CF -> C
+		}
+	}
+
+	Jit::~Jit() {
+		if(code_) munmap(code_, CODE_SIZE);
+	}
+
+	void Jit::reset() {
+		if(code_) mprotect(code_, CODE_SIZE, PROT_READ | PROT_WRITE);
+		used_ = 0;
+		full_ = false;
+	}
+
+	JitCode Jit::compile(const JitInsn* insns, int count, u16 pc) {
+		if(!code_ || full_ || !Translator::supported(insns[0])) return nullptr;
+
+		// The page shared with the previous translation goes back to RW while
+		// this one is emitted; pages past it were never made executable
+		std::size_t first = used_ & ~(page_size() - 1);
+		if(first != used_ && mprotect(code_ + first, page_size(), PROT_READ | PROT_WRITE) != 0) return nullptr;
+
+		Emitter e(code_ + used_, CODE_SIZE - used_);
+		Translator t(e);
+
+		// Prologue: save callee-saved registers, load the guest state
+		for(int reg : {RBX, RBP, R12, R13, R14, R15}) e.push(reg);
+		e.sub_rsp(8);
+		e.mov64(CTX, RDI);
+		e.load8(REG_A, CTX, -1, OFF_A);
+		e.load16(REG_BC, CTX, OFF_BC);
+		e.load16(REG_DE, CTX, OFF_DE);
+		e.load16(REG_HL, CTX, OFF_HL);
+		e.load8(REG_F, CTX, -1, OFF_F);
+
+		u16 addr = pc;
+		for(int i = 0; i < count && !t.terminated; i++) {
+			if(!Translator::supported(insns[i])) break; // Interpreter takes over here
+			t.translate(insns[i], addr);
+			addr = static_cast<u16>(addr + insns[i].length);
+		}
+		if(!t.terminated) t.exit_const(addr, t.elapsed);
+		t.emit_stubs();
+
+		// Epilogue: write the guest state back
+		e.bind(t.epilogue);
+		e.store8(REG_A, CTX, -1, OFF_A);
+		e.store16(REG_BC, CTX, OFF_BC);
+		e.store16(REG_DE, CTX, OFF_DE);
+		e.store16(REG_HL, CTX, OFF_HL);
+		e.store8(REG_F, CTX, -1, OFF_F);
+		e.add_rsp(8);
+		for(int reg : {R15, R14, R13, R12, RBP, RBX}) e.pop(reg);
+		e.ret();
+
+		JitCode code = nullptr;
+		if(e.overflow()) full_ = true;
+		else {
+			code = reinterpret_cast<JitCode>(code_ + used_);
+			used_ += (e.size() + 15) & ~static_cast<std::size_t>(15);
+		}
+
+		// Everything emitted so far from the first page on becomes RX
+		std::size_t end = (used_ + page_size() - 1) & ~(page_size() - 1);
+		if(end > first && mprotect(code_ + first, end - first, PROT_READ | PROT_EXEC) != 0) {
+			full_ = true; // Earlier translations in that page can't run either
+			return nullptr;
+		}
+		return code;
+	}
+#else
+	Jit::Jit(Bus& bus) : bus_(bus) {}
+	Jit::~Jit() {}
+	void Jit::reset() {}
+	JitCode Jit::compile(const JitInsn*, int, u16) { return nullptr; }
+#endif
+} // namespace gb
@@ -31,67 +31,34 @@ namespace gb {
 		return false;
 	}
 
-	void Joypad::set_a(bool pressed) {
-		if(!button_.a && pressed) {
-			pending_intr = true;
-			button_.a = true;
-		}
-		else if(!pressed) button_.a = false;
-	}
-
-	void Joypad::set_b(bool pressed) {
-		if(!button_.b && pressed) {
-			pending_intr = true;
-			button_.b = true;
-		}
-		else if(!pressed) button_.b = false;
-	}
-
-	void Joypad::set_select(bool pressed) {
-		if(!button_.select && pressed) {
-			pending_intr = true;
-			button_.select = true;
-		}
-		else if(!pressed) button_.select = false;
-	}
-
-	void Joypad::set_start(bool pressed) {
-		if(!button_.start && pressed) {
-			pending_intr = true;
-			button_.start = true;
-		}
-		else if(!pressed) button_.start = false;
-	}
+	bool Joypad::poll() {
+		// Newly pressed buttons raise the joypad interrupt
+		u8 buttons = host_buttons_.load(std::memory_order_acquire);
+		if(buttons & ~latched_) pending_intr = true;
+		latched_ = buttons;
 
-	void Joypad::set_up(bool pressed) {
-		if(!button_.up && pressed) {
-			pending_intr = true;
-			button_.up = true;
-		}
-		else if(!pressed) button_.up = false;
+		button_.a = buttons & 0x01;
+		button_.b = buttons & 0x02;
+		button_.select = buttons & 0x04;
+		button_.start = buttons & 0x08;
+		button_.right = buttons & 0x10;
+		button_.left = buttons & 0x20;
+		button_.up = buttons & 0x40;
+		button_.down = buttons & 0x80;
+		return pending_intr;
 	}
 
-	void Joypad::set_down(bool pressed) {
-		if(!button_.down && pressed) {
-			pending_intr = true;
-			button_.down = true;
-		}
-		else if(!pressed) button_.down = false;
+	void Joypad::set_button(u8 bit, bool pressed) {
+		if(pressed) host_buttons_.fetch_or(bit, std::memory_order_release);
+		else host_buttons_.fetch_and(static_cast<u8>(~bit), std::memory_order_release);
 	}
 
-	void Joypad::set_left(bool pressed) {
-		if(!button_.left && pressed) {
-			pending_intr = true;
-			button_.left = true;
-		}
-		else if(!pressed) button_.left = false;
-	}
-
-	void Joypad::set_right(bool pressed) {
-		if(!button_.down && pressed) {
-			pending_intr = true;
-			button_.right = true;
-		}
-		else if(!pressed) button_.right = false;
-	}
+	void Joypad::set_a(bool pressed) { set_button(0x01, pressed); }
+	void Joypad::set_b(bool pressed) { set_button(0x02, pressed); }
+	void Joypad::set_select(bool pressed) { set_button(0x04, pressed); }
+	void Joypad::set_start(bool pressed) { set_button(0x08, pressed); }
+	void Joypad::set_right(bool pressed) { set_button(0x10, pressed); }
+	void Joypad::set_left(bool pressed) { set_button(0x20, pressed); }
+	void Joypad::set_up(bool pressed) { set_button(0x40, pressed); }
+	void Joypad::set_down(bool pressed) { set_button(0x80, pressed); }
 } // namespace gb
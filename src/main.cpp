@@ -1,136 +1,329 @@
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gb/bus.hpp"
 #include "gb/cpu.hpp"
 #include "gb/timer.hpp"
 #include "gb/ppu.hpp"
 #include "gb/joypad.hpp"
+#include "gb/video_sink.hpp"
+#include "gb/input_source.hpp"
+#include "gb/scaler.hpp"
+#include "gb/profile.hpp"
+#include "gb/guest_profile.hpp"
+#if GBEMU_SDL
+#include "gb/sdl_backend.hpp"
+#endif
 
 const int CYCLES_PER_FRAME = 70224;
 const double FPS = 59.7275;
 using my_clock = std::chrono::steady_clock;
-const auto frame_dt =
-		std::chrono::duration_cast<my_clock::duration>(
-				std::chrono::duration<double>(1.0 / FPS));
 
+namespace {
+	struct Options {
+		std::string rom;
+		std::string bootrom = "roms/bootix_dmg.bin";
+		bool headless = false;
+		long long frames = 0;  // 0: no limit
+		long long cycles = 0;  // 0: no limit
+		double speed = -1;     // x real time, 0: unlimited; default 1 with a window, 0 headless
+		gb::Decoder decoder = gb::Decoder::Cached;
+		gb::scale::Filter filter = gb::scale::Filter::Nearest;
+		int factor = 1;
+		std::string screenshot; // .ppm of the last frame
+		std::string profile;    // opcode profile output, "-": stdout
+		unsigned long profile_sample = 0;
+		std::string guest_profile; // folded stacks
+		std::string guest_report;  // hot PCs, "-": stdout
+		unsigned long guest_period = 16384;
+		std::string sym;            // default <rom>.sym when it exists
+	};
+
+	volatile std::sig_atomic_t profile_requested = 0;
+	void request_profile(int) { profile_requested = 1; }
+
+	void usage() {
+		std::cout <<
+			"usage: gbemu [options] <rom>\n"
+			"  --bootrom <file>     boot ROM (default roms/bootix_dmg.bin)\n"
+			"  --headless           no window, input or presentation\n"
+			"  --frames <n>         stop after n frames\n"
+			"  --cycles <n>         stop after n cycles\n"
+			"  --speed <x>          x real time, 0 = unlimited (default: 1, headless 0)\n"
+			"  --decoder <name>     switch, table, cached or jit (default cached)\n"
+			"                       jit is experimental and slower than cached on some hosts\n"
+			"  --filter <name>      nearest, scalenx, xbr-lite or lcd-grid\n"
+			"  --scale <n>          window scale factor for --filter, 1~4\n"
+			"  --screenshot <file>  write the last frame as a PPM image\n"
+			"  --profile <file>     opcode profile at exit and on SIGUSR1: a table, JSON for\n"
+			"                       *.json, - for stdout (GBEMU_PROFILE builds)\n"
+			"  --profile-sample <n> also time one in n instructions on the host\n"
+			"  --guest-profile <file>\n"
+			"                       folded guest call stacks at exit and on SIGUSR1, for\n"
+			"                       flamegraph tools (GBEMU_PROFILE builds)\n"
+			"  --guest-report <file>\n"
+			"                       hottest guest PCs, - for stdout\n"
+			"  --guest-period <n>   guest cycles between samples (default 16384)\n"
+			"  --sym <file>         RGBDS symbols for both (default <rom>.sym if present)\n";
+	}
+
+	bool parse_decoder(const std::string& text, gb::Decoder& decoder) {
+		if(text == "switch") decoder = gb::Decoder::Switch;
+		else if(text == "table") decoder = gb::Decoder::Table;
+		else if(text == "cached") decoder = gb::Decoder::Cached;
+		else if(text == "jit") decoder = gb::Decoder::Jit;
+		else return false;
+		return true;
+	}
+
+	bool parse_options(int argc, char** argv, Options& options) {
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+			try {
+				if(arg == "--headless") options.headless = true;
+				else if(arg == "--bootrom" || arg == "--screenshot" || arg == "--decoder" || arg == "--filter" ||
+								arg == "--frames" || arg == "--cycles" || arg == "--speed" || arg == "--scale" ||
+								arg == "--profile" || arg == "--profile-sample" || arg == "--guest-profile" ||
+								arg == "--guest-report" || arg == "--guest-period" || arg == "--sym") {
+					const char* v = value();
+					if(!v) {
+						std::cerr << arg << " needs a value\n";
+						return false;
+					}
+					if(arg == "--bootrom") options.bootrom = v;
+					else if(arg == "--screenshot") options.screenshot = v;
+					else if(arg == "--frames") options.frames = std::stoll(v);
+					else if(arg == "--cycles") options.cycles = std::stoll(v);
+					else if(arg == "--speed") options.speed = std::stod(v);
+					else if(arg == "--scale") options.factor = std::stoi(v);
+					else if(arg == "--profile") options.profile = v;
+					else if(arg == "--profile-sample") options.profile_sample = std::stoul(v);
+					else if(arg == "--guest-profile") options.guest_profile = v;
+					else if(arg == "--guest-report") options.guest_report = v;
+					else if(arg == "--guest-period") options.guest_period = std::stoul(v);
+					else if(arg == "--sym") options.sym = v;
+					else if(arg == "--decoder" && !parse_decoder(v, options.decoder)) {
+						std::cerr << "unknown decoder: " << v << "\n";
+						return false;
+					}
+					else if(arg == "--filter" && !gb::scale::parse(v, options.filter)) {
+						std::cerr << "unknown filter: " << v << "\n";
+						return false;
+					}
+				}
+				else if(arg == "-h" || arg == "--help") return false;
+				else if(!arg.empty() && arg[0] == '-') {
+					std::cerr << "unknown option: " << arg << "\n";
+					return false;
+				}
+				else options.rom = arg;
+			} catch(const std::exception&) {
+				std::cerr << "bad value for " << arg << "\n";
+				return false;
+			}
+		}
+		if(options.rom.empty()) return false;
+		if(options.factor < 1 || options.factor > 4) {
+			std::cerr << "--scale must be 1~4\n";
+			return false;
+		}
+		if(!options.profile.empty() && !GBEMU_PROFILE) {
+			std::cerr << "--profile needs a build with -DGBEMU_PROFILE=ON\n";
+			return false;
+		}
+		if((!options.guest_profile.empty() || !options.guest_report.empty()) && !GBEMU_PROFILE) {
+			std::cerr << "--guest-profile needs a build with -DGBEMU_PROFILE=ON\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool write_ppm(const std::string& path, const gb::PPU& ppu) {
+		std::vector<gb::u32> pixels(160 * 144);
+		ppu.convert_frame(pixels.data());
+		std::ofstream ofs(path, std::ios::binary);
+		if(!ofs) return false;
+		ofs << "P6\n160 144\n255\n";
+		for(gb::u32 pixel : pixels) {
+			// DMG_GRAY is RGBA bytes in memory: R in the low byte
+			char rgb[3] = {static_cast<char>(pixel & 0xFF), static_cast<char>((pixel >> 8) & 0xFF), static_cast<char>((pixel >> 16) & 0xFF)};
+			ofs.write(rgb, 3);
+		}
+		return static_cast<bool>(ofs);
+	}
+
+	bool write_profile(const std::string& path, const gb::OpcodeProfile& profile) {
+		bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		std::string text = json ? profile.json() : profile.table();
+		if(path == "-") {
+			std::cout << text;
+			return true;
+		}
+		std::ofstream ofs(path, std::ios::binary);
+		return static_cast<bool>(ofs << text);
+	}
+
+	bool write_guest_profile(const Options& options, const gb::GuestProfiler& profiler) {
+		if(!options.guest_profile.empty()) {
+			std::ofstream ofs(options.guest_profile, std::ios::binary);
+			if(!(ofs << profiler.folded())) return false;
+		}
+		if(options.guest_report == "-") std::cout << profiler.hot_pcs();
+		else if(!options.guest_report.empty()) {
+			std::ofstream ofs(options.guest_report, std::ios::binary);
+			if(!(ofs << profiler.hot_pcs())) return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if(!parse_options(argc, argv, options)) {
+		usage();
+		return 1;
+	}
 
-int main() {
 	gb::Timer timer;
 	gb::PPU ppu;
 	gb::Joypad joypad;
 	gb::Bus bus(timer, ppu, joypad);
 	gb::CPU cpu(bus);
 	cpu.reset();
-	ppu.initPPU();
-
-	if(!bus.load_bootrom("roms/bootix_dmg.bin")) {
-		std::cout << "load failed\n";
-		return 0;
-	}
-
-	/* Test Rom 1
-	if(!bus.load_cartridge("roms/01-special.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-
-	/* Test Rom 2
-	if(!bus.load_cartridge("roms/02-interrupts.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 3
-	if(!bus.load_cartridge("roms/03-op sp,hl.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 4
-	if(!bus.load_cartridge("roms/04-op r,imm.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 5
-	if(!bus.load_cartridge("roms/05-op rp.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 6
-	if(!bus.load_cartridge("roms/06-ld r,r.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 7
-	if(!bus.load_cartridge("roms/07-jr,jp,call,ret,rst.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 8
-	if(!bus.load_cartridge("roms/08-misc instrs.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-	
-	/* Test Rom 9
-	if(!bus.load_cartridge("roms/09-op r,r.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 10
-	if(!bus.load_cartridge("roms/10-bit ops.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom 11
-	if(!bus.load_cartridge("roms/11-op a,(hl).gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Test Rom: instr_timing.gb
-	if(!bus.load_cartridge("roms/instr_timing.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Game 1: Dr. Mario
-	if(!bus.load_cartridge("roms/Dr. mario.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	} */
-
-	/* Game 2: Tetris */
-	if(!bus.load_cartridge("roms/Tetris.gb")) {
-		std::cout << "load failed\n";
-		return 0;
-	}
-
-
-	auto next_frame = my_clock::now();
-
-	while(ppu.pump_events(joypad)) {
-		int budget = CYCLES_PER_FRAME;
-		while(budget > 0) {
-			int cycles = cpu.step();
-			bus.tick(cycles);
-			budget -= cycles;
-			if(cycles == 0) return 0;
+	cpu.set_decoder(options.decoder);
+
+	gb::OpcodeProfile profile;
+	if(!options.profile.empty()) {
+		profile.set_sample_period(static_cast<gb::u32>(options.profile_sample));
+		cpu.set_profile(&profile);
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, request_profile);
+#endif
+	}
+
+	gb::GuestProfiler guest(static_cast<gb::u32>(options.guest_period));
+	bool guest_profiling = !options.guest_profile.empty() || !options.guest_report.empty();
+	if(guest_profiling) {
+		std::string sym = options.sym;
+		if(sym.empty()) {
+			std::filesystem::path path = std::filesystem::path(options.rom).replace_extension(".sym");
+			if(std::filesystem::exists(path)) sym = path.string();
+		}
+		if(!sym.empty() && !guest.load_symbols(sym)) {
+			std::cout << "load failed: " << sym << "\n";
+			return 1;
+		}
+		cpu.set_guest_profiler(&guest);
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, request_profile);
+#endif
+	}
+
+	// Window when SDL is built in, asked for and a display is there;
+	// headless runs produce no frames at all (the PPU has no sink)
+	gb::NullInputSource null_input;
+	gb::VideoSink* video = nullptr;
+	gb::InputSource* input = &null_input;
+#if GBEMU_SDL
+	gb::SdlVideoSink sdl_video;
+	gb::SdlInputSource sdl_input(&sdl_video);
+	if(!options.headless) {
+		if(sdl_video.open(options.filter, options.factor)) {
+			video = &sdl_video;
+			input = &sdl_input;
+		} else {
+			std::cout << "no display, running headless\n";
 		}
-    next_frame += frame_dt;
-    std::this_thread::sleep_until(next_frame);
+	}
+#endif
+	bool headless = video == nullptr;
+	ppu.set_video_sink(video);
+	if(options.speed < 0) options.speed = headless ? 0 : 1;
+
+	if(!bus.load_bootrom(options.bootrom)) {
+		std::cout << "load failed: " << options.bootrom << "\n";
+		return 1;
+	}
+	if(!bus.load_cartridge(options.rom)) {
+		std::cout << "load failed: " << options.rom << "\n";
+		return 1;
+	}
 
-    auto now = my_clock::now();
-    if (now > next_frame + frame_dt) next_frame = now;
+	// Frame- or cycle-limited, paced to speed x real time unless unlimited
+	long long limit = options.cycles;
+	if(options.frames > 0 && (limit == 0 || options.frames * CYCLES_PER_FRAME < limit)) limit = options.frames * CYCLES_PER_FRAME;
+
+	std::atomic<bool> running{true};
+	long long emulated = 0;
+	auto emulate = [&]() {
+		auto frame_dt = std::chrono::duration_cast<my_clock::duration>(
+				std::chrono::duration<double>(1.0 / (FPS * (options.speed > 0 ? options.speed : 1))));
+		auto next_frame = my_clock::now();
+		while(running.load(std::memory_order_relaxed)) {
+			int budget = CYCLES_PER_FRAME;
+			if(limit > 0 && limit - emulated < budget) budget = static_cast<int>(limit - emulated);
+			int cycles = cpu.run(budget);
+			if(cycles == 0) break;
+			emulated += cycles;
+			if(profile_requested) {
+				profile_requested = 0;
+				if(!options.profile.empty()) write_profile(options.profile, profile);
+				if(guest_profiling) write_guest_profile(options, guest);
+			}
+			if(limit > 0 && emulated >= limit) break;
+			if(options.speed <= 0) continue;
+
+			next_frame += frame_dt;
+			std::this_thread::sleep_until(next_frame);
+
+			auto now = my_clock::now();
+			if (now > next_frame + frame_dt) next_frame = now;
+		}
+		running = false;
+	};
+
+	auto start = my_clock::now();
+	if(headless) {
+		emulate();
+	} else {
+		// Emulation runs on its own paced thread and only publishes frames;
+		// the main thread owns the window, so it polls input and presents
+		std::thread emulation(emulate);
+		while(running && input->poll(joypad)) {
+			if(!video->present()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		running = false;
+		emulation.join();
+	}
+	double seconds = std::chrono::duration<double>(my_clock::now() - start).count();
+
+	// Emulated frames per second and guest MIPS
+	double frames = static_cast<double>(emulated) / CYCLES_PER_FRAME;
+	char line[160];
+	std::snprintf(line, sizeof(line), "%.0f frames in %.3f s: %.1f fps (%.2fx), %.2f MIPS\n",
+			frames, seconds, frames / seconds, frames / seconds / FPS, cpu.get_instructions() / seconds / 1e6);
+	std::cout << line;
+
+	if(!options.profile.empty() && !write_profile(options.profile, profile)) {
+		std::cout << "profile failed: " << options.profile << "\n";
+		return 1;
+	}
+	if(guest_profiling && !write_guest_profile(options, guest)) {
+		std::cout << "guest profile failed\n";
+		return 1;
+	}
+	if(!options.screenshot.empty() && !write_ppm(options.screenshot, ppu)) {
+		std::cout << "screenshot failed: " << options.screenshot << "\n";
+		return 1;
 	}
 	return 0;
 }
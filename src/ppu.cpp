@@ -1,128 +1,41 @@
 #include "gb/ppu.hpp"
-#include "gb/joypad.hpp"
-#include "SDL2/SDL.h"
+#include "gb/compositor.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 namespace gb {
-	void PPU::initPPU() {
-		if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-			std::cerr << "SDL_Init failed: " << SDL_GetError() << "\n";
-			return;
-		}	
-
-		if (SDL_CreateWindowAndRenderer(160, 144, 0, &window_, &renderer_) != 0) {
-			std::cerr << "SDL_CreateWindowAndRenderer failed: " << SDL_GetError() << "\n";
-			SDL_Quit();
-			return;
-		}
-
-		SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
-		SDL_SetWindowSize(window_, 480, 432);
-		SDL_SetWindowResizable(window_, SDL_TRUE);
-
-		// === Texture 생성(핵심) ===
-		texture_ = SDL_CreateTexture(
-				renderer_,
-				SDL_PIXELFORMAT_ABGR8888,      // framebuffer_랑 맞춤
-				SDL_TEXTUREACCESS_STREAMING,   // 매 프레임 업데이트할 거라서
-				160, 144);
-
-	 if (!texture_) {
-			std::cerr << "SDL_CreateTexture failed: " << SDL_GetError() << "\n";
-			shutdownPPU();
-		}
-	}
-
-	void PPU::present() {
-		if(!renderer_ || !texture_) return;
-
-		// framebuffer_ → texture_
-		const int pitch = 160 * 4; // RGBA8888: 4 bytes per pixel
-		if (SDL_UpdateTexture(texture_, nullptr, framebuffer_.data(), pitch) != 0) {
-			std::cerr << "SDL_UpdateTexture failed: " << SDL_GetError() << "\n";
-			return;
-		}
-
-		SDL_RenderClear(renderer_);
-		SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
-		SDL_RenderPresent(renderer_);
-	}
-
-	bool PPU::pump_events(Joypad& joypad) {
-		SDL_Event e;
-		while(SDL_PollEvent(&e)) {
-			if(e.type == SDL_QUIT) return false;
-			if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) return false;
-
-			if(e.type == SDL_KEYDOWN && e.key.repeat == 0) {
-				if(e.key.keysym.sym == SDLK_x) joypad.set_a(true);
-				if(e.key.keysym.sym == SDLK_z) joypad.set_b(true);
-				if(e.key.keysym.sym == SDLK_RETURN) joypad.set_start(true);
-				if(e.key.keysym.sym == SDLK_RSHIFT) joypad.set_select(true);
-				if(e.key.keysym.sym == SDLK_LEFT) joypad.set_left(true);
-				if(e.key.keysym.sym == SDLK_RIGHT) joypad.set_right(true);
-				if(e.key.keysym.sym == SDLK_UP) joypad.set_up(true);
-				if(e.key.keysym.sym == SDLK_DOWN) joypad.set_down(true);
-			}
-
-			if (e.type == SDL_KEYUP) {
-				if(e.key.keysym.sym == SDLK_x) joypad.set_a(false);
-				if(e.key.keysym.sym == SDLK_z) joypad.set_b(false);
-				if(e.key.keysym.sym == SDLK_RETURN) joypad.set_start(false);
-				if(e.key.keysym.sym == SDLK_RSHIFT) joypad.set_select(false);
-				if(e.key.keysym.sym == SDLK_LEFT) joypad.set_left(false);
-				if(e.key.keysym.sym == SDLK_RIGHT) joypad.set_right(false);
-				if(e.key.keysym.sym == SDLK_UP) joypad.set_up(false);
-				if(e.key.keysym.sym == SDLK_DOWN) joypad.set_down(false);
-			}
-		}
-		return true;
-	}	
-
-	void PPU::shutdownPPU() {
-		if (texture_) { SDL_DestroyTexture(texture_); texture_ = nullptr; }
-		if (renderer_) { SDL_DestroyRenderer(renderer_); renderer_ = nullptr; }
-		if (window_) { SDL_DestroyWindow(window_); window_ = nullptr; }
-		SDL_Quit();
+	void PPU::publish_frame() {
+		if(sink_) sink_->submit_frame(framebuffer_.data());
 	}
 
 	void PPU::renderTestPattern(uint32_t frame) {
-		// 1) framebuffer_ 채우기 (RGBA)
+		// 1) framebuffer_ 채우기 (shade)
 		for (int y = 0; y < 144; y++) {
 			for (int x = 0; x < 160; x++) {
-				u8 r=0, g=0, b=0, a=0xFF;
-
 				bool left = (x < 80);
 				bool top  = (y < 72);
 
-				// 4분면 색상 (방향 검증용)
-				if (top && left)      { r = 0xFF; g = 0x00; b = 0x00; } // TL red
-				else if (top && !left){ r = 0x00; g = 0xFF; b = 0x00; } // TR green
-				else if (!top && left){ r = 0x00; g = 0x00; b = 0xFF; } // BL blue
-				else                  { r = 0xFF; g = 0xFF; b = 0xFF; } // BR white
+				// 4분면 shade (방향 검증용)
+				u8 shade;
+				if (top && left)      shade = 0; // TL white
+				else if (top && !left)shade = 1; // TR light gray
+				else if (!top && left)shade = 2; // BL dark gray
+				else                  shade = 0; // BR white
 
-				// 움직이는 컬러바 (업데이트/시간 흐름 검증)
+				// 움직이는 세로줄 (업데이트/시간 흐름 검증)
 				int bar_x = (frame % 160);
 				if (x == bar_x || x == bar_x + 1) {
-					r = 0x00; g = 0x00; b = 0x00; // 검은 세로줄
+					shade = 3; // 검은 세로줄
 				}
 
-				const int idx = (y * 160 + x) * 4;
-				framebuffer_[idx + 0] = r;
-				framebuffer_[idx + 1] = g;
-				framebuffer_[idx + 2] = b;
-				framebuffer_[idx + 3] = a;
+				framebuffer_[y * 160 + x] = shade;
 			}
 		}
 
-		// 2) texture 업데이트
-		SDL_UpdateTexture(texture_, nullptr, framebuffer_.data(), 160 * 4);
-
-		// 3) 렌더
-		SDL_RenderClear(renderer_);
-		SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
-		SDL_RenderPresent(renderer_);
+		// 2) sink로 전달
+		invalidate_lines();
+		publish_frame();
 	}
 	
 	u8 PPU::read8(u16 addr) {
@@ -148,14 +61,37 @@ namespace gb {
 	}
 
 	void PPU::write8(u16 addr, u8 value) {
-		if(addr >= 0x8000 && addr < 0xA000) vram_[addr-0x8000] = value;
+		if(addr >= 0x8000 && addr < 0xA000) {
+			// Rewriting the same value touches nothing
+			u16 offset = addr - 0x8000;
+			if(vram_[offset] == value) return;
+			vram_[offset] = value;
+			if(offset < 0x1800) {
+				decode_tile_row(offset);
+				tile_gen_[offset >> 4] = ++gen_;
+			}
+			else map_gen_[(offset - 0x1800) >> 5] = ++gen_;
+		}
 		else if(addr >= 0xFE00 && addr < 0xFEA0) {
-			oam_[addr-0xFE00]= value;
+			u16 offset = addr - 0xFE00;
+			if(oam_[offset] == value) return;
+
+			// Y moves the entry; X only matters between zero and non-zero
+			u8 old = oam_[offset];
+			oam_[offset] = value;
+			oam_gen_ = ++gen_;
+			if((offset & 0x3) == 0) {
+				mark_sprite_rows(old);
+				mark_sprite_rows(value);
+			} else if((offset & 0x3) == 1 && (old == 0) != (value == 0)) {
+				mark_sprite_rows(oam_[offset - 1]);
+			}
 			//std::cout << "oam write @0x" << std::hex << (int)addr << ", value=@x" << (int)value << std::endl;
 		}
 
 		switch(addr) {
-			case 0xFF40: lcdc_ = value;
+			case 0xFF40: if((lcdc_ ^ value) & 0x04) sprite_rows_valid_.reset(); // sprite height
+									 lcdc_ = value;
 									 break;
 			case 0xFF41: stat_ = (stat_ & 0x07) | (value & 0x78); // CPU only can write to stat_[6:3]
 									 break;
@@ -183,6 +119,17 @@ namespace gb {
 		}
 	}
 
+	void PPU::decode_tile_row(u16 offset) {
+		offset &= ~1;
+		u8 lo = vram_[offset];
+		u8 hi = vram_[offset + 1];
+		u8* row = &tiles_[(offset >> 4 << 6) | ((offset >> 1 & 0x7) << 3)];
+		for(int x = 0; x < 8; x++) {
+			int bit = 7 - x;
+			row[x] = static_cast<u8>(((lo >> bit) & 1) | (((hi >> bit) & 1) << 1));
+		}
+	}
+
 	u8 PPU::tick(int cycles) {
 		u8 intr = 0;
 		dot_cycles += cycles;
@@ -208,7 +155,7 @@ namespace gb {
 			if(next_mode == 1) {
 				stat_ = ((stat_ & 0xFC) | 0x01);
 				intr |= 0x1;
-				present();
+				publish_frame();
 			}
 			else if(next_mode == 2) {
 				stat_ = ((stat_ & 0xFC) | 0x02);
@@ -245,166 +192,157 @@ namespace gb {
 		return intr;
 	}
 
-	void PPU::oam_search() {
-		// Search for total 40 sprites
-		int max_obj = 10;
-		for(int i = 0; i < 40; i++) {
-			if(max_obj == 0) break;
-		  int x_pos = oam_[4 * i + 1];
+	int PPU::cycles_to_event() const {
+		switch(mode) {
+			case 2: return 80 - dot_cycles;
+			case 3: return 172 - dot_cycles;
+			case 0: return 204 - dot_cycles;
+			default: return 456 - dot_cycles;
+		}
+	}
+
+	void PPU::mark_sprite_rows(u8 y_pos) {
+		// Rows y_pos - 16 ~ y_pos - 1 (8 x 16); 8 x 8 sprites cover fewer
+		for(int line = std::max(0, y_pos - 16); line < std::min(144, static_cast<int>(y_pos)); line++) {
+			sprite_rows_valid_.reset(line);
+		}
+	}
+
+	void PPU::build_sprite_row(int line) {
+		// Search for total 40 sprites: the first 10 in OAM order win
+		int height = ((lcdc_ & 0x04) == 0x04) ? 16 : 8;
+		u8 count = 0;
+		for(int i = 0; i < 40 && count < 10; i++) {
 			int y_pos = oam_[4 * i + 0];
-			int tile = oam_[4 * i + 2];
-			int attr = oam_[4 * i + 3];
-
-			if((lcdc_ & 0x04) == 0x04) {
-				// 8 x 16
-				if((x_pos != 0) && (ly_ >= y_pos - 16) && (ly_ < y_pos)) {
-					Sprites sprite = {(u8)x_pos, (u8)y_pos, (u8)tile, (u8)attr};
-					ly_sprites_[10-max_obj] = sprite;
-					max_obj--;
-				}
-			} else {
-				// 8 x 8
-				if((x_pos != 0) && (ly_ >= y_pos - 16) && (ly_ < y_pos - 8)) {
-					Sprites sprite = {(u8)x_pos, (u8)y_pos, (u8)tile, (u8)attr};
-					ly_sprites_[10-max_obj] = sprite;
-					max_obj--;
-				}
+			int x_pos = oam_[4 * i + 1];
+			if((x_pos != 0) && (line >= y_pos - 16) && (line < y_pos - 16 + height)) {
+				sprite_rows_[line][count++] = static_cast<u8>(i);
 			}
 		}
-		sprites_num = 10 - max_obj;
+		sprite_rows_num_[line] = count;
+		sprite_rows_valid_.set(line);
 	}
 
-	void PPU::pixel_transfer() {
-		// Array for priority
-		std::array<u8, 160> color_bit_array{};
-
-		for(int i = 0; i < 160; i++) {
-			// 1. Calculate scrolled coordinate
-			u8 bg_x = (scx_ + i) & 0xFF;
-			u8 bg_y = (scy_ + ly_) & 0xFF;
-
-			// 2. Get tileID by calculated coordinate
-			u64 tilemap_base = (lcdc_ & 0x08) ? 0x9C00 : 0x9800;
-			u8 tileID = vram_[tilemap_base + (bg_x >> 3) + ((bg_y >> 3) << 5) - 0x8000];
-
-			// 3. Get tile data from tileID
-			u16 tiledata_addr;
-			// 3-1. $8000 Addressing
-			if((lcdc_ & 0x10) == 0x10) {
-				tiledata_addr = 0x8000 + tileID * 0x10 + ((bg_y & 0x7) << 1);
-			}
-			// 3-2. $8800 Addressing
-			else {
-				s8 s_tileID = static_cast<s8>(tileID);
-				tiledata_addr = 0x9000 + s_tileID * 0x10 + ((bg_y & 0x7) << 1);
-			}
-			u8 lo = vram_[tiledata_addr - 0x8000];
-			u8 hi = vram_[tiledata_addr - 0x8000 + 1];
-
-			// 4. Select color bit from each tiledata
-			u8 bit = 0x7 - (bg_x & 0x7);
-			u8 color_bit = ((lo & (1 << bit)) >> bit) | (((hi & (1 << bit)) >> bit) << 1);
-
-			// 5. Fill framebuffer
-			u8 shade = (bgp_ >> (color_bit * 2)) & 0x3;
-			u64 idx = (ly_ * 160 + i) << 2;
-			u8 color;
-			color_bit_array[i] = shade;
-
-			switch(shade) {
-				case 0x00: color = 0xFF; // white
-								   break;
-				case 0x01: color = 0xAA; // light gray
-							     break;
-				case 0x02: color = 0x55; // dark gray
-									 break;
-				case 0x03: color = 0x00; // black
-									 break;
-				default: color = 0xFF;
-			}
+	void PPU::oam_search() {
+		// 1. Rescan this line only if OAM changed for it
+		if(!sprite_rows_valid_.test(ly_)) build_sprite_row(ly_);
 
-			framebuffer_[idx] = color;     // R
-			framebuffer_[idx + 1] = color; // G
-			framebuffer_[idx + 2] = color; // B
-			framebuffer_[idx + 3] = 0xFF;  // A
+		// 2. Its sprites, as they are in OAM now
+		sprites_num = sprite_rows_num_[ly_];
+		for(int i = 0; i < sprites_num; i++) {
+			const u8* entry = &oam_[4 * sprite_rows_[ly_][i]];
+			ly_sprites_[i] = Sprites{entry[1], entry[0], entry[2], entry[3]};
 		}
+	}
+
+	bool PPU::line_unchanged() const {
+		const LineCache& line = lines_[ly_];
+		if(!line.valid || !(line.key == line_key())) return false;
+		if(gen_ == line.gen) return true; // no VRAM/OAM change at all since
 
-		// 6. Sprite rendering
+		// 1. Same sprites (OAM search result) on this line
+		if(oam_gen_ > line.gen) {
+			if(line.sprites_num != sprites_num) return false;
+			if(!std::equal(ly_sprites_.begin(), ly_sprites_.begin() + sprites_num, line.sprites.begin())) return false;
+		}
+
+		// 2. Same tilemap row
+		u8 bg_y = (scy_ + ly_) & 0xFF;
+		int map_row = ((lcdc_ & 0x08) ? 32 : 0) + (bg_y >> 3);
+		if(map_gen_[map_row] > line.gen) return false;
+
+		// 3. Same tile data for the 21 background tiles and the sprite tiles
+		u16 tilemap = ((lcdc_ & 0x08) ? 0x1C00 : 0x1800) + ((bg_y >> 3) << 5);
+		for(int i = 0; i < 21; i++) {
+			u8 tileID = vram_[tilemap + (((scx_ >> 3) + i) & 0x1F)];
+			int tile = (lcdc_ & 0x10) ? tileID : 256 + static_cast<s8>(tileID);
+			if(tile_gen_[tile] > line.gen) return false;
+		}
+		for(int i = 0; i < sprites_num; i++) {
+			// 8x16 sprites may use either tile of the pair
+			u8 tile = ly_sprites_[i].tile;
+			if(tile_gen_[tile] > line.gen) return false;
+			if((lcdc_ & 0x04) && tile_gen_[tile ^ 0x01] > line.gen) return false;
+		}
+		return true;
+	}
+
+	void PPU::invalidate_lines() {
+		for(auto& line : lines_) line.valid = false;
+	}
+
+	void PPU::pixel_transfer() {
+		// 0. Nothing this line reads changed since the last frame: its
+		// framebuffer_ row is still right
+		if(line_unchanged()) return;
+
+		// Line buffers with 8 pixels of margin on both sides for sprites
+		// hanging off the screen edges
+		constexpr int MARGIN = 8;
+		std::array<u8, 160> line;                    // BG color indices
+		std::array<u8, 160 + 2 * MARGIN> bg{};       // BG shades (priority)
+		std::array<u8, 160 + 2 * MARGIN> shades{};   // composited shades
+
+		// 1. Background color indices, a decoded tile row at a time
+		u8 bg_y = (scy_ + ly_) & 0xFF;
+		u16 tilemap = ((lcdc_ & 0x08) ? 0x1C00 : 0x1800) + ((bg_y >> 3) << 5);
+		u8 bg_x = scx_;
+		for(int i = 0; i < 160;) {
+			// 2. Tile from the tilemap ($8000 or signed $8800 addressing)
+			u8 tileID = vram_[tilemap + (bg_x >> 3)];
+			int tile = (lcdc_ & 0x10) ? tileID : 256 + static_cast<s8>(tileID);
+
+			// 3. Copy the rest of its row
+			const u8* row = tile_row(tile, bg_y & 0x7);
+			for(int x = bg_x & 0x7; x < 8 && i < 160; x++, i++, bg_x++) line[i] = row[x];
+		}
+
+		// 4. BGP
+		compose::palette(line.data(), bgp_, bg.data() + MARGIN, 160);
+		shades = bg;
+
+		// 5. Sprite rendering
 		for(int i = 0; i < sprites_num; i++) {
 			int sprite_x = ly_sprites_[i].x - 8;
 			int sprite_y = ly_sprites_[i].y - 16;
 			u8 sprite_attr = ly_sprites_[i].attr;
 			u8 sprite_tileID = ly_sprites_[i].tile;
 			u8 sprite_height = ((lcdc_ & 0x04) == 0x04) ? 16 : 8;
-
-			for(int x = 0; x < 8; x++) {
-				if((sprite_x + x < 0) || (sprite_x + x >= 160)) continue;
-				if((ly_ < sprite_y) || (ly_ >= sprite_y + sprite_height)) continue;
-
-				// 6-1. Get tile data from tileID
-				u16 sprite_tile_addr;
-				if(sprite_height == 8) {
-					// Y flip
-					if((sprite_attr & 0x40) == 0x40) {
-						sprite_tile_addr = (sprite_tileID * 0x10) + ((sprite_y + 7 - ly_) << 1);
-					} else sprite_tile_addr = (sprite_tileID * 0x10) + ((ly_ - sprite_y) << 1); 
-				} 
-				else {
-					if((ly_ - sprite_y) < 8) {
-						// Y flip
-						if((sprite_attr & 0x40) == 0x40) {
-							sprite_tile_addr = (sprite_tileID | 0x01) * 0x10 + (((sprite_y + 15 - ly_) & 0x7) << 1);
-						} else sprite_tile_addr = (sprite_tileID & 0xFE) * 0x10 + ((ly_ - sprite_y) << 1);
-					} else {
-						// Y flip
-						if((sprite_attr & 0x40) == 0x40) {
-							sprite_tile_addr = (sprite_tileID & 0xFE) * 0x10 + (((sprite_y + 15 - ly_) & 0x7) << 1);
-						} else sprite_tile_addr = (sprite_tileID | 0x01) * 0x10 + (((ly_ - sprite_y) & 0x7) << 1);
-					}
-				}
-				u8 sprite_lo = vram_[sprite_tile_addr];
-				u8 sprite_hi = vram_[sprite_tile_addr + 1];
-				// 6-2. Select color bit from each tiledata
-				u8 sprite_bit = 0x7 - x;
-				u8 sprite_color_bit = ((sprite_lo & (1 << sprite_bit)) >> sprite_bit) | (((sprite_hi & (1 << sprite_bit)) >> sprite_bit) << 1);
-
-				if(sprite_color_bit == 0x00) continue;
-
-				// 6-3. Fill framebuffer according to palette
-				bool is_obp0 = ((sprite_attr & 0x10) == 0x10) ? false : true;
-				u8 sprite_shade;
-				if(is_obp0) {
-					sprite_shade = (obp0_ >> (sprite_color_bit * 2)) & 0x3;
-				} else {
-					sprite_shade = (obp1_ >> (sprite_color_bit * 2)) & 0x3;
-				}
-				u64 sprite_idx = (ly_ * 160 + sprite_x + x) << 2;
-				u8 sprite_color;
-				switch(sprite_shade) {
-					case 0x00: sprite_color = 0xFF; // white
-										 break;
-					case 0x01: sprite_color = 0xAA; // light gray
-										 break;
-					case 0x02: sprite_color = 0x55; // dark gray
-										 break;
-					case 0x03: sprite_color = 0x00; // black
-										 break;
-					default: sprite_color = 0xFF;
-				}
-
-				// 6-4. Adjust attribute
-				// 6-4-1. Priority check
-				if((sprite_attr & 0x80) != 0x80 || (color_bit_array[sprite_x + x] == 0x00)) {
-					// 6-4-2. X flip check
-					if((sprite_attr & 0x20) == 0x20) {
-						sprite_idx = (ly_ * 160 + sprite_x + (7 - x)) << 2;
-					}
-					framebuffer_[sprite_idx] = sprite_color;     // R
-					framebuffer_[sprite_idx + 1] = sprite_color; // G
-					framebuffer_[sprite_idx + 2] = sprite_color; // B
-					framebuffer_[sprite_idx + 3] = 0xFF; // A
-				}
+			if((ly_ < sprite_y) || (ly_ >= sprite_y + sprite_height)) continue;
+			if(sprite_x >= 160) continue;
+
+			// 5-1. Decoded row of the sprite tile on this line
+			int tile, row;
+			if(sprite_height == 8) {
+				tile = sprite_tileID;
+				row = ((sprite_attr & 0x40) == 0x40) ? (sprite_y + 7 - ly_) : (ly_ - sprite_y); // Y flip
 			}
+			else {
+				bool flip = (sprite_attr & 0x40) == 0x40;
+				bool top = (ly_ - sprite_y) < 8;
+				tile = (top != flip) ? (sprite_tileID & 0xFE) : (sprite_tileID | 0x01);
+				row = (flip ? (sprite_y + 15 - ly_) : (ly_ - sprite_y)) & 0x7;
+			}
+
+			// 5-2. X flip, transparency, BG priority and OBP0/OBP1
+			u8 pal = ((sprite_attr & 0x10) == 0x10) ? obp1_ : obp0_;
+			int at = MARGIN + sprite_x;
+			compose::sprite(shades.data() + at, bg.data() + at, tile_row(tile, row), pal, sprite_attr);
 		}
+
+		// 6. Fill framebuffer
+		std::copy(shades.begin() + MARGIN, shades.begin() + MARGIN + 160, framebuffer_.begin() + ly_ * 160);
+
+		// 7. Remember what it was made from
+		LineCache& cache = lines_[ly_];
+		cache.valid = true;
+		cache.key = line_key();
+		cache.gen = gen_;
+		cache.sprites_num = sprites_num;
+		std::copy(ly_sprites_.begin(), ly_sprites_.begin() + sprites_num, cache.sprites.begin());
+	}
+
+	void PPU::convert_frame(u32* out, const Palette& palette) const {
+		compose::convert(framebuffer_.data(), palette, out, 160 * 144);
 	}
 } // namespace gb
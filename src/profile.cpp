@@ -0,0 +1,138 @@
+#include "gb/profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace gb {
+	namespace {
+		struct Entry {
+			bool cb;
+			u8 opcode;
+			const OpcodeProfile::Stats* stats;
+		};
+
+		// Every opcode that ran, most guest cycles first
+		std::vector<Entry> sorted(const OpcodeProfile& profile) {
+			std::vector<Entry> entries;
+			for(int i = 0; i < 256; i++) {
+				u8 opcode = static_cast<u8>(i);
+				if(profile.get_op(opcode).count) entries.push_back({false, opcode, &profile.get_op(opcode)});
+				if(profile.get_cb(opcode).count) entries.push_back({true, opcode, &profile.get_cb(opcode)});
+			}
+			std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+				return a.stats->cycles > b.stats->cycles;
+			});
+			return entries;
+		}
+
+		std::string op_name(const Entry& entry) {
+			char name[16];
+			std::snprintf(name, sizeof(name), entry.cb ? "CB %02X" : "%02X", entry.opcode);
+			return name;
+		}
+	}
+
+	void OpcodeProfile::reset() {
+		ops_.fill({});
+		cb_.fill({});
+		interrupts_ = interrupt_cycles_ = 0;
+		halt_cycles_ = 0;
+		idle_cycles_ = idle_instructions_ = 0;
+		countdown_ = period_;
+
+		// Back-to-back reads: what a sample costs with nothing in between
+		overhead_ = ~0ull;
+		for(int i = 0; i < 64; i++) {
+			u64 start = ticks();
+			overhead_ = std::min(overhead_, ticks() - start);
+		}
+		start_ticks_ = ticks();
+		start_time_ = std::chrono::steady_clock::now();
+	}
+
+	double OpcodeProfile::ns_per_tick() const {
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time_).count();
+		u64 elapsed = ticks() - start_ticks_;
+		return elapsed ? ns / static_cast<double>(elapsed) : 0.0;
+	}
+
+	std::string OpcodeProfile::table(int top) const {
+		std::vector<Entry> entries = sorted(*this);
+		u64 instructions = 0, op_cycles = 0;
+		for(const Entry& entry : entries) {
+			instructions += entry.stats->count;
+			op_cycles += entry.stats->cycles;
+		}
+		u64 cycles = op_cycles + interrupt_cycles_ + halt_cycles_ + idle_cycles_;
+		auto percent = [](u64 part, u64 whole) { return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0; };
+		double tick_ns = ns_per_tick();
+
+		// 1. Where the guest cycles went
+		std::string out;
+		char line[200];
+		std::snprintf(line, sizeof(line), "%llu instructions, %llu cycles\n",
+				static_cast<unsigned long long>(instructions + idle_instructions_), static_cast<unsigned long long>(cycles));
+		out += line;
+		std::snprintf(line, sizeof(line), "  executed    %6.2f%%\n", percent(op_cycles, cycles));
+		out += line;
+		std::snprintf(line, sizeof(line), "  interrupts  %6.2f%%  (%llu entries)\n", percent(interrupt_cycles_, cycles),
+				static_cast<unsigned long long>(interrupts_));
+		out += line;
+		std::snprintf(line, sizeof(line), "  halt        %6.2f%%\n", percent(halt_cycles_, cycles));
+		out += line;
+		std::snprintf(line, sizeof(line), "  idle skip   %6.2f%%  (%llu instructions)\n", percent(idle_cycles_, cycles),
+				static_cast<unsigned long long>(idle_instructions_));
+		out += line;
+
+		// 2. Opcodes by guest cycles
+		out += "\nop        count   count%       cycles  cycles%  cyc/op   ns/op\n";
+		int shown = 0;
+		for(const Entry& entry : entries) {
+			if(top > 0 && shown++ >= top) break;
+			const Stats& stats = *entry.stats;
+			char ns[16] = "-";
+			if(stats.samples) std::snprintf(ns, sizeof(ns), "%.2f", static_cast<double>(stats.ticks) / stats.samples * tick_ns);
+			std::snprintf(line, sizeof(line), "%-5s %12llu  %6.2f%% %12llu  %6.2f%%  %6.2f  %6s\n", op_name(entry).c_str(),
+					static_cast<unsigned long long>(stats.count), percent(stats.count, instructions),
+					static_cast<unsigned long long>(stats.cycles), percent(stats.cycles, op_cycles),
+					static_cast<double>(stats.cycles) / stats.count, ns);
+			out += line;
+		}
+		return out;
+	}
+
+	std::string OpcodeProfile::json() const {
+		std::vector<Entry> entries = sorted(*this);
+		u64 instructions = 0, op_cycles = 0;
+		for(const Entry& entry : entries) {
+			instructions += entry.stats->count;
+			op_cycles += entry.stats->cycles;
+		}
+		double tick_ns = ns_per_tick();
+
+		auto number = [](u64 value) { return std::to_string(value); };
+		std::string out = "{\n";
+		out += "  \"instructions\": " + number(instructions) + ",\n";
+		out += "  \"cycles\": " + number(op_cycles + interrupt_cycles_ + halt_cycles_ + idle_cycles_) + ",\n";
+		out += "  \"executed_cycles\": " + number(op_cycles) + ",\n";
+		out += "  \"interrupts\": {\"count\": " + number(interrupts_) + ", \"cycles\": " + number(interrupt_cycles_) + "},\n";
+		out += "  \"halt_cycles\": " + number(halt_cycles_) + ",\n";
+		out += "  \"idle_skip\": {\"cycles\": " + number(idle_cycles_) + ", \"instructions\": " + number(idle_instructions_) + "},\n";
+		out += "  \"sample_period\": " + number(period_) + ",\n";
+		out += "  \"ops\": [\n";
+		for(std::size_t i = 0; i < entries.size(); i++) {
+			const Stats& stats = *entries[i].stats;
+			out += "    {\"op\": \"" + op_name(entries[i]) + "\", \"count\": " + number(stats.count) +
+				", \"cycles\": " + number(stats.cycles);
+			if(stats.samples) {
+				char ns[32];
+				std::snprintf(ns, sizeof(ns), "%.3f", static_cast<double>(stats.ticks) / stats.samples * tick_ns);
+				out += ", \"samples\": " + number(stats.samples) + ", \"ns\": " + ns;
+			}
+			out += (i + 1 < entries.size()) ? "},\n" : "}\n";
+		}
+		out += "  ]\n}\n";
+		return out;
+	}
+} // namespace gb
@@ -0,0 +1,138 @@
+#include "gb/rom_image.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GBEMU_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gb {
+	namespace {
+		constexpr std::size_t BANK = 0x4000; // Cartridge ROM bank; images are whole banks
+
+		u64 fnv1a(const u8* data, std::size_t size) {
+			u64 hash = 0xCBF29CE484222325ull;
+			for(std::size_t i = 0; i < size; i++) {
+				hash ^= data[i];
+				hash *= 0x100000001B3ull;
+			}
+			return hash;
+		}
+
+		// Identity of the file behind a path, to notice it being replaced
+		struct FileId {
+			u64 dev = 0, ino = 0, size = 0;
+			s64 mtime = 0;
+			bool operator==(const FileId&) const = default;
+		};
+
+		bool file_id(const std::string &path, FileId& id) {
+#ifdef GBEMU_HAVE_MMAP
+			struct stat st;
+			if(stat(path.c_str(), &st) != 0) return false;
+			id = {static_cast<u64>(st.st_dev), static_cast<u64>(st.st_ino), static_cast<u64>(st.st_size), static_cast<s64>(st.st_mtime)};
+			return true;
+#else
+			(void)path; (void)id;
+			return false;
+#endif
+		}
+
+		struct PathEntry {
+			FileId id;
+			std::weak_ptr<const RomImage> image;
+		};
+
+		// Process-wide cache: by path (no I/O on a hit), then by content hash
+		// so that copies of the same ROM under other names share one image
+		std::mutex cache_mutex;
+		std::unordered_map<std::string, PathEntry> by_path;
+		std::unordered_map<u64, std::weak_ptr<const RomImage>> by_hash;
+	}
+
+	std::shared_ptr<const RomImage> RomImage::open(const std::string &path) {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+
+		// 1. Same path, same file on disk
+		FileId id;
+		bool have_id = file_id(path, id);
+		auto it = by_path.find(path);
+		if(have_id && it != by_path.end() && it->second.id == id) {
+			if(auto image = it->second.image.lock()) return image;
+		}
+
+		// 2. Map (or read) the file
+		std::shared_ptr<RomImage> image(new RomImage());
+		if(!image->map_file(path) && !image->read_file(path)) return nullptr;
+		image->hash_ = fnv1a(image->data_, image->size_);
+
+		// 3. Same contents already loaded under another path
+		std::shared_ptr<const RomImage> shared;
+		auto hit = by_hash.find(image->hash_);
+		if(hit != by_hash.end()) shared = hit->second.lock();
+		if(!shared || shared->size_ != image->size_ || std::memcmp(shared->data_, image->data_, image->size_) != 0) {
+			shared = image;
+			by_hash[image->hash_] = shared;
+		}
+
+		if(have_id) by_path[path] = PathEntry{id, shared};
+		return shared;
+	}
+
+	RomImage::~RomImage() {
+#ifdef GBEMU_HAVE_MMAP
+		if(mapping_) munmap(mapping_, size_);
+#endif
+	}
+
+	bool RomImage::map_file(const std::string &path) {
+#ifdef GBEMU_HAVE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size % BANK != 0) {
+			// Partial last bank: read_file() pads it instead
+			::close(fd);
+			return false;
+		}
+
+		void* mapping = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(mapping == MAP_FAILED) return false;
+
+		mapping_ = mapping;
+		data_ = static_cast<const u8*>(mapping);
+		size_ = static_cast<std::size_t>(st.st_size);
+		return true;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+	bool RomImage::read_file(const std::string &path) {
+		std::ifstream ifs(path, std::ios::binary);
+		if(!ifs) return false;
+
+		ifs.seekg(0, std::ios::end);
+		std::streamsize size = ifs.tellg();
+		ifs.seekg(0, std::ios::beg);
+		if(size <= 0) return false;
+
+		// Pad to whole banks with open-bus bytes
+		buffer_.assign(((static_cast<std::size_t>(size) + BANK - 1) / BANK) * BANK, 0xFF);
+		if(!ifs.read(reinterpret_cast<char*>(buffer_.data()), size)) return false;
+
+		data_ = buffer_.data();
+		size_ = buffer_.size();
+		return true;
+	}
+} // namespace gb
@@ -0,0 +1,136 @@
+#include "gb/save_ram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GBEMU_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gb {
+	SaveRam::~SaveRam() {
+		if(!data_) return;
+
+		// 1. Everything written so far goes to the flusher for a last pass
+		commit();
+		if(thread_.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stop_ = true;
+			}
+			wake_.notify_one();
+			thread_.join();
+		}
+
+#ifdef GBEMU_HAVE_MMAP
+		// 2. Unmap
+		if(mapping_) {
+			munmap(mapping_, size_);
+			return;
+		}
+#endif
+		// 2. Fallback copy: write back the whole file
+		std::ofstream ofs(path_, std::ios::binary | std::ios::trunc);
+		ofs.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+	}
+
+	bool SaveRam::open(const std::string &path, std::size_t size) {
+		path_ = path;
+		size_ = size;
+		std::size_t words = (size / PAGE + 63) / 64;
+		dirty_.assign(words, 0);
+		pending_ = std::make_unique<std::atomic<u64>[]>(words);
+
+#ifdef GBEMU_HAVE_MMAP
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if(fd >= 0) {
+			// A shorter (or new) file grows with zeros; longer ones keep their tail
+			struct stat st;
+			bool sized = fstat(fd, &st) == 0 &&
+									 (static_cast<std::size_t>(st.st_size) >= size || ftruncate(fd, static_cast<off_t>(size)) == 0);
+			void* mapping = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+			::close(fd);
+			if(mapping != MAP_FAILED) {
+				mapping_ = mapping;
+				data_ = static_cast<u8*>(mapping);
+				thread_ = std::thread(&SaveRam::flusher, this);
+				return true;
+			}
+		}
+		std::cout << "save file not mapped, keeping it in memory: " << path << std::endl;
+#endif
+
+		buffer_.assign(size, 0);
+		std::ifstream ifs(path, std::ios::binary);
+		if(ifs) ifs.read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(size));
+		data_ = buffer_.data();
+		return true;
+	}
+
+	bool SaveRam::commit() {
+		if(!any_dirty_) return false;
+		for(std::size_t i = 0; i < dirty_.size(); i++) {
+			if(dirty_[i]) pending_[i].fetch_or(dirty_[i], std::memory_order_release);
+			dirty_[i] = 0;
+		}
+		any_dirty_ = false;
+		return true;
+	}
+
+	void SaveRam::set_interval(std::chrono::milliseconds interval) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			interval_ = interval;
+		}
+		wake_.notify_one();
+	}
+
+	void SaveRam::flusher() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(!stop_) {
+			wake_.wait_for(lock, interval_);
+			lock.unlock();
+			write_pending();
+			lock.lock();
+		}
+		lock.unlock();
+		write_pending();
+	}
+
+	void SaveRam::write_pending() {
+#ifdef GBEMU_HAVE_MMAP
+		// msync() wants host-page-aligned ranges; runs of dirty pages are
+		// widened to host pages and merged
+		std::size_t host_page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		std::size_t begin = 0, end = 0;
+		auto sync = [&]() {
+			if(end > begin) msync(static_cast<u8*>(mapping_) + begin, end - begin, MS_SYNC);
+		};
+
+		std::size_t words = (size_ / PAGE + 63) / 64;
+		for(std::size_t i = 0; i < words; i++) {
+			u64 bits = pending_[i].exchange(0, std::memory_order_acquire);
+			while(bits) {
+				std::size_t page = i * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+				bits &= bits - 1;
+
+				std::size_t lo = (page * PAGE) / host_page * host_page;
+				std::size_t hi = std::min(size_, (page * PAGE + PAGE + host_page - 1) / host_page * host_page);
+				if(lo <= end) end = std::max(end, hi);
+				else {
+					sync();
+					begin = lo;
+					end = hi;
+				}
+			}
+		}
+		sync();
+#endif
+	}
+} // namespace gb
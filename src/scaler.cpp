@@ -0,0 +1,399 @@
+#include "gb/scaler.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifndef GBEMU_SIMD
+#define GBEMU_SIMD 1
+#endif
+
+#if GBEMU_SIMD && (defined(__SSE2__) || defined(_M_X64))
+#define GBEMU_SCALE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace gb::scale {
+	namespace {
+		constexpr int WIDTH = 160;
+		constexpr int HEIGHT = 144;
+		constexpr u8 NONE = 0xFF; // no xBR corner
+
+		u32* row_at(u32* out, int pitch, int y) {
+			return reinterpret_cast<u32*>(reinterpret_cast<u8*>(out) + static_cast<std::ptrdiff_t>(y) * pitch);
+		}
+
+		// Rows past the top and bottom repeat the edge row
+		const u8* clamp_row(const u8* pixels, int width, int height, int y) {
+			return pixels + std::clamp(y, 0, height - 1) * width;
+		}
+
+		u32 mix(u32 a, u32 b) { return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1); }
+		u32 dim(u32 c) { return c - ((c >> 2) & 0x003F3F3F); } // 3/4 brightness, alpha kept
+		u8 dist(u8 a, u8 b) { return a > b ? a - b : b - a; }
+
+		// out[x * factor + k] = in[x]
+		void expand(const u32* in, int count, int factor, u32* out) {
+			int i = 0;
+#if defined(GBEMU_SCALE_SSE2)
+			auto load = [&](int at) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + at)); };
+			auto store = [&](int at, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out + at), v); };
+			if(factor == 2) {
+				for(; i + 4 <= count; i += 4) {
+					__m128i v = load(i);
+					store(i * 2 + 0, _mm_unpacklo_epi32(v, v));
+					store(i * 2 + 4, _mm_unpackhi_epi32(v, v));
+				}
+			} else if(factor == 3) {
+				for(; i + 4 <= count; i += 4) {
+					__m128i v = load(i);
+					store(i * 3 + 0, _mm_shuffle_epi32(v, 0x40)); // 0 0 0 1
+					store(i * 3 + 4, _mm_shuffle_epi32(v, 0xA5)); // 1 1 2 2
+					store(i * 3 + 8, _mm_shuffle_epi32(v, 0xFE)); // 2 3 3 3
+				}
+			} else if(factor == 4) {
+				for(; i + 4 <= count; i += 4) {
+					__m128i v = load(i);
+					store(i * 4 + 0, _mm_shuffle_epi32(v, 0x00));
+					store(i * 4 + 4, _mm_shuffle_epi32(v, 0x55));
+					store(i * 4 + 8, _mm_shuffle_epi32(v, 0xAA));
+					store(i * 4 + 12, _mm_shuffle_epi32(v, 0xFF));
+				}
+			}
+#endif
+			for(; i < count; i++) {
+				for(int k = 0; k < factor; k++) out[i * factor + k] = in[i];
+			}
+		}
+
+#if defined(GBEMU_SCALE_SSE2)
+		__m128i load8(const u8* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+		__m128i select(__m128i mask, __m128i a, __m128i b) {
+			return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+		}
+		__m128i not_equal(__m128i a, __m128i b) {
+			return _mm_xor_si128(_mm_cmpeq_epi8(a, b), _mm_set1_epi8(-1));
+		}
+		__m128i distance(__m128i a, __m128i b) {
+			return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		}
+		__m128i times4(__m128i a) {
+			a = _mm_adds_epu8(a, a);
+			return _mm_adds_epu8(a, a);
+		}
+#endif
+
+		/*
+		 * Scale2x (EPX): each shade becomes 2x2. out0/out1 are the upper and
+		 * lower output rows, 2 * width shades each.
+		 */
+		void scale2x_pixel(const u8* up, const u8* mid, const u8* down, int width, int x, u8* out0, u8* out1) {
+			u8 b = up[x], e = mid[x], h = down[x];
+			u8 d = mid[std::max(x - 1, 0)], f = mid[std::min(x + 1, width - 1)];
+			bool edge = b != h && d != f;
+			out0[2 * x + 0] = (edge && d == b) ? d : e;
+			out0[2 * x + 1] = (edge && b == f) ? f : e;
+			out1[2 * x + 0] = (edge && d == h) ? d : e;
+			out1[2 * x + 1] = (edge && h == f) ? f : e;
+		}
+
+		void scale2x_row(const u8* up, const u8* mid, const u8* down, int width, u8* out0, u8* out1) {
+			scale2x_pixel(up, mid, down, width, 0, out0, out1);
+			int x = 1;
+#if defined(GBEMU_SCALE_SSE2)
+			// 16 pixels whose left and right neighbours are all in the row
+			for(; x + 16 < width; x += 16) {
+				__m128i b = load8(up + x), e = load8(mid + x), h = load8(down + x);
+				__m128i d = load8(mid + x - 1), f = load8(mid + x + 1);
+				__m128i edge = _mm_and_si128(not_equal(b, h), not_equal(d, f));
+				__m128i e0 = select(_mm_and_si128(edge, _mm_cmpeq_epi8(d, b)), d, e);
+				__m128i e1 = select(_mm_and_si128(edge, _mm_cmpeq_epi8(b, f)), f, e);
+				__m128i e2 = select(_mm_and_si128(edge, _mm_cmpeq_epi8(d, h)), d, e);
+				__m128i e3 = select(_mm_and_si128(edge, _mm_cmpeq_epi8(h, f)), f, e);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x), _mm_unpacklo_epi8(e0, e1));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x + 16), _mm_unpackhi_epi8(e0, e1));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x), _mm_unpacklo_epi8(e2, e3));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x + 16), _mm_unpackhi_epi8(e2, e3));
+			}
+#endif
+			for(; x < width; x++) scale2x_pixel(up, mid, down, width, x, out0, out1);
+		}
+
+		/*
+		 * Scale3x (AdvMAME3x): each shade becomes 3x3, rows out0 ~ out2 of
+		 * 3 * width shades.
+		 */
+		void scale3x_pixel(const u8* up, const u8* mid, const u8* down, int width, int x, u8* out0, u8* out1, u8* out2) {
+			int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+			u8 a = up[l], b = up[x], c = up[r];
+			u8 d = mid[l], e = mid[x], f = mid[r];
+			u8 g = down[l], h = down[x], i = down[r];
+			u8* o0 = out0 + 3 * x;
+			u8* o1 = out1 + 3 * x;
+			u8* o2 = out2 + 3 * x;
+			if(b != h && d != f) {
+				o0[0] = d == b ? d : e;
+				o0[1] = ((d == b && e != c) || (b == f && e != a)) ? b : e;
+				o0[2] = b == f ? f : e;
+				o1[0] = ((d == b && e != g) || (d == h && e != a)) ? d : e;
+				o1[1] = e;
+				o1[2] = ((b == f && e != i) || (h == f && e != c)) ? f : e;
+				o2[0] = d == h ? d : e;
+				o2[1] = ((d == h && e != i) || (h == f && e != g)) ? h : e;
+				o2[2] = h == f ? f : e;
+			} else {
+				o0[0] = o0[1] = o0[2] = e;
+				o1[0] = o1[1] = o1[2] = e;
+				o2[0] = o2[1] = o2[2] = e;
+			}
+		}
+
+		void scale3x_row(const u8* up, const u8* mid, const u8* down, int width, u8* out0, u8* out1, u8* out2) {
+			scale3x_pixel(up, mid, down, width, 0, out0, out1, out2);
+			int x = 1;
+#if defined(GBEMU_SCALE_SSE2)
+			for(; x + 16 < width; x += 16) {
+				// 1. The nine outputs for 16 pixels at once
+				__m128i a = load8(up + x - 1), b = load8(up + x), c = load8(up + x + 1);
+				__m128i d = load8(mid + x - 1), e = load8(mid + x), f = load8(mid + x + 1);
+				__m128i g = load8(down + x - 1), h = load8(down + x), i = load8(down + x + 1);
+				__m128i edge = _mm_and_si128(not_equal(b, h), not_equal(d, f));
+				__m128i db = _mm_and_si128(edge, _mm_cmpeq_epi8(d, b));
+				__m128i bf = _mm_and_si128(edge, _mm_cmpeq_epi8(b, f));
+				__m128i dh = _mm_and_si128(edge, _mm_cmpeq_epi8(d, h));
+				__m128i hf = _mm_and_si128(edge, _mm_cmpeq_epi8(h, f));
+				alignas(16) u8 o[9][16];
+				auto put = [&](int k, __m128i v) { _mm_store_si128(reinterpret_cast<__m128i*>(o[k]), v); };
+				put(0, select(db, d, e));
+				put(1, select(_mm_or_si128(_mm_and_si128(db, not_equal(e, c)), _mm_and_si128(bf, not_equal(e, a))), b, e));
+				put(2, select(bf, f, e));
+				put(3, select(_mm_or_si128(_mm_and_si128(db, not_equal(e, g)), _mm_and_si128(dh, not_equal(e, a))), d, e));
+				put(4, e);
+				put(5, select(_mm_or_si128(_mm_and_si128(bf, not_equal(e, i)), _mm_and_si128(hf, not_equal(e, c))), f, e));
+				put(6, select(dh, d, e));
+				put(7, select(_mm_or_si128(_mm_and_si128(dh, not_equal(e, i)), _mm_and_si128(hf, not_equal(e, g))), h, e));
+				put(8, select(hf, f, e));
+
+				// 2. Interleave three per pixel into the output rows
+				for(int k = 0; k < 16; k++) {
+					u8* o0 = out0 + 3 * (x + k);
+					u8* o1 = out1 + 3 * (x + k);
+					u8* o2 = out2 + 3 * (x + k);
+					o0[0] = o[0][k]; o0[1] = o[1][k]; o0[2] = o[2][k];
+					o1[0] = o[3][k]; o1[1] = o[4][k]; o1[2] = o[5][k];
+					o2[0] = o[6][k]; o2[1] = o[7][k]; o2[2] = o[8][k];
+				}
+			}
+#endif
+			for(; x < width; x++) scale3x_pixel(up, mid, down, width, x, out0, out1, out2);
+		}
+
+		/*
+		 * xBR edge rule for one corner of e: k is the diagonal neighbour at
+		 * that corner, p and q the neighbours beside it, pq and qp the pixels
+		 * across p and q, x and y the other two diagonals. Returns the shade
+		 * the corner takes on, or NONE.
+		 */
+		u8 xbr_corner(u8 e, u8 k, u8 p, u8 q, u8 pq, u8 qp, u8 x, u8 y) {
+			if(e == p || e == q) return NONE;
+			int wd1 = dist(e, x) + dist(e, y) + 4 * dist(q, p);
+			int wd2 = dist(q, qp) + dist(p, pq) + 4 * dist(e, k);
+			if(wd1 >= wd2) return NONE;
+			return dist(e, p) <= dist(e, q) ? p : q;
+		}
+
+#if defined(GBEMU_SCALE_SSE2)
+		__m128i xbr_corner(__m128i e, __m128i k, __m128i p, __m128i q, __m128i pq, __m128i qp, __m128i x, __m128i y) {
+			// Sums stay below 19, so signed byte compares are fine
+			__m128i wd1 = _mm_adds_epu8(_mm_adds_epu8(distance(e, x), distance(e, y)), times4(distance(q, p)));
+			__m128i wd2 = _mm_adds_epu8(_mm_adds_epu8(distance(q, qp), distance(p, pq)), times4(distance(e, k)));
+			__m128i edge = _mm_and_si128(_mm_cmplt_epi8(wd1, wd2), _mm_and_si128(not_equal(e, p), not_equal(e, q)));
+			__m128i shade = select(_mm_cmpgt_epi8(distance(e, p), distance(e, q)), q, p);
+			return select(edge, shade, _mm_set1_epi8(static_cast<char>(NONE)));
+		}
+#endif
+
+		// Corners of one source row: TL, TR, BL, BR
+		void xbr_row(const u8* up, const u8* mid, const u8* down, u8 (*corners)[WIDTH]) {
+			auto pixel = [&](int x) {
+				int l = std::max(x - 1, 0), r = std::min(x + 1, WIDTH - 1);
+				u8 a = up[l], b = up[x], c = up[r];
+				u8 d = mid[l], e = mid[x], f = mid[r];
+				u8 g = down[l], h = down[x], i = down[r];
+				corners[0][x] = xbr_corner(e, a, d, b, h, f, g, c);
+				corners[1][x] = xbr_corner(e, c, f, b, h, d, i, a);
+				corners[2][x] = xbr_corner(e, g, d, h, b, f, a, i);
+				corners[3][x] = xbr_corner(e, i, f, h, b, d, c, g);
+			};
+			pixel(0);
+			int x = 1;
+#if defined(GBEMU_SCALE_SSE2)
+			for(; x + 16 < WIDTH; x += 16) {
+				__m128i a = load8(up + x - 1), b = load8(up + x), c = load8(up + x + 1);
+				__m128i d = load8(mid + x - 1), e = load8(mid + x), f = load8(mid + x + 1);
+				__m128i g = load8(down + x - 1), h = load8(down + x), i = load8(down + x + 1);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(corners[0] + x), xbr_corner(e, a, d, b, h, f, g, c));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(corners[1] + x), xbr_corner(e, c, f, b, h, d, i, a));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(corners[2] + x), xbr_corner(e, g, d, h, b, f, a, i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(corners[3] + x), xbr_corner(e, i, f, h, b, d, c, g));
+			}
+#endif
+			for(; x < WIDTH; x++) pixel(x);
+		}
+	}
+
+	const char* name(Filter filter) {
+		switch(filter) {
+			case Filter::Nearest: return "nearest";
+			case Filter::ScaleNx: return "scalenx";
+			case Filter::XbrLite: return "xbr-lite";
+			case Filter::LcdGrid: return "lcd-grid";
+		}
+		return "?";
+	}
+
+	bool parse(const std::string& text, Filter& filter) {
+		for(Filter f : {Filter::Nearest, Filter::ScaleNx, Filter::XbrLite, Filter::LcdGrid}) {
+			if(text == name(f)) {
+				filter = f;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Scaler::Scaler(Filter filter, int factor) : filter_(filter), factor_(std::clamp(factor, 1, 4)) {
+		if(filter_ == Filter::ScaleNx && factor_ == 4) wide_.resize(2 * WIDTH * 2 * HEIGHT);
+		shade_rows_.resize(4 * 4 * WIDTH);
+		host_.resize(4 * WIDTH);
+		dim_.resize(4 * WIDTH);
+	}
+
+	int Scaler::get_reach() const {
+		// ScaleNx 4x is Scale2x of Scale2x: one row of reach per pass
+		if(filter_ == Filter::ScaleNx && factor_ == 4) return 2;
+		return (filter_ == Filter::ScaleNx || filter_ == Filter::XbrLite) && factor_ > 1 ? 1 : 0;
+	}
+
+	void Scaler::run(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch) {
+		switch(filter_) {
+			case Filter::Nearest: run_nearest(shades, palette, first, count, out, pitch); break;
+			case Filter::ScaleNx: run_scale_nx(shades, palette, first, count, out, pitch); break;
+			case Filter::XbrLite: run_xbr_lite(shades, palette, first, count, out, pitch); break;
+			case Filter::LcdGrid: run_lcd_grid(shades, palette, first, count, out, pitch); break;
+		}
+	}
+
+	void Scaler::run_nearest(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch) {
+		int n = factor_;
+		for(int y = 0; y < count; y++) {
+			// 1. Host pixels, widened into the first output row
+			u32* row = row_at(out, pitch, y * n);
+			const u8* src = shades + (first + y) * WIDTH;
+			if(n == 1) {
+				compose::convert(src, palette, row, WIDTH);
+				continue;
+			}
+			compose::convert(src, palette, host_.data(), WIDTH);
+			expand(host_.data(), WIDTH, n, row);
+
+			// 2. Repeated down
+			for(int k = 1; k < n; k++) std::memcpy(row_at(out, pitch, y * n + k), row, WIDTH * n * sizeof(u32));
+		}
+	}
+
+	void Scaler::run_lcd_grid(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch) {
+		int n = factor_;
+		if(n == 1) return run_nearest(shades, palette, first, count, out, pitch);
+
+		Palette dimmed;
+		for(int k = 0; k < 4; k++) dimmed[k] = dim(palette[k]);
+		for(int y = 0; y < count; y++) {
+			const u8* src = shades + (first + y) * WIDTH;
+			u32* row = row_at(out, pitch, y * n);
+			u32* bottom = row_at(out, pitch, y * n + n - 1);
+
+			// 1. Bottom row of each pixel is all border
+			compose::convert(src, dimmed, dim_.data(), WIDTH);
+			expand(dim_.data(), WIDTH, n, bottom);
+
+			// 2. Other rows: the pixel with a border on its right
+			compose::convert(src, palette, host_.data(), WIDTH);
+			expand(host_.data(), WIDTH, n, row);
+			for(int x = 0; x < WIDTH; x++) row[x * n + n - 1] = dim_[x];
+			for(int k = 1; k < n - 1; k++) std::memcpy(row_at(out, pitch, y * n + k), row, WIDTH * n * sizeof(u32));
+		}
+	}
+
+	void Scaler::run_scale_nx(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch) {
+		int n = factor_;
+		if(n == 1) return run_nearest(shades, palette, first, count, out, pitch);
+
+		u8* rows = shade_rows_.data();
+		if(n == 2 || n == 3) {
+			int width = WIDTH * n;
+			for(int y = first; y < first + count; y++) {
+				const u8* up = clamp_row(shades, WIDTH, HEIGHT, y - 1);
+				const u8* mid = shades + y * WIDTH;
+				const u8* down = clamp_row(shades, WIDTH, HEIGHT, y + 1);
+				if(n == 2) scale2x_row(up, mid, down, WIDTH, rows, rows + width);
+				else scale3x_row(up, mid, down, WIDTH, rows, rows + width, rows + 2 * width);
+				for(int k = 0; k < n; k++) compose::convert(rows + k * width, palette, row_at(out, pitch, (y - first) * n + k), width);
+			}
+			return;
+		}
+
+		// 4x: Scale2x of the rows (and their neighbours) into wide_, then
+		// Scale2x again
+		constexpr int WIDE_W = 2 * WIDTH, WIDE_H = 2 * HEIGHT;
+		for(int y = std::max(0, first - 1); y < std::min(HEIGHT, first + count + 1); y++) {
+			const u8* up = clamp_row(shades, WIDTH, HEIGHT, y - 1);
+			const u8* down = clamp_row(shades, WIDTH, HEIGHT, y + 1);
+			scale2x_row(up, shades + y * WIDTH, down, WIDTH, &wide_[2 * y * WIDE_W], &wide_[(2 * y + 1) * WIDE_W]);
+		}
+		for(int y = 2 * first; y < 2 * (first + count); y++) {
+			const u8* up = clamp_row(wide_.data(), WIDE_W, WIDE_H, y - 1);
+			const u8* down = clamp_row(wide_.data(), WIDE_W, WIDE_H, y + 1);
+			scale2x_row(up, &wide_[y * WIDE_W], down, WIDE_W, rows, rows + 2 * WIDE_W);
+			for(int k = 0; k < 2; k++) {
+				compose::convert(rows + k * 2 * WIDE_W, palette, row_at(out, pitch, (y - 2 * first) * 2 + k), 2 * WIDE_W);
+			}
+		}
+	}
+
+	void Scaler::run_xbr_lite(const u8* shades, const Palette& palette, int first, int count, u32* out, int pitch) {
+		int n = factor_;
+		if(n == 1) return run_nearest(shades, palette, first, count, out, pitch);
+
+		// Corner subpixels: s = distance from the pixel's opposite corner;
+		// beyond n takes the edge shade, exactly n is blended with it
+		auto corners = reinterpret_cast<u8 (*)[WIDTH]>(shade_rows_.data());
+		for(int y = first; y < first + count; y++) {
+			// 1. Nearest fill
+			run_nearest(shades, palette, y, 1, row_at(out, pitch, (y - first) * n), pitch);
+
+			// 2. Edge corners on top
+			const u8* up = clamp_row(shades, WIDTH, HEIGHT, y - 1);
+			const u8* mid = shades + y * WIDTH;
+			const u8* down = clamp_row(shades, WIDTH, HEIGHT, y + 1);
+			xbr_row(up, mid, down, corners);
+			for(int x = 0; x < WIDTH; x++) {
+				for(int c = 0; c < 4; c++) {
+					u8 shade = corners[c][x];
+					if(shade == NONE) continue;
+					u32 full = palette[shade];
+					u32 half = mix(palette[mid[x]], full);
+					for(int j = 0; j < n; j++) {
+						u32* dst = row_at(out, pitch, (y - first) * n + j) + x * n;
+						int jj = (c & 2) ? j : n - 1 - j;
+						for(int i = 0; i < n; i++) {
+							int s = ((c & 1) ? i : n - 1 - i) + jj;
+							if(s > n) dst[i] = full;
+							else if(s == n) dst[i] = half;
+						}
+					}
+				}
+			}
+		}
+	}
+} // namespace gb::scale
@@ -0,0 +1,138 @@
+#include "gb/sdl_backend.hpp"
+#include "SDL2/SDL.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace gb {
+	SdlVideoSink::~SdlVideoSink() {
+		if (texture_) { SDL_DestroyTexture(texture_); texture_ = nullptr; }
+		if (renderer_) { SDL_DestroyRenderer(renderer_); renderer_ = nullptr; }
+		if (window_) { SDL_DestroyWindow(window_); window_ = nullptr; }
+		SDL_Quit();
+	}
+
+	bool SdlVideoSink::open(scale::Filter filter, int factor) {
+		scaler_ = scale::Scaler(filter, factor);
+
+		if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+			std::cerr << "SDL_Init failed: " << SDL_GetError() << "\n";
+			return false;
+		}
+
+		if (SDL_CreateWindowAndRenderer(160, 144, 0, &window_, &renderer_) != 0) {
+			std::cerr << "SDL_CreateWindowAndRenderer failed: " << SDL_GetError() << "\n";
+			return false;
+		}
+
+		SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
+		if(scaler_.get_factor() == 1) SDL_SetWindowSize(window_, 480, 432);
+		else SDL_SetWindowSize(window_, scaler_.get_width(), scaler_.get_height());
+		SDL_SetWindowResizable(window_, SDL_TRUE);
+
+		// === Texture 생성(핵심) ===
+		texture_ = SDL_CreateTexture(
+				renderer_,
+				SDL_PIXELFORMAT_ABGR8888,      // palette_ (RGBA bytes)랑 맞춤
+				SDL_TEXTUREACCESS_STREAMING,   // 매 프레임 업데이트할 거라서
+				scaler_.get_width(), scaler_.get_height());
+
+		if (!texture_) {
+			std::cerr << "SDL_CreateTexture failed: " << SDL_GetError() << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	void SdlVideoSink::submit_frame(const u8* shades) {
+		// Emulation side: never waits for the render thread
+		std::copy(shades, shades + 160 * 144, frames_.back().begin());
+		frames_.publish();
+	}
+
+	bool SdlVideoSink::present() {
+		if(!renderer_ || !texture_) return false;
+		if(!frames_.acquire()) return false;
+
+		// 1. Per-row dirty mask against what texture_ already shows; filters
+		// also redraw the rows next to a change
+		const Frame& frame = frames_.front();
+		if(palette_ != shown_palette_) shown_valid_ = false;
+		std::array<bool, 144> dirty{};
+		int reach = scaler_.get_reach();
+		for(int y = 0; y < 144; y++) {
+			if(shown_valid_ && std::memcmp(&frame[y * 160], &shown_[y * 160], 160) == 0) continue;
+			for(int k = std::max(0, y - reach); k <= std::min(143, y + reach); k++) dirty[k] = true;
+		}
+
+		// 2. Each run of dirty rows → locked texture memory
+		for(int y = 0; y < 144;) {
+			if(!dirty[y]) { y++; continue; }
+			int first = y;
+			while(y < 144 && dirty[y]) y++;
+			if(!upload_rows(frame, first, y - first)) {
+				shown_valid_ = false;
+				return false;
+			}
+		}
+		shown_ = frame;
+		shown_palette_ = palette_;
+		shown_valid_ = true;
+
+		SDL_RenderClear(renderer_);
+		SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
+		SDL_RenderPresent(renderer_); // may block on vsync: render thread only
+		return true;
+	}
+
+	bool SdlVideoSink::upload_rows(const Frame& frame, int first, int count) {
+		// Locked memory is write-only and only valid inside the rect: every
+		// row in it is written, each at its own pitch
+		int factor = scaler_.get_factor();
+		SDL_Rect rect{0, first * factor, scaler_.get_width(), count * factor};
+		void* pixels = nullptr;
+		int pitch = 0;
+		if (SDL_LockTexture(texture_, &rect, &pixels, &pitch) != 0) {
+			std::cerr << "SDL_LockTexture failed: " << SDL_GetError() << "\n";
+			return false;
+		}
+		scaler_.run(frame.data(), palette_, first, count, static_cast<u32*>(pixels), pitch);
+		SDL_UnlockTexture(texture_);
+		return true;
+	}
+
+	bool SdlInputSource::poll(Joypad& joypad) {
+		SDL_Event e;
+		while(SDL_PollEvent(&e)) {
+			if(e.type == SDL_QUIT) return false;
+			if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) return false;
+			if(e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+				if(video_) video_->invalidate();
+			}
+
+			if(e.type == SDL_KEYDOWN && e.key.repeat == 0) {
+				if(e.key.keysym.sym == SDLK_x) joypad.set_a(true);
+				if(e.key.keysym.sym == SDLK_z) joypad.set_b(true);
+				if(e.key.keysym.sym == SDLK_RETURN) joypad.set_start(true);
+				if(e.key.keysym.sym == SDLK_RSHIFT) joypad.set_select(true);
+				if(e.key.keysym.sym == SDLK_LEFT) joypad.set_left(true);
+				if(e.key.keysym.sym == SDLK_RIGHT) joypad.set_right(true);
+				if(e.key.keysym.sym == SDLK_UP) joypad.set_up(true);
+				if(e.key.keysym.sym == SDLK_DOWN) joypad.set_down(true);
+			}
+
+			if (e.type == SDL_KEYUP) {
+				if(e.key.keysym.sym == SDLK_x) joypad.set_a(false);
+				if(e.key.keysym.sym == SDLK_z) joypad.set_b(false);
+				if(e.key.keysym.sym == SDLK_RETURN) joypad.set_start(false);
+				if(e.key.keysym.sym == SDLK_RSHIFT) joypad.set_select(false);
+				if(e.key.keysym.sym == SDLK_LEFT) joypad.set_left(false);
+				if(e.key.keysym.sym == SDLK_RIGHT) joypad.set_right(false);
+				if(e.key.keysym.sym == SDLK_UP) joypad.set_up(false);
+				if(e.key.keysym.sym == SDLK_DOWN) joypad.set_down(false);
+			}
+		}
+		return true;
+	}
+} // namespace gb
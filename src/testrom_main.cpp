@@ -0,0 +1,199 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gb/batch.hpp"
+#include "gb/emulator.hpp"
+
+using my_clock = std::chrono::steady_clock;
+
+const double CLOCK_HZ = 4194304;
+
+namespace {
+	// Blargg's cpu_instrs singles and instr_timing, with their cycle budgets
+	// in guest seconds (about 2~3x what a passing run takes)
+	struct SuiteRom {
+		const char* file;
+		double seconds;
+	};
+	const SuiteRom SUITE[] = {
+		{"01-special.gb", 10},
+		{"02-interrupts.gb", 5},
+		{"03-op sp,hl.gb", 10},
+		{"04-op r,imm.gb", 10},
+		{"05-op rp.gb", 15},
+		{"06-ld r,r.gb", 5},
+		{"07-jr,jp,call,ret,rst.gb", 5},
+		{"08-misc instrs.gb", 5},
+		{"09-op r,r.gb", 30},
+		{"10-bit ops.gb", 40},
+		{"11-op a,(hl).gb", 50},
+		{"instr_timing.gb", 10},
+	};
+
+	struct Options {
+		std::vector<std::string> roms; // instead of SUITE
+		std::string dir = "roms";
+		std::string bootrom;           // default <dir>/bootix_dmg.bin
+		std::string report;
+		std::vector<gb::Decoder> decoders = {gb::Decoder::Switch, gb::Decoder::Table, gb::Decoder::Cached, gb::Decoder::Jit};
+		int threads = 0;
+		bool pin = false;
+		double budget = 60;            // guest seconds, ROMs given on the command line
+		double budget_scale = 1;
+		bool verbose = false;
+	};
+
+	void usage() {
+		std::cout <<
+			"usage: gbemu_testroms [options] [rom...]\n"
+			"Runs the test ROM suite in dir (or the given ROMs) headless and in parallel,\n"
+			"once per decoder, and exits non-zero unless every run passes.\n"
+			"  --dir <path>         suite directory (default roms)\n"
+			"  --bootrom <file>     boot ROM (default <dir>/bootix_dmg.bin)\n"
+			"  --decoder <name>     switch, table, cached, jit or all (default all)\n"
+			"  --threads <n>        worker threads (default: one per hardware thread)\n"
+			"  --pin                pin worker i to the i-th usable core\n"
+			"  --budget <s>         guest seconds for ROMs given on the command line (default 60)\n"
+			"  --budget-scale <x>   multiply every budget by x\n"
+			"  --report <file>      JSON report (see gbemu_batch)\n"
+			"  -v, --verbose        serial output of passing runs too\n";
+	}
+
+	const char* decoder_name(gb::Decoder decoder) {
+		switch(decoder) {
+			case gb::Decoder::Switch: return "switch";
+			case gb::Decoder::Table: return "table";
+			case gb::Decoder::Cached: return "cached";
+			case gb::Decoder::Jit: return "jit";
+		}
+		return "?";
+	}
+
+	bool parse_decoders(const std::string& text, std::vector<gb::Decoder>& decoders) {
+		if(text == "all") decoders = {gb::Decoder::Switch, gb::Decoder::Table, gb::Decoder::Cached, gb::Decoder::Jit};
+		else if(text == "switch") decoders = {gb::Decoder::Switch};
+		else if(text == "table") decoders = {gb::Decoder::Table};
+		else if(text == "cached") decoders = {gb::Decoder::Cached};
+		else if(text == "jit") decoders = {gb::Decoder::Jit};
+		else return false;
+		return true;
+	}
+
+	bool parse_options(int argc, char** argv, Options& options) {
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			auto value = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+			try {
+				if(arg == "--pin") options.pin = true;
+				else if(arg == "-v" || arg == "--verbose") options.verbose = true;
+				else if(arg == "--dir" || arg == "--bootrom" || arg == "--decoder" || arg == "--threads" ||
+								arg == "--budget" || arg == "--budget-scale" || arg == "--report") {
+					const char* v = value();
+					if(!v) {
+						std::cerr << arg << " needs a value\n";
+						return false;
+					}
+					if(arg == "--dir") options.dir = v;
+					else if(arg == "--bootrom") options.bootrom = v;
+					else if(arg == "--threads") options.threads = std::stoi(v);
+					else if(arg == "--budget") options.budget = std::stod(v);
+					else if(arg == "--budget-scale") options.budget_scale = std::stod(v);
+					else if(arg == "--report") options.report = v;
+					else if(arg == "--decoder" && !parse_decoders(v, options.decoders)) {
+						std::cerr << "unknown decoder: " << v << "\n";
+						return false;
+					}
+				}
+				else if(arg == "-h" || arg == "--help") return false;
+				else if(!arg.empty() && arg[0] == '-') {
+					std::cerr << "unknown option: " << arg << "\n";
+					return false;
+				}
+				else options.roms.push_back(arg);
+			} catch(const std::exception&) {
+				std::cerr << "bad value for " << arg << "\n";
+				return false;
+			}
+		}
+		if(options.bootrom.empty()) options.bootrom = (std::filesystem::path(options.dir) / "bootix_dmg.bin").string();
+		return true;
+	}
+
+	gb::BatchJob make_job(const Options& options, const std::string& rom, double seconds, gb::Decoder decoder) {
+		gb::BatchJob job;
+		job.name = std::filesystem::path(rom).stem().string();
+		job.rom = rom;
+		job.bootrom = options.bootrom;
+		job.cycles = static_cast<gb::u64>(seconds * options.budget_scale * CLOCK_HZ);
+		job.decoder = decoder;
+		job.test_rom = true;
+		return job;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if(!parse_options(argc, argv, options)) {
+		usage();
+		return 1;
+	}
+
+	// 1. One job per ROM and decoder
+	std::vector<gb::BatchJob> jobs;
+	for(gb::Decoder decoder : options.decoders) {
+		if(options.roms.empty()) {
+			for(const SuiteRom& rom : SUITE) {
+				jobs.push_back(make_job(options, (std::filesystem::path(options.dir) / rom.file).string(), rom.seconds, decoder));
+			}
+		}
+		for(const std::string& rom : options.roms) jobs.push_back(make_job(options, rom, options.budget, decoder));
+	}
+
+	// 2. Run, uncapped and headless
+	gb::WorkStealingPool pool(options.threads, options.pin);
+	auto start = my_clock::now();
+	std::vector<gb::BatchResult> results = gb::run_batch(pool, jobs);
+	double seconds = std::chrono::duration<double>(my_clock::now() - start).count();
+
+	// 3. One line per run; serial output of the ones that did not pass
+	int passed = 0;
+	char line[200];
+	for(std::size_t i = 0; i < jobs.size(); i++) {
+		const gb::BatchJob& job = jobs[i];
+		const gb::BatchResult& result = results[i];
+		bool ok = result.status == "passed";
+		if(ok) passed++;
+
+		std::snprintf(line, sizeof(line), "%-11s %-24s %-6s %7.2f s guest %7.3f s\n", result.status.c_str(),
+				job.name.c_str(), decoder_name(job.decoder), result.cycles / CLOCK_HZ, result.seconds);
+		std::cout << line;
+		if(!ok || options.verbose) {
+			// Non-empty lines, printable characters only
+			std::string text;
+			for(char c : result.serial + "\n") {
+				if(c == '\n') {
+					if(!text.empty()) std::cout << "    | " << text << "\n";
+					text.clear();
+				}
+				else if(c >= 0x20 && c < 0x7F) text += c;
+			}
+		}
+	}
+	std::snprintf(line, sizeof(line), "%d/%zu passed on %d threads in %.3f s\n",
+			passed, jobs.size(), pool.get_threads(), seconds);
+	std::cout << line;
+
+	if(!options.report.empty()) {
+		std::ofstream ofs(options.report, std::ios::binary);
+		if(!(ofs << gb::batch_report(jobs, results, seconds, pool.get_threads()))) {
+			std::cout << "cannot write " << options.report << "\n";
+			return 1;
+		}
+	}
+	return passed == static_cast<int>(jobs.size()) ? 0 : 1;
+}
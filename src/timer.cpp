@@ -29,7 +29,7 @@ namespace gb {
 
 		// 1. DIV increment
 		div_cycles += cycles;
-		if(div_cycles >= 256) {
+		while(div_cycles >= 256) {
 			div_++;
 			div_cycles -= 256;
 		}
@@ -64,4 +64,14 @@ namespace gb {
 		return is_intr;
 
 	}
+
+	int Timer::cycles_to_event() const {
+		int next = 0x10000; // DIV alone raises nothing; just resync now and then
+		if((tac_ & 0x04) == 0x04) {
+			static constexpr int PERIOD[4] = {1024, 16, 64, 256};
+			int overflow = (256 - tima_) * PERIOD[tac_ & 0x03] - static_cast<int>(acc_cycles);
+			if(overflow < next) next = overflow;
+		}
+		return next;
+	}
 } // namespace gb
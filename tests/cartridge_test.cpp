@@ -0,0 +1,232 @@
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "gb/cartridge.hpp"
+
+/*
+ * Mapper registers on synthetic cartridges: every ROM bank carries its own
+ * number at MARK, so the banks behind get_rom0()/get_romx() can be read
+ * back after each register write.
+ */
+namespace {
+	using gb::u8;
+	using gb::u16;
+	using gb::u64;
+
+	const u16 MARK = 0x1000; // bank number, low byte then high byte
+
+	int failures = 0;
+
+	void check(bool ok, const std::string& what) {
+		if(!ok) {
+			std::cout << "FAIL  " << what << "\n";
+			failures++;
+		}
+	}
+
+	// Header type/RAM size codes and banks ROM banks, written to a new temp file
+	std::string write_cart(u8 type, u8 ram_code, int banks) {
+		std::vector<u8> rom(static_cast<std::size_t>(banks) * gb::Cartridge::ROM_BANK, 0x00);
+		for(int bank = 0; bank < banks; bank++) {
+			rom[bank * gb::Cartridge::ROM_BANK + MARK] = static_cast<u8>(bank);
+			rom[bank * gb::Cartridge::ROM_BANK + MARK + 1] = static_cast<u8>(bank >> 8);
+		}
+		rom[0x0147] = type;
+		rom[0x0149] = ram_code;
+
+		// RomImage caches by path, so every cartridge gets a fresh name
+		static int count = 0;
+		std::string name = "gbemu_cart_test_" + std::to_string(count++);
+#if defined(__unix__) || defined(__APPLE__)
+		name += '_';
+		name += std::to_string(getpid());
+#endif
+		std::filesystem::path path = std::filesystem::temp_directory_path() / (name + ".gb");
+		std::ofstream ofs(path, std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+		return path.string();
+	}
+
+	int bank_of(const u8* bank) {
+		return bank ? bank[MARK] | (bank[MARK + 1] << 8) : -1;
+	}
+
+	struct Cart {
+		gb::Cartridge cart;
+		std::string path;
+
+		Cart(u8 type, u8 ram_code, int banks) : path(write_cart(type, ram_code, banks)) {
+			check(cart.load(path, false), "load " + path);
+		}
+		~Cart() { std::filesystem::remove(path); }
+
+		int rom0() const { return bank_of(cart.get_rom0()); }
+		int romx() const { return bank_of(cart.get_romx()); }
+		void write(u16 addr, u8 value, u64 now = 0) { cart.write_rom(addr, value, now); }
+	};
+
+	// 1. MBC1: bank 0 -> 1 in the low 5 bits, upper bits through 0x4000,
+	//    mode 1 moves the upper bits onto 0x0000 and the RAM bank
+	void mbc1() {
+		Cart c(0x03, 0x03, 128); // MBC1 + RAM + battery, 2 MiB, 32 KiB RAM
+		check(c.rom0() == 0 && c.romx() == 1, "mbc1 power-on banks");
+
+		c.write(0x2000, 0x00);
+		check(c.romx() == 1, "mbc1 bank 0 reads as 1");
+		c.write(0x2000, 0x05);
+		check(c.romx() == 5, "mbc1 bank 5");
+		c.write(0x2000, 0x25);
+		check(c.romx() == 5, "mbc1 bank register is 5 bits");
+
+		for(u8 hi = 1; hi < 4; hi++) {
+			c.write(0x4000, hi);
+			c.write(0x2000, 0x00);
+			check(c.romx() == (hi << 5 | 1), "mbc1 bank 0x" + std::to_string(hi << 5) + " aliases to +1");
+			c.write(0x2000, 0x02);
+			check(c.romx() == (hi << 5 | 2), "mbc1 upper bits");
+		}
+
+		// Mode 0: bank 0 fixed, RAM bank 0
+		c.write(0x0000, 0x0A);
+		c.write(0x4000, 0x02);
+		check(c.rom0() == 0, "mbc1 mode 0 keeps bank 0");
+		c.cart.write_ram(0xA000, 0x11, 0);
+
+		// Mode 1: bank 0x40 at 0x0000, RAM bank 2
+		c.write(0x6000, 0x01);
+		check(c.rom0() == 0x40, "mbc1 mode 1 remaps bank 0");
+		check(c.romx() == 0x42, "mbc1 mode 1 romx");
+		check(c.cart.read_ram(0xA000, 0) == 0x00, "mbc1 mode 1 RAM bank 2 is separate");
+		c.cart.write_ram(0xA000, 0x22, 0);
+
+		c.write(0x6000, 0x00);
+		check(c.rom0() == 0, "mbc1 back to mode 0");
+		check(c.cart.read_ram(0xA000, 0) == 0x11, "mbc1 mode 0 RAM bank 0");
+	}
+
+	// 2. MBC5: 9-bit ROM bank (bank 0 selectable), 4-bit RAM bank
+	void mbc5() {
+		Cart c(0x1B, 0x04, 512); // MBC5 + RAM + battery, 8 MiB, 128 KiB RAM
+		c.write(0x2000, 0x00);
+		check(c.romx() == 0, "mbc5 bank 0 is selectable");
+		c.write(0x2000, 0xAB);
+		check(c.romx() == 0xAB, "mbc5 low 8 bits");
+		c.write(0x3000, 0x01);
+		check(c.romx() == 0x1AB, "mbc5 bit 8");
+		c.write(0x2000, 0x00);
+		check(c.romx() == 0x100, "mbc5 bank 0x100");
+		c.write(0x3000, 0x00);
+		check(c.romx() == 0x000, "mbc5 bit 8 cleared");
+		check(c.rom0() == 0, "mbc5 bank 0 fixed");
+
+		c.write(0x0000, 0x0A);
+		for(u8 bank = 0; bank < 16; bank++) {
+			c.write(0x4000, bank);
+			c.cart.write_ram(0xA123, static_cast<u8>(0x80 | bank), 0);
+		}
+		for(u8 bank = 0; bank < 16; bank++) {
+			c.write(0x4000, bank);
+			check(c.cart.read_ram(0xA123, 0) == (0x80 | bank), "mbc5 RAM bank " + std::to_string(bank));
+		}
+
+		// Rumble carts: bit 3 is the motor, not part of the RAM bank
+		Cart r(0x1E, 0x04, 4); // MBC5 + rumble + RAM + battery, 128 KiB RAM
+		r.write(0x0000, 0x0A);
+		r.write(0x4000, 0x01);
+		r.cart.write_ram(0xA000, 0x5A, 0);
+		r.write(0x4000, 0x09);
+		check(r.cart.read_ram(0xA000, 0) == 0x5A, "mbc5 rumble bit keeps RAM bank 1");
+	}
+
+	// 3. RAM enable: 0x0A in the low nibble of 0x0000~0x1FFF
+	void ram_enable() {
+		Cart c(0x03, 0x02, 4); // MBC1 + RAM + battery, 8 KiB RAM
+		check(c.cart.get_ram() == nullptr, "RAM disabled at power-on");
+		check(c.cart.read_ram(0xA000, 0) == 0xFF, "disabled RAM reads 0xFF");
+		c.cart.write_ram(0xA000, 0x42, 0);
+
+		c.write(0x1FFF, 0x1A);
+		check(c.cart.get_ram() != nullptr, "0x1A enables RAM");
+		check(c.cart.read_ram(0xA000, 0) == 0x00, "write while disabled is dropped");
+		c.cart.write_ram(0xA000, 0x42, 0);
+		check(c.cart.read_ram(0xA000, 0) == 0x42, "RAM write");
+
+		c.write(0x0000, 0x00);
+		check(c.cart.get_ram() == nullptr, "0x00 disables RAM");
+		check(c.cart.read_ram(0xA000, 0) == 0xFF, "disabled RAM reads 0xFF again");
+		c.write(0x0000, 0x0A);
+		check(c.cart.read_ram(0xA000, 0) == 0x42, "RAM kept while disabled");
+	}
+
+	// 4. MBC3 RTC: 0x00 -> 0x01 latches the clock as of that write
+	void mbc3_rtc() {
+		const u64 HZ = gb::Cartridge::RTC_HZ;
+		Cart c(0x10, 0x03, 64); // MBC3 + timer + RAM + battery, 1 MiB
+		c.write(0x0000, 0x0A);
+		c.write(0x2000, 0x00);
+		check(c.romx() == 1, "mbc3 bank 0 reads as 1");
+		c.write(0x2000, 0x3F);
+		check(c.romx() == 0x3F, "mbc3 bank 0x3F");
+
+		auto latch = [&](u64 now) {
+			c.write(0x6000, 0x00, now);
+			c.write(0x6000, 0x01, now);
+		};
+		auto reg = [&](u8 select, u64 now) {
+			c.write(0x4000, select, now);
+			return c.cart.read_ram(0xA000, now);
+		};
+
+		// Nothing reads the clock before the latch: it still has to count
+		latch(5 * HZ);
+		check(reg(0x08, 5 * HZ) == 5, "rtc latch catches up to the write");
+		check(reg(0x08, 9 * HZ) == 5, "rtc latched value holds");
+
+		latch(125 * HZ + HZ / 2);
+		check(reg(0x08, 130 * HZ) == 5 && reg(0x09, 130 * HZ) == 2, "rtc 125 s -> 2 min 5 s");
+
+		// Halt stops the clock; writing seconds restarts the second
+		c.write(0x4000, 0x0C, 130 * HZ);
+		c.cart.write_ram(0xA000, 0x40, 130 * HZ);
+		latch(500 * HZ);
+		check(reg(0x08, 500 * HZ) == 10, "rtc halted at 130 s");
+		c.write(0x4000, 0x08, 500 * HZ);
+		c.cart.write_ram(0xA000, 30, 500 * HZ);
+		c.write(0x4000, 0x0C, 500 * HZ);
+		c.cart.write_ram(0xA000, 0x00, 500 * HZ);
+		latch(501 * HZ);
+		check(reg(0x08, 501 * HZ) == 31, "rtc resumes from the written seconds");
+
+		// Day counter carry into bit 0 of the high register
+		c.write(0x4000, 0x0A, 501 * HZ);
+		c.cart.write_ram(0xA000, 23, 501 * HZ);
+		c.write(0x4000, 0x0B, 501 * HZ);
+		c.cart.write_ram(0xA000, 0xFF, 501 * HZ);
+		u64 later = 501 * HZ + 3600 * HZ;
+		latch(later);
+		check(reg(0x0B, later) == 0x00 && (reg(0x0C, later) & 0x01), "rtc day 255 -> 256");
+
+		// RAM banks are still there next to the clock
+		c.write(0x4000, 0x01, later);
+		c.cart.write_ram(0xA000, 0x77, later);
+		check(c.cart.read_ram(0xA000, later) == 0x77, "mbc3 RAM bank 1");
+	}
+}
+
+int main() {
+	mbc1();
+	mbc5();
+	ram_enable();
+	mbc3_rtc();
+	std::cout << (failures ? "FAIL  " : "ok    ") << "cartridge mappers";
+	if(failures) std::cout << ": " << failures << " checks failed";
+	std::cout << "\n";
+	return failures ? 1 : 0;
+}
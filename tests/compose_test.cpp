@@ -0,0 +1,115 @@
+#include <iostream>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "gb/compositor.hpp"
+
+// Built once per backend (see CMakeLists.txt): every gb::compose function on
+// random inputs against the scalar definitions below
+#ifndef GBEMU_COMPOSE_EXPECT
+#define GBEMU_COMPOSE_EXPECT "scalar"
+#endif
+
+namespace {
+	using gb::u8;
+	using gb::u32;
+
+	const int SKIP = 77; // ctest SKIP_RETURN_CODE
+
+	u8 ref_lookup(u8 pal, u8 index) {
+		return (pal >> (index * 2)) & 0x3;
+	}
+
+	void ref_palette(const u8* indices, u8 pal, u8* shades, int count) {
+		for(int i = 0; i < count; i++) shades[i] = ref_lookup(pal, indices[i]);
+	}
+
+	void ref_sprite(u8* line, const u8* bg, const u8* indices, u8 pal, u8 attr) {
+		for(int x = 0; x < 8; x++) {
+			u8 index = (attr & 0x20) ? indices[7 - x] : indices[x];
+			if(index == 0) continue;
+			if((attr & 0x80) && bg[x] != 0) continue;
+			line[x] = ref_lookup(pal, index);
+		}
+	}
+
+	void ref_convert(const u8* shades, const gb::Palette& palette, u32* out, int count) {
+		for(int i = 0; i < count; i++) out[i] = palette[shades[i] & 0x3];
+	}
+
+	bool host_has_backend() {
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+		return __builtin_cpu_supports("avx2");
+#else
+		return true;
+#endif
+	}
+}
+
+int main() {
+	if(std::string(gb::compose::backend()) != GBEMU_COMPOSE_EXPECT) {
+		std::cout << "backend " << gb::compose::backend() << " instead of " << GBEMU_COMPOSE_EXPECT << ", skipped\n";
+		return SKIP;
+	}
+	if(!host_has_backend()) {
+		std::cout << "host lacks " << GBEMU_COMPOSE_EXPECT << ", skipped\n";
+		return SKIP;
+	}
+
+	std::mt19937 rng(0x6B6D);
+	auto byte = [&]() { return static_cast<u8>(rng()); };
+	int failures = 0;
+	auto check = [&](bool ok, const char* what, int round) {
+		if(!ok && failures++ < 10) std::cerr << what << " differs in round " << round << "\n";
+	};
+
+	const int ROUNDS = 20000;
+	for(int round = 0; round < ROUNDS; round++) {
+		// 1. palette(): any length and alignment, color indices 0 ~ 3
+		{
+			u8 indices[256], got[256 + 1], want[256 + 1];
+			int offset = rng() % 32;
+			int count = rng() % (256 - 32);
+			for(u8& index : indices) index = byte() & 0x3;
+			u8 pal = byte();
+			std::memset(got, 0xEE, sizeof(got));
+			std::memset(want, 0xEE, sizeof(want));
+			gb::compose::palette(indices + offset, pal, got + 1, count);
+			ref_palette(indices + offset, pal, want + 1, count);
+			check(std::memcmp(got, want, sizeof(got)) == 0, "palette", round);
+		}
+
+		// 2. sprite(): every flip/priority combination over random lines
+		{
+			u8 line[8], want[8], bg[8], indices[8];
+			for(int x = 0; x < 8; x++) {
+				line[x] = want[x] = byte() & 0x3;
+				bg[x] = (rng() % 3 == 0) ? 0 : byte() & 0x3;
+				indices[x] = byte() & 0x3;
+			}
+			u8 pal = byte();
+			u8 attr = byte();
+			gb::compose::sprite(line, bg, indices, pal, attr);
+			ref_sprite(want, bg, indices, pal, attr);
+			check(std::memcmp(line, want, sizeof(line)) == 0, "sprite", round);
+		}
+
+		// 3. convert(): any shade byte (only the low 2 bits count)
+		{
+			u8 shades[256];
+			u32 got[256 + 1], want[256 + 1];
+			int offset = rng() % 32;
+			int count = rng() % (256 - 32);
+			for(u8& shade : shades) shade = byte();
+			gb::Palette palette = {static_cast<u32>(rng()), static_cast<u32>(rng()), static_cast<u32>(rng()), static_cast<u32>(rng())};
+			for(int i = 0; i <= 256; i++) got[i] = want[i] = 0xDEADBEEF;
+			gb::compose::convert(shades + offset, palette, got + 1, count);
+			ref_convert(shades + offset, palette, want + 1, count);
+			check(std::memcmp(got, want, sizeof(got)) == 0, "convert", round);
+		}
+	}
+
+	std::cout << gb::compose::backend() << ": " << (failures ? "FAILED" : "ok") << " (" << ROUNDS << " rounds)\n";
+	return failures ? 1 : 0;
+}
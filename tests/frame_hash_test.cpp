@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "gb/emulator.hpp"
+
+/*
+ * Golden frame hashes (see Emulator::set_frame_hashing) for the bundled
+ * games on every decoder: any change to CPU timing, PPU rendering or the
+ * compositor that alters a single pixel shows up here.
+ * Usage: gbemu_frame_hash_test [roms dir] [--print]
+ */
+namespace {
+	using gb::u64;
+
+	const int FRAMES = 900;
+	const int EVERY = 100; // frames between checked hashes
+
+	struct Golden {
+		const char* rom;
+		std::vector<u64> hashes; // frames 0, EVERY, 2 * EVERY, ...
+		u64 all;                 // FNV-1a over every frame hash
+	};
+	const Golden GOLDEN[] = {
+		{"Tetris.gb", {0xECA47F6549902B25ull, 0x30F371EB3DC8EB6Dull, 0x6B827BFECA079D3Dull, 0x6B827BFECA079D3Dull, 0x6B827BFECA079D3Dull,
+				0x6B827BFECA079D3Dull, 0x6B827BFECA079D3Dull, 0xEDE67E6BBCC17904ull, 0xEDE67E6BBCC17904ull}, 0x4748D3F22EBAD94Bull},
+		{"Dr. Mario.gb", {0xECA47F6549902B25ull, 0x30F371EB3DC8EB6Dull, 0xB0F0F4C0E1139312ull, 0xB0F0F4C0E1139312ull, 0xB0F0F4C0E1139312ull,
+				0xB0F0F4C0E1139312ull, 0xB0F0F4C0E1139312ull, 0x9D5C00113FAD1B98ull, 0xD2422F91875C7C9Dull}, 0xBB899E9737B7D847ull},
+		// MBC3 + battery RAM, 1 MiB
+		{"pokemon_red.rom", {0xECA47F6549902B25ull, 0x30F371EB3DC8EB6Dull, 0xECA47F6549902B25ull, 0xECA47F6549902B25ull, 0xD8B3E046A0D41325ull,
+				0xED2B3900A312F4D9ull, 0xB4EC134FD35E7419ull, 0xBB6BC27FA0C7E7BEull, 0x9AE8AC5AEBF7E19Bull}, 0x73CFB0F52858C8D7ull},
+	};
+
+	const char* decoder_name(gb::Decoder decoder) {
+		switch(decoder) {
+			case gb::Decoder::Switch: return "switch";
+			case gb::Decoder::Table: return "table";
+			case gb::Decoder::Cached: return "cached";
+			case gb::Decoder::Jit: return "jit";
+		}
+		return "?";
+	}
+
+	bool run(const std::string& dir, const char* rom, gb::Decoder decoder, std::vector<u64>& hashes) {
+		gb::Emulator emulator;
+		if(!emulator.load((std::filesystem::path(dir) / "bootix_dmg.bin").string(), (std::filesystem::path(dir) / rom).string())) return false;
+		emulator.set_decoder(decoder);
+		emulator.set_frame_hashing(true);
+		emulator.run(static_cast<u64>(FRAMES) * gb::Emulator::CYCLES_PER_FRAME);
+		hashes = emulator.get_frame_hashes();
+		return true;
+	}
+
+	u64 digest(const std::vector<u64>& hashes) {
+		return gb::fnv1a(reinterpret_cast<const gb::u8*>(hashes.data()), hashes.size() * sizeof(u64));
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string dir = "roms";
+	bool print = false;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "--print") print = true;
+		else dir = arg;
+	}
+
+	int failures = 0;
+	for(const Golden& golden : GOLDEN) {
+		for(gb::Decoder decoder : {gb::Decoder::Switch, gb::Decoder::Table, gb::Decoder::Cached, gb::Decoder::Jit}) {
+			std::vector<u64> hashes;
+			if(!run(dir, golden.rom, decoder, hashes)) {
+				std::cerr << golden.rom << ": load failed\n";
+				return 1;
+			}
+
+			// 1. Regenerating: the table entry, from the first decoder
+			if(print) {
+				std::printf("\t\t{\"%s\", {", golden.rom);
+				for(std::size_t i = 0; i < hashes.size(); i += EVERY) std::printf("%s0x%016llXull", i ? ", " : "", static_cast<unsigned long long>(hashes[i]));
+				std::printf("}, 0x%016llXull},\n", static_cast<unsigned long long>(digest(hashes)));
+				break;
+			}
+
+			// 2. Sampled frames first, to say where output starts to differ
+			bool ok = true;
+			std::size_t differs = 0;
+			for(std::size_t i = 0; i < golden.hashes.size(); i++) {
+				std::size_t frame = i * EVERY;
+				if(frame >= hashes.size() || hashes[frame] != golden.hashes[i]) {
+					ok = false;
+					differs = frame;
+					break;
+				}
+			}
+			bool sampled = ok;
+			ok = ok && digest(hashes) == golden.all;
+
+			std::cout << (ok ? "ok    " : "FAIL  ") << golden.rom << " (" << decoder_name(decoder) << ", " << hashes.size() << " frames)";
+			if(!sampled) std::cout << ": frame " << differs << " differs";
+			std::cout << "\n";
+			if(!ok) failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}
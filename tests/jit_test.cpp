@@ -0,0 +1,198 @@
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "gb/emulator.hpp"
+
+/*
+ * Native code against the cached interpreter: random instruction mixes in
+ * ROM (the only code Jit translates), run under Cached and Jit side by side
+ * with timer and VBlank interrupts on. After every frame both must have run
+ * the same cycles and agree on registers, flags and state_hash().
+ * Usage: gbemu_jit_test [roms dir]
+ */
+namespace {
+	using gb::u8;
+	using gb::u16;
+	using gb::u32;
+
+	const int PROGRAMS = 12;
+	const int FRAMES = 300;
+
+	const u16 START = 0x0150;
+	const u16 HL = 0xC100; // (HL) operand; H and L are never written
+
+	class Program {
+		public:
+			explicit Program(u32 seed) : rng_(seed), rom_(0x8000, 0x00) {}
+
+			std::vector<u8> build() {
+				// 1. RST vectors return at once; VBlank/timer count in HRAM
+				for(u16 vector = 0x00; vector < 0x40; vector += 0x08) rom_[vector] = 0xC9;
+				place(0x40, {0xF5, 0xF0, 0x90, 0x3C, 0xE0, 0x90, 0xF1, 0xD9}); // PUSH AF / LDH A,(0x90) / INC A / LDH (0x90),A / POP AF / RETI
+				place(0x50, {0xF5, 0xF0, 0x91, 0x3C, 0xE0, 0x91, 0xF1, 0xD9});
+				place(0x100, {0x00, 0xC3, static_cast<u8>(START), static_cast<u8>(START >> 8)});
+
+				// 2. Registers, timer at 262144 Hz, VBlank + timer interrupts
+				code_ = {0x31, 0xF0, 0xDF, 0x21, static_cast<u8>(HL), static_cast<u8>(HL >> 8),
+				         0x01, byte(), byte(), 0x11, byte(), byte(), 0x3E, 0x05, 0xE0, 0x07, 0xE0, 0xFF, 0xFB};
+
+				// 3. Loop body with CALLs into sub, then sub itself
+				u16 loop = at();
+				int count = 80 + static_cast<int>(rng_() % 80);
+				for(int i = 0; i < count; i++) op();
+				emit({0xC3, static_cast<u8>(loop), static_cast<u8>(loop >> 8)});
+				u16 sub = at();
+				for(int i = 0; i < 12; i++) {
+					if(rng_() % 6 == 0) emit({pick({0xC0, 0xC8, 0xD0, 0xD8})}); // RET cc
+					else simple();
+				}
+				emit({0xC9});
+				for(std::size_t i : calls_) {
+					code_[i] = static_cast<u8>(sub);
+					code_[i + 1] = static_cast<u8>(sub >> 8);
+				}
+				place(START, code_);
+				return rom_;
+			}
+		private:
+			u8 byte() { return static_cast<u8>(rng_()); }
+			u8 pick(std::initializer_list<u8> values) { return *(values.begin() + rng_() % values.size()); }
+			u16 at() const { return static_cast<u16>(START + code_.size()); }
+			void emit(std::initializer_list<u8> bytes) { code_.insert(code_.end(), bytes); }
+			void place(u16 addr, const std::vector<u8>& bytes) { std::copy(bytes.begin(), bytes.end(), rom_.begin() + addr); }
+
+			u8 dst() { return pick({0, 1, 2, 3, 7}); }      // B, C, D, E, A
+			u8 src() { return static_cast<u8>(rng_() % 8); } // anything, (HL) too
+
+			// Straight-line ops that leave HL and SP alone
+			void simple() {
+				switch(rng_() % 14) {
+					case 0: case 1: emit({static_cast<u8>(0x80 | (rng_() & 0x38) | src())}); break; // ALU A,r
+					case 2: emit({pick({0xC6, 0xCE, 0xD6, 0xDE, 0xE6, 0xEE, 0xF6, 0xFE}), byte()}); break; // ALU A,n
+					case 3: { // INC/DEC r, (HL)
+						u8 r = (rng_() % 6 == 0) ? 6 : dst();
+						emit({static_cast<u8>((r << 3) | (rng_() % 2 ? 0x04 : 0x05))});
+						break;
+					}
+					case 4: case 5: { // LD r,r' / LD (HL),r
+						u8 d = (rng_() % 6 == 0) ? 6 : dst();
+						u8 s = (d == 6) ? dst() : src();
+						emit({static_cast<u8>(0x40 | (d << 3) | s)});
+						break;
+					}
+					case 6: emit({static_cast<u8>(0x06 | ((rng_() % 6 == 0 ? 6 : dst()) << 3)), byte()}); break; // LD r,n
+					case 7: { // CB: rotates, shifts, SWAP, BIT, RES, SET
+						u8 r = (rng_() % 6 == 0) ? 6 : dst();
+						emit({0xCB, static_cast<u8>((rng_() & 0xF8) | r)});
+						break;
+					}
+					case 8: emit({pick({0x07, 0x0F, 0x17, 0x1F, 0x2F, 0x37, 0x3F, 0x27})}); break; // RLCA... CPL SCF CCF DAA
+					case 9: emit({pick({0x03, 0x0B, 0x13, 0x1B, 0x00})}); break; // INC/DEC BC/DE, NOP
+					case 10: // WRAM and HRAM
+						if(rng_() % 2) emit({pick({0xEA, 0xFA}), static_cast<u8>(rng_() % 0x200), static_cast<u8>(0xC0 + rng_() % 2)});
+						else emit({pick({0xE0, 0xF0}), static_cast<u8>(0x80 + rng_() % 0x10)});
+						break;
+					case 11: emit({pick({0x0A, 0x1A})}); break; // LD A,(BC)/(DE): anywhere, I/O too
+					case 12: emit({0xF0, pick({0x04, 0x05, 0x41, 0x44, 0x0F})}); break; // DIV, TIMA, STAT, LY, IF
+					default: emit({0xE0, pick({0x05, 0x06})}); break; // TIMA, TMA
+				}
+			}
+
+			void op() {
+				switch(rng_() % 12) {
+					case 0: // PUSH rr / POP rr' (AF too: F's low nibble drops)
+						emit({pick({0xC5, 0xD5, 0xF5}), pick({0xC1, 0xD1, 0xF1})});
+						break;
+					case 1: // JR cc over an ALU A,n
+						emit({pick({0x20, 0x28, 0x30, 0x38}), 0x02, pick({0xC6, 0xD6, 0xEE}), byte()});
+						break;
+					case 2: { // JP cc over LD A,(nn)
+						u16 target = static_cast<u16>(at() + 6);
+						emit({pick({0xC2, 0xCA, 0xD2, 0xDA}), static_cast<u8>(target), static_cast<u8>(target >> 8), 0xFA, 0x00, 0xC0});
+						break;
+					}
+					case 3: // CALL / CALL cc sub
+						emit({pick({0xCD, 0xCD, 0xC4, 0xCC, 0xD4, 0xDC})});
+						calls_.push_back(code_.size());
+						emit({0x00, 0x00});
+						break;
+					case 4:
+						emit({static_cast<u8>(0xC7 | ((rng_() % 8) << 3))}); // RST
+						break;
+					case 5:
+						if(rng_() % 8 == 0) emit({0x76}); // HALT until the timer or VBlank
+						else simple();
+						break;
+					default:
+						simple();
+						break;
+				}
+			}
+
+			std::mt19937 rng_;
+			std::vector<u8> rom_;
+			std::vector<u8> code_;
+			std::vector<std::size_t> calls_;
+	};
+
+	std::string write_rom(const std::vector<u8>& rom) {
+		static int count = 0;
+		std::string name = "gbemu_jit_test_" + std::to_string(count++);
+#if defined(__unix__) || defined(__APPLE__)
+		name += '_';
+		name += std::to_string(getpid());
+#endif
+		std::filesystem::path path = std::filesystem::temp_directory_path() / (name + ".gb");
+		std::ofstream ofs(path, std::ios::binary);
+		ofs.write(reinterpret_cast<const char*>(rom.data()), static_cast<std::streamsize>(rom.size()));
+		return path.string();
+	}
+
+	bool same_registers(gb::Emulator& a, gb::Emulator& b) {
+		gb::Registers x = a.get_cpu().get_registers(), y = b.get_cpu().get_registers();
+		return x.af == y.af && x.bc == y.bc && x.de == y.de && x.hl == y.hl && x.sp == y.sp && x.pc == y.pc;
+	}
+}
+
+int main(int argc, char** argv) {
+#ifndef GBEMU_JIT
+	std::cout << "skip  jit: built without GBEMU_JIT\n";
+	return 77;
+#endif
+	std::string dir = (argc > 1) ? argv[1] : "roms";
+	std::string bootrom = (std::filesystem::path(dir) / "bootix_dmg.bin").string();
+
+	int failures = 0;
+	for(int n = 0; n < PROGRAMS; n++) {
+		std::string path = write_rom(Program(0x1700 + n).build());
+		gb::Emulator cached, jit;
+		if(!cached.load(bootrom, path) || !jit.load(bootrom, path)) {
+			std::cerr << "load failed: " << path << "\n";
+			return 1;
+		}
+		cached.set_decoder(gb::Decoder::Cached);
+		jit.set_decoder(gb::Decoder::Jit);
+
+		int differs = -1;
+		for(int frame = 0; frame < FRAMES && differs < 0; frame++) {
+			cached.run(gb::Emulator::CYCLES_PER_FRAME);
+			jit.run(gb::Emulator::CYCLES_PER_FRAME);
+			if(cached.get_cycles() != jit.get_cycles() || !same_registers(cached, jit) || cached.state_hash() != jit.state_hash()) differs = frame;
+		}
+		std::filesystem::remove(path);
+
+		std::cout << (differs < 0 ? "ok    " : "FAIL  ") << "program " << n << " (" << cached.get_instructions() << " instructions)";
+		if(differs >= 0) std::cout << ": frame " << differs << " differs";
+		std::cout << "\n";
+		if(differs >= 0) failures++;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <algorithm>
+#include <initializer_list>
+#include <random>
+
+#include "gb/ppu.hpp"
+
+/*
+ * Line cache exactness: pixel_transfer() keeps a line's previous row when
+ * line_unchanged() says nothing it reads was written since. After random
+ * VRAM/OAM/register writes, every line must come out as a copy of the PPU
+ * with all lines invalidated renders it.
+ */
+namespace {
+	using gb::u8;
+	using gb::u16;
+	using gb::u32;
+
+	const int FRAMES = 8000;
+
+	int stat_mode(gb::PPU& ppu) { return ppu.read8(0xFF41) & 0x3; }
+
+	// Next mode change (there is no state in between)
+	void step(gb::PPU& ppu) { ppu.tick(ppu.cycles_to_event()); }
+
+	// Small value sets, so that lines often read what they read before
+	u8 pick(std::mt19937& rng, std::initializer_list<u8> values) {
+		return *(values.begin() + rng() % values.size());
+	}
+
+	void random_write(std::mt19937& rng, gb::PPU& ppu) {
+		u32 kind = rng() % 16;
+		if(kind < 6) { // tile data, mostly the first tiles of both blocks
+			ppu.write8(static_cast<u16>(((rng() & 1) ? 0x8000 : 0x9000) + rng() % 0x200), pick(rng, {0x00, 0xFF, 0x3C, static_cast<u8>(rng())}));
+		}
+		else if(kind < 10) { // either tilemap
+			ppu.write8(static_cast<u16>(0x9800 + rng() % 0x800), static_cast<u8>(rng() % 0x20));
+		}
+		else if(kind < 14) { // OAM: Y, X, tile, attributes
+			u16 entry = static_cast<u16>(0xFE00 + 4 * (rng() % 40));
+			switch(rng() % 4) {
+				case 0: ppu.write8(entry, static_cast<u8>(rng() % 170)); break;
+				case 1: ppu.write8(entry + 1, static_cast<u8>(rng() % 176)); break;
+				case 2: ppu.write8(entry + 2, static_cast<u8>(rng() % 0x20)); break;
+				default: ppu.write8(entry + 3, pick(rng, {0x00, 0x10, 0x20, 0x40, 0x80, 0xF0})); break;
+			}
+		}
+		else if(kind == 14) { // LCDC: tilemap, tile data and sprite size bits
+			ppu.write8(0xFF40, pick(rng, {0x93, 0x97, 0x9B, 0x83}));
+		}
+		else { // SCY, SCX, BGP, OBP0, OBP1
+			u16 addr = pick(rng, {0x42, 0x43, 0x47, 0x48, 0x49});
+			ppu.write8(static_cast<u16>(0xFF00 | addr), addr < 0x47 ? pick(rng, {0, 5}) : pick(rng, {0xE4, 0x1B}));
+		}
+	}
+
+	// One frame from line 0's OAM search: now and then a few writes before
+	// a line's transfer, the same ones for the same seed
+	long run_frame(gb::PPU& ppu, u32 seed) {
+		std::mt19937 rng(seed);
+		long writes = 0;
+		for(int line = 0; line < 144; line++) {
+			while(stat_mode(ppu) != 2) step(ppu);
+			if(rng() % 8 == 0) {
+				int count = 1 + static_cast<int>(rng() % 3);
+				for(int i = 0; i < count; i++) random_write(rng, ppu);
+				writes += count;
+			}
+			step(ppu);
+		}
+		while(stat_mode(ppu) != 1) step(ppu);
+		while(stat_mode(ppu) != 2) step(ppu);
+		return writes;
+	}
+}
+
+int main() {
+	std::mt19937 rng(0x11CE);
+	gb::PPU ppu;
+
+	// 1. Something to draw: random tiles and maps, sprites on screen
+	for(u16 addr = 0x8000; addr < 0xA000; addr++) ppu.write8(addr, static_cast<u8>(addr < 0x9800 ? rng() : rng() % 0x20));
+	for(u16 entry = 0xFE00; entry < 0xFEA0; entry += 4) {
+		ppu.write8(entry, static_cast<u8>(16 + rng() % 144));
+		ppu.write8(entry + 1, static_cast<u8>(8 + rng() % 160));
+		ppu.write8(entry + 2, static_cast<u8>(rng() % 0x20));
+		ppu.write8(entry + 3, static_cast<u8>(rng() & 0xF0));
+	}
+	ppu.write8(0xFF40, 0x93);
+	ppu.write8(0xFF47, 0xE4);
+	ppu.write8(0xFF48, 0xE4);
+	ppu.write8(0xFF49, 0x1B);
+
+	// 2. Every frame with the cache and again with every line invalidated
+	int mismatches = 0;
+	long writes = 0;
+	for(int frame = 0; frame < FRAMES; frame++) {
+		u32 seed = static_cast<u32>(rng());
+		gb::PPU fresh = ppu;
+		fresh.invalidate_lines();
+		writes += run_frame(ppu, seed);
+		run_frame(fresh, seed);
+
+		const u8* cached = ppu.get_framebuffer();
+		const u8* rendered = fresh.get_framebuffer();
+		for(int ly = 0; ly < 144; ly++) {
+			if(std::equal(cached + ly * 160, cached + (ly + 1) * 160, rendered + ly * 160)) continue;
+			if(mismatches++ < 10) std::cout << "FAIL  frame " << frame << ", line " << ly << "\n";
+		}
+	}
+
+	std::cout << (mismatches ? "FAIL  " : "ok    ") << "line cache: " << FRAMES << " frames, " << writes << " writes";
+	if(mismatches) std::cout << ", " << mismatches << " lines differ";
+	std::cout << "\n";
+	return mismatches ? 1 : 0;
+}
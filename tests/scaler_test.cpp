@@ -0,0 +1,149 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gb/scaler.hpp"
+
+/*
+ * 1. Dirty-row redraw against full frames: SdlVideoSink::present() redraws
+ *    only the rows within Scaler::get_reach() of a changed source row, so
+ *    that must give the same pixels as scaling the whole new frame.
+ * 2. Full frames against golden hashes. Built once with SIMD and once with
+ *    GBEMU_SIMD=0 (see CMakeLists.txt), so the SSE2 row kernels and the
+ *    scalar per-pixel rules must agree.
+ * Usage: gbemu_scaler_test [--print]
+ */
+namespace {
+	using gb::u8;
+	using gb::u32;
+	using gb::u64;
+
+	const int WIDTH = 160;
+	const int HEIGHT = 144;
+
+	// Blocks and strokes, so the edge rules fire often
+	void random_frame(std::mt19937& rng, std::vector<u8>& shades) {
+		for(int y = 0; y < HEIGHT; y++) {
+			for(int x = 0; x < WIDTH; x++) {
+				shades[y * WIDTH + x] = (rng() % 4 == 0) ? static_cast<u8>(rng() & 0x3) : static_cast<u8>(((x >> 2) ^ (y >> 2)) & 0x1) * 3;
+			}
+		}
+	}
+
+	const int GOLDEN_FRAMES = 20;
+
+	struct Golden {
+		gb::scale::Filter filter;
+		int factor;
+		u64 hash; // FNV-1a over GOLDEN_FRAMES scaled frames
+	};
+	const Golden GOLDEN[] = {
+		{gb::scale::Filter::Nearest, 1, 0x64C4688AA8AC7794ull},
+		{gb::scale::Filter::Nearest, 2, 0x1A4E1CB5022E3B65ull},
+		{gb::scale::Filter::Nearest, 3, 0x16929A106700DCECull},
+		{gb::scale::Filter::Nearest, 4, 0x72D710BC8FB71825ull},
+		{gb::scale::Filter::ScaleNx, 1, 0x64C4688AA8AC7794ull},
+		{gb::scale::Filter::ScaleNx, 2, 0xE1FEE1EE31200DB7ull},
+		{gb::scale::Filter::ScaleNx, 3, 0x047A74219F7B9FD7ull},
+		{gb::scale::Filter::ScaleNx, 4, 0xE3342236E4B2D8D7ull},
+		{gb::scale::Filter::XbrLite, 1, 0x64C4688AA8AC7794ull},
+		{gb::scale::Filter::XbrLite, 2, 0x037A9A6296ED787Full},
+		{gb::scale::Filter::XbrLite, 3, 0xAC2EB3E630730042ull},
+		{gb::scale::Filter::XbrLite, 4, 0x8B852A6B1193736Dull},
+		{gb::scale::Filter::LcdGrid, 1, 0x64C4688AA8AC7794ull},
+		{gb::scale::Filter::LcdGrid, 2, 0x720E9935CA9A6DD4ull},
+		{gb::scale::Filter::LcdGrid, 3, 0xF460E3164F24A125ull},
+		{gb::scale::Filter::LcdGrid, 4, 0xAA886CDB3C9CE07Cull},
+	};
+
+	const char* enumerator(gb::scale::Filter filter) {
+		switch(filter) {
+			case gb::scale::Filter::Nearest: return "Nearest";
+			case gb::scale::Filter::ScaleNx: return "ScaleNx";
+			case gb::scale::Filter::XbrLite: return "XbrLite";
+			case gb::scale::Filter::LcdGrid: return "LcdGrid";
+		}
+		return "?";
+	}
+
+	u64 fnv1a(const u8* data, std::size_t size, u64 hash) {
+		for(std::size_t i = 0; i < size; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+		return hash;
+	}
+
+	u64 full_frames(gb::scale::Filter filter, int factor) {
+		std::mt19937 rng(0xF1A7);
+		std::vector<u8> shades(WIDTH * HEIGHT);
+		gb::scale::Scaler scaler(filter, factor);
+		std::vector<u32> out(scaler.get_width() * scaler.get_height());
+		u64 hash = 0xcbf29ce484222325ull;
+		for(int frame = 0; frame < GOLDEN_FRAMES; frame++) {
+			random_frame(rng, shades);
+			scaler.run(shades.data(), gb::DMG_GRAY, 0, HEIGHT, out.data(), scaler.get_width() * static_cast<int>(sizeof(u32)));
+			hash = fnv1a(reinterpret_cast<const u8*>(out.data()), out.size() * sizeof(u32), hash);
+		}
+		return hash;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool print = argc > 1 && std::string(argv[1]) == "--print";
+	if(print) {
+		for(auto filter : {gb::scale::Filter::Nearest, gb::scale::Filter::ScaleNx, gb::scale::Filter::XbrLite, gb::scale::Filter::LcdGrid}) {
+			for(int factor = 1; factor <= 4; factor++) {
+				std::printf("\t\t{gb::scale::Filter::%s, %d, 0x%016llXull},\n", enumerator(filter), factor,
+						static_cast<unsigned long long>(full_frames(filter, factor)));
+			}
+		}
+		return 0;
+	}
+
+	std::mt19937 rng(0x5CA1E);
+	std::vector<u8> before(WIDTH * HEIGHT), after(WIDTH * HEIGHT);
+	int failures = 0;
+
+	for(auto filter : {gb::scale::Filter::Nearest, gb::scale::Filter::ScaleNx, gb::scale::Filter::XbrLite, gb::scale::Filter::LcdGrid}) {
+		for(int factor = 1; factor <= 4; factor++) {
+			gb::scale::Scaler scaler(filter, factor);
+			int width = scaler.get_width(), height = scaler.get_height();
+			int pitch = width * static_cast<int>(sizeof(u32));
+			int reach = scaler.get_reach();
+			std::vector<u32> partial(width * height), full(width * height);
+
+			const int TRIALS = 50;
+			int differ = 0;
+			for(int trial = 0; trial < TRIALS; trial++) {
+				// 1. Old frame on screen, one source row changes
+				random_frame(rng, before);
+				scaler.run(before.data(), gb::DMG_GRAY, 0, HEIGHT, partial.data(), pitch);
+				after = before;
+				int row = static_cast<int>(rng() % HEIGHT);
+				for(int x = 0; x < WIDTH; x++) after[row * WIDTH + x] = static_cast<u8>(rng() & 0x3);
+
+				// 2. Redraw rows row - reach ~ row + reach only, as present() does
+				int first = std::max(0, row - reach);
+				int last = std::min(HEIGHT - 1, row + reach);
+				scaler.run(after.data(), gb::DMG_GRAY, first, last - first + 1, partial.data() + first * factor * width, pitch);
+
+				// 3. Against the whole new frame
+				scaler.run(after.data(), gb::DMG_GRAY, 0, HEIGHT, full.data(), pitch);
+				if(partial != full) differ++;
+			}
+
+			std::cout << (differ ? "FAIL  " : "ok    ") << gb::scale::name(filter) << " x" << factor << " (reach " << reach << ")";
+			if(differ) std::cout << ": " << differ << " of " << TRIALS << " trials differ";
+			std::cout << "\n";
+			if(differ) failures++;
+		}
+	}
+
+	for(const Golden& golden : GOLDEN) {
+		bool ok = full_frames(golden.filter, golden.factor) == golden.hash;
+		std::cout << (ok ? "ok    " : "FAIL  ") << gb::scale::name(golden.filter) << " x" << golden.factor << " full frames\n";
+		if(!ok) failures++;
+	}
+	return failures ? 1 : 0;
+}
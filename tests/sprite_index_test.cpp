@@ -0,0 +1,79 @@
+#include <iostream>
+#include <algorithm>
+#include <random>
+
+#include "gb/ppu.hpp"
+
+/*
+ * Sprite index against a brute-force scan: after random OAM and LCDC
+ * writes, the sprites oam_search() picks for each line from the rows
+ * mark_sprite_rows()/build_sprite_row() keep must be the first 10 of all
+ * 40 entries that cover the line, in OAM order.
+ */
+namespace {
+	using gb::u8;
+	using gb::u16;
+
+	const int LINES = 600000;
+
+	int stat_mode(gb::PPU& ppu) { return ppu.read8(0xFF41) & 0x3; }
+
+	// Next mode change (there is no state in between)
+	void step(gb::PPU& ppu) { ppu.tick(ppu.cycles_to_event()); }
+
+	void random_write(std::mt19937& rng, gb::PPU& ppu) {
+		if(rng() % 16 == 0) {
+			ppu.write8(0xFF40, static_cast<u8>(0x83 | (rng() & 0x04))); // sprite height
+			return;
+		}
+
+		// Y around the screen (off-screen too), X often 0 (hidden), any tile
+		u16 addr = static_cast<u16>(0xFE00 + rng() % 0xA0);
+		switch(addr & 0x3) {
+			case 0: ppu.write8(addr, static_cast<u8>(rng() % 176)); break;
+			case 1: ppu.write8(addr, (rng() % 2) ? 0 : static_cast<u8>(rng())); break;
+			default: ppu.write8(addr, static_cast<u8>(rng())); break;
+		}
+	}
+
+	// The first 10 OAM entries covering line
+	int scan(gb::PPU& ppu, int line, gb::Sprites* out) {
+		int height = (ppu.read8(0xFF40) & 0x04) ? 16 : 8;
+		int count = 0;
+		for(u16 entry = 0xFE00; entry < 0xFEA0 && count < 10; entry += 4) {
+			gb::Sprites sprite{ppu.read8(entry + 1), ppu.read8(entry), ppu.read8(entry + 2), ppu.read8(entry + 3)};
+			if(sprite.x != 0 && line >= sprite.y - 16 && line < sprite.y - 16 + height) out[count++] = sprite;
+		}
+		return count;
+	}
+}
+
+int main() {
+	std::mt19937 rng(0x0A45);
+	gb::PPU ppu;
+	ppu.write8(0xFF40, 0x83);
+
+	// Writes land anywhere in the frame (VBlank too); each line's OAM search
+	// is checked when it happens
+	int mismatches = 0;
+	long writes = 0;
+	for(int n = 0; n < LINES; n++) {
+		int count = (rng() % 4) ? 0 : 1 + static_cast<int>(rng() % 2);
+		for(int i = 0; i < count; i++) random_write(rng, ppu);
+		writes += count;
+
+		do step(ppu); while(stat_mode(ppu) != 2);
+
+		int ly = ppu.read8(0xFF44);
+		gb::Sprites expected[10];
+		int num = scan(ppu, ly, expected);
+		if(num != ppu.get_sprites_num() || !std::equal(expected, expected + num, ppu.get_sprites())) {
+			if(mismatches++ < 10) std::cout << "FAIL  line " << ly << " after " << writes << " writes\n";
+		}
+	}
+
+	std::cout << (mismatches ? "FAIL  " : "ok    ") << "sprite index: " << LINES << " lines, " << writes << " writes";
+	if(mismatches) std::cout << ", " << mismatches << " lines differ";
+	std::cout << "\n";
+	return mismatches ? 1 : 0;
+}